@@ -86,6 +86,24 @@ function App() {
       setTick(tick)
       setStatus(`Tick: ${tick} | Time: ${safeToFixed(simTime, 2)}s | dt: ${safeToFixed(deltaTime, 4)}s`)
 
+      if (delta.reset) {
+        const kept = new Set(Array.isArray(delta.created) ? delta.created.map(e => e && e.id) : [])
+        for (const [id, mesh] of entitiesRef.current) {
+          if (kept.has(id)) continue
+          scene.remove(mesh)
+          mesh.geometry.dispose()
+          mesh.material.dispose()
+          entitiesRef.current.delete(id)
+        }
+        for (const [id, velLine] of velocityLinesRef.current) {
+          if (kept.has(id)) continue
+          scene.remove(velLine)
+          velLine.geometry.dispose()
+          velLine.material.dispose()
+          velocityLinesRef.current.delete(id)
+        }
+      }
+
       if (Array.isArray(delta.created)) {
         for (const entity of delta.created) {
           if (!entity || !entity.id) continue
@@ -78,6 +78,11 @@ private:
   }
 
   void update_stage(const navora::sim::StateDelta& delta) {
+    // A reset delta carries the whole world in created.
+    if (delta.reset()) {
+      stage_->RemovePrim(pxr::SdfPath("/World/Entities"));
+    }
+
     for (const auto& entity : delta.updated()) {
       std::string path_str = "/World/Entities/" + entity.id();
       pxr::SdfPath path(path_str);
@@ -0,0 +1,168 @@
+#pragma once
+
+#include "util/checkpoint.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace navora {
+
+// Names an entity independently of where its body is stored. index selects a
+// slot in an EntityTable and generation must match the slot's current one, so
+// a handle to a removed entity stays invalid after the slot is reused.
+// Generation 0 is never issued: a default-constructed handle is null.
+struct EntityHandle {
+  uint32_t index = 0;
+  uint32_t generation = 0;
+
+  EntityHandle() = default;
+  EntityHandle(uint32_t index, uint32_t generation) : index(index), generation(generation) {}
+
+  bool is_null() const { return generation == 0; }
+  explicit operator bool() const { return generation != 0; }
+
+  // Packed form for the wire; 0 is the null handle.
+  uint64_t to_u64() const { return (static_cast<uint64_t>(generation) << 32) | index; }
+  static EntityHandle from_u64(uint64_t value) {
+    return EntityHandle(static_cast<uint32_t>(value), static_cast<uint32_t>(value >> 32));
+  }
+
+  bool operator==(const EntityHandle& other) const {
+    return index == other.index && generation == other.generation;
+  }
+  bool operator!=(const EntityHandle& other) const { return !(*this == other); }
+};
+
+// Name used for an entity that was created without one, wherever a name is
+// required (USD prim paths, exported scenes).
+inline std::string default_entity_name(EntityHandle handle) {
+  return "entity_" + std::to_string(handle.index) + "_" + std::to_string(handle.generation);
+}
+
+// Slot map from handles to dense indices (e.g. body indices in a BodyStore).
+// Lookup is one array access plus a generation compare. Freed slots are
+// threaded into a free list and reused with their generation bumped.
+class EntityTable {
+public:
+  static constexpr uint32_t NO_INDEX = 0xffffffffu;
+
+  // Allocates a handle that resolves to dense.
+  EntityHandle insert(uint32_t dense) {
+    uint32_t index;
+    if (free_head_ != NO_INDEX) {
+      index = free_head_;
+      free_head_ = slots_[index].dense;
+    } else {
+      index = static_cast<uint32_t>(slots_.size());
+      slots_.push_back({1, 0});
+    }
+    slots_[index].dense = dense;
+    live_++;
+    return EntityHandle(index, slots_[index].generation);
+  }
+
+  bool contains(EntityHandle handle) const {
+    return handle.index < slots_.size() && slots_[handle.index].generation == handle.generation &&
+           !handle.is_null();
+  }
+
+  // Dense index of a live handle, or NO_INDEX.
+  uint32_t find(EntityHandle handle) const {
+    return contains(handle) ? slots_[handle.index].dense : NO_INDEX;
+  }
+
+  // Points a live handle at a new dense index, e.g. after a swap-remove moved
+  // its data.
+  void relocate(EntityHandle handle, uint32_t dense) { slots_[handle.index].dense = dense; }
+
+  // Invalidates a live handle and frees its slot.
+  void erase(EntityHandle handle) {
+    free_slot(handle.index);
+    live_--;
+  }
+
+  size_t size() const { return live_; }
+
+  // Frees every slot. Handles issued before stay invalid.
+  void clear() {
+    free_head_ = NO_INDEX;
+    for (uint32_t index = static_cast<uint32_t>(slots_.size()); index-- > 0;) {
+      free_slot(index);
+    }
+    live_ = 0;
+  }
+
+  void save(util::CheckpointWriter& writer) const {
+    writer.add(util::CHECKPOINT_ENTITY_SLOTS, slots_);
+    writer.add_value(util::CHECKPOINT_ENTITY_TABLE, State{free_head_, 0, live_});
+  }
+
+  // dense_count is the number of dense indices the saved table mapped to.
+  // False unless the free list is a chain of distinct slots ending in NO_INDEX
+  // and the other slots map one to one onto [0, dense_count).
+  bool load(const util::CheckpointReader& reader, size_t dense_count) {
+    State state;
+    if (!reader.read(util::CHECKPOINT_ENTITY_SLOTS, slots_) ||
+        !reader.read_value(util::CHECKPOINT_ENTITY_TABLE, state) || state.live != dense_count) {
+      return false;
+    }
+    std::vector<bool> free(slots_.size(), false);
+    size_t free_count = 0;
+    for (uint32_t index = state.free_head; index != NO_INDEX; index = slots_[index].dense) {
+      if (index >= slots_.size() || free[index]) return false;
+      free[index] = true;
+      free_count++;
+    }
+    if (free_count + dense_count != slots_.size()) return false;
+    std::vector<bool> mapped(dense_count, false);
+    for (uint32_t index = 0; index < slots_.size(); ++index) {
+      const Slot& slot = slots_[index];
+      if (slot.generation == 0) return false;
+      if (free[index]) continue;
+      if (slot.dense >= dense_count || mapped[slot.dense]) return false;
+      mapped[slot.dense] = true;
+    }
+    free_head_ = state.free_head;
+    live_ = dense_count;
+    return true;
+  }
+
+private:
+  struct Slot {
+    uint32_t generation;
+    // Dense index while live, next free slot while free.
+    uint32_t dense;
+  };
+
+  void free_slot(uint32_t index) {
+    Slot& slot = slots_[index];
+    slot.generation = (slot.generation == 0xffffffffu) ? 1 : slot.generation + 1;
+    slot.dense = free_head_;
+    free_head_ = index;
+  }
+
+  struct State {
+    uint32_t free_head;
+    uint32_t reserved;
+    uint64_t live;
+  };
+
+  std::vector<Slot> slots_;
+  uint32_t free_head_ = NO_INDEX;
+  size_t live_ = 0;
+};
+
+}
+
+namespace std {
+
+template <>
+struct hash<navora::EntityHandle> {
+  size_t operator()(const navora::EntityHandle& handle) const noexcept {
+    return hash<uint64_t>()(handle.to_u64());
+  }
+};
+
+}
@@ -2,24 +2,42 @@
 #include "physics/rigid_body.h"
 #include <iostream>
 
-int main() {
+static void build_default_scene(navora::Simulator& sim) {
+  navora::physics::RigidBody floor;
+  floor.is_static = true;
+  floor.shape.type = navora::physics::ShapeType::PLANE;
+  floor.shape.normal = navora::physics::Vector3(0, 1, 0);
+  floor.shape.offset = 0.0;
+  floor.transform.position = navora::physics::Vector3(0, -5, 0);
+  sim.create_entity("floor", floor);
+
+  navora::physics::RigidBody sphere;
+  sphere.mass = 1.0;
+  sphere.inv_mass = 1.0;
+  sphere.shape.type = navora::physics::ShapeType::SPHERE;
+  sphere.shape.size = navora::physics::Vector3(1.0, 1.0, 1.0);
+  sphere.transform.position = navora::physics::Vector3(0, 5, 0);
+  sim.create_entity("sphere_0", sphere);
+}
+
+// sim_runner [scene.usd]: a USD build can start from a scene file instead of
+// the built-in floor and sphere.
+int main(int argc, char** argv) {
   navora::Simulator sim;
 
+  if (argc > 1) {
 #ifdef USD_FOUND
-  auto* floor = sim.get_scene().create_entity("floor");
-  floor->body.is_static = true;
-  floor->body.shape.type = navora::physics::ShapeType::PLANE;
-  floor->body.shape.normal = navora::physics::Vector3(0, 1, 0);
-  floor->body.shape.offset = 0.0;
-  floor->body.transform.position = navora::physics::Vector3(0, -5, 0);
-
-  auto* sphere = sim.get_scene().create_entity("sphere_0");
-  sphere->body.mass = 1.0;
-  sphere->body.inv_mass = 1.0;
-  sphere->body.shape.type = navora::physics::ShapeType::SPHERE;
-  sphere->body.shape.size = navora::physics::Vector3(1.0, 1.0, 1.0);
-  sphere->body.transform.position = navora::physics::Vector3(0, 5, 0);
+    if (!sim.load_usd(argv[1])) {
+      std::cerr << "Failed to load " << argv[1] << "\n";
+      return 1;
+    }
+#else
+    std::cerr << "Loading " << argv[1] << " requires a build with USD\n";
+    return 1;
 #endif
+  } else {
+    build_default_scene(sim);
+  }
 
   sim.start();
 
@@ -31,6 +49,9 @@ int main() {
     }
   }
 
+  const auto& arena = sim.get_integrator().get_frame_arena();
+  std::cout << "Frame arena: peak " << arena.peak_bytes() << " bytes, "
+            << arena.last_frame_heap_allocations() << " arena heap allocations last frame\n";
+
   return 0;
 }
-
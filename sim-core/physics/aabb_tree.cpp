@@ -0,0 +1,273 @@
+#include "aabb_tree.h"
+
+namespace navora::physics {
+
+bool AABBTree::ray_hits_box(const Vector3& origin, const Vector3& inv_dir, const AABB& box, double max_t) {
+  double t_min = 0.0;
+  double t_max = max_t;
+
+  const double o[3] = {origin.x, origin.y, origin.z};
+  const double inv[3] = {inv_dir.x, inv_dir.y, inv_dir.z};
+  const double lo[3] = {box.min.x, box.min.y, box.min.z};
+  const double hi[3] = {box.max.x, box.max.y, box.max.z};
+
+  for (int axis = 0; axis < 3; ++axis) {
+    if (std::isinf(inv[axis])) {
+      if (o[axis] < lo[axis] || o[axis] > hi[axis]) return false;
+      continue;
+    }
+    double t1 = (lo[axis] - o[axis]) * inv[axis];
+    double t2 = (hi[axis] - o[axis]) * inv[axis];
+    if (t1 > t2) std::swap(t1, t2);
+    t_min = std::max(t_min, t1);
+    t_max = std::min(t_max, t2);
+    if (t_min > t_max) return false;
+  }
+  return true;
+}
+
+int32_t AABBTree::allocate_node() {
+  if (free_list_ != NULL_NODE) {
+    int32_t id = free_list_;
+    free_list_ = nodes_[id].parent;
+    nodes_[id] = Node();
+    return id;
+  }
+  nodes_.emplace_back();
+  return static_cast<int32_t>(nodes_.size() - 1);
+}
+
+void AABBTree::free_node(int32_t id) {
+  nodes_[id].parent = free_list_;
+  nodes_[id].height = -1;
+  free_list_ = id;
+}
+
+int32_t AABBTree::insert(const AABB& box, uint32_t user_data) {
+  int32_t leaf = allocate_node();
+  nodes_[leaf].box = box;
+  nodes_[leaf].user_data = user_data;
+  insert_leaf(leaf);
+  return leaf;
+}
+
+void AABBTree::remove(int32_t proxy) {
+  remove_leaf(proxy);
+  free_node(proxy);
+}
+
+void AABBTree::move(int32_t proxy, const AABB& fat_box) {
+  remove_leaf(proxy);
+  nodes_[proxy].box = fat_box;
+  insert_leaf(proxy);
+}
+
+void AABBTree::clear() {
+  nodes_.clear();
+  root_ = NULL_NODE;
+  free_list_ = NULL_NODE;
+}
+
+void AABBTree::save(util::CheckpointWriter& writer) const {
+  writer.add(util::CHECKPOINT_QUERY_TREE_NODES, nodes_);
+  writer.add_value(util::CHECKPOINT_QUERY_TREE, Roots{root_, free_list_});
+}
+
+bool AABBTree::load(const util::CheckpointReader& reader) {
+  Roots roots;
+  if (!reader.read(util::CHECKPOINT_QUERY_TREE_NODES, nodes_) ||
+      !reader.read_value(util::CHECKPOINT_QUERY_TREE, roots)) {
+    return false;
+  }
+  const int32_t count = static_cast<int32_t>(nodes_.size());
+  if (nodes_.size() > static_cast<size_t>(std::numeric_limits<int32_t>::max())) return false;
+  auto in_range = [count](int32_t id) { return id >= 0 && id < count; };
+
+  // Each node may be reached once, from the free list or from the root.
+  std::vector<bool> seen(nodes_.size(), false);
+  size_t reached = 0;
+  for (int32_t id = roots.free_list; id != NULL_NODE; id = nodes_[id].parent) {
+    if (!in_range(id) || seen[id] || nodes_[id].height != -1) return false;
+    seen[id] = true;
+    reached++;
+  }
+  if (roots.root != NULL_NODE) {
+    if (!in_range(roots.root) || nodes_[roots.root].parent != NULL_NODE) return false;
+    std::vector<int32_t> stack{roots.root};
+    while (!stack.empty()) {
+      const int32_t id = stack.back();
+      stack.pop_back();
+      if (seen[id]) return false;
+      seen[id] = true;
+      reached++;
+      const Node& node = nodes_[id];
+      if (node.is_leaf()) {
+        if (node.right != NULL_NODE || node.height != 0) return false;
+        continue;
+      }
+      if (!in_range(node.left) || !in_range(node.right) || nodes_[node.left].parent != id ||
+          nodes_[node.right].parent != id || node.height < 1) {
+        return false;
+      }
+      stack.push_back(node.left);
+      stack.push_back(node.right);
+    }
+  }
+  if (reached != nodes_.size()) return false;
+
+  root_ = roots.root;
+  free_list_ = roots.free_list;
+  return true;
+}
+
+size_t AABBTree::leaf_count() const {
+  size_t leaves = 0;
+  for (const Node& node : nodes_) {
+    if (node.height >= 0 && node.is_leaf()) leaves++;
+  }
+  return leaves;
+}
+
+void AABBTree::insert_leaf(int32_t leaf) {
+  if (root_ == NULL_NODE) {
+    root_ = leaf;
+    nodes_[leaf].parent = NULL_NODE;
+    return;
+  }
+
+  // Descend towards the sibling that minimises the added surface area.
+  const AABB leaf_box = nodes_[leaf].box;
+  int32_t index = root_;
+  while (!nodes_[index].is_leaf()) {
+    const Node& node = nodes_[index];
+    double area = node.box.area();
+    double combined_area = node.box.merged(leaf_box).area();
+    double cost = 2.0 * combined_area;
+    double inheritance_cost = 2.0 * (combined_area - area);
+
+    auto child_cost = [&](int32_t child) {
+      const Node& c = nodes_[child];
+      double merged_area = c.box.merged(leaf_box).area();
+      return c.is_leaf() ? merged_area + inheritance_cost
+                         : (merged_area - c.box.area()) + inheritance_cost;
+    };
+
+    double cost_left = child_cost(node.left);
+    double cost_right = child_cost(node.right);
+    if (cost < cost_left && cost < cost_right) break;
+    index = (cost_left < cost_right) ? node.left : node.right;
+  }
+
+  int32_t sibling = index;
+  int32_t old_parent = nodes_[sibling].parent;
+  int32_t new_parent = allocate_node();
+  nodes_[new_parent].parent = old_parent;
+  nodes_[new_parent].box = nodes_[sibling].box.merged(leaf_box);
+  nodes_[new_parent].height = nodes_[sibling].height + 1;
+  nodes_[new_parent].left = sibling;
+  nodes_[new_parent].right = leaf;
+  nodes_[sibling].parent = new_parent;
+  nodes_[leaf].parent = new_parent;
+
+  if (old_parent == NULL_NODE) {
+    root_ = new_parent;
+  } else if (nodes_[old_parent].left == sibling) {
+    nodes_[old_parent].left = new_parent;
+  } else {
+    nodes_[old_parent].right = new_parent;
+  }
+
+  refit_from(new_parent);
+}
+
+void AABBTree::remove_leaf(int32_t leaf) {
+  if (leaf == root_) {
+    root_ = NULL_NODE;
+    return;
+  }
+
+  int32_t parent = nodes_[leaf].parent;
+  int32_t grand_parent = nodes_[parent].parent;
+  int32_t sibling = (nodes_[parent].left == leaf) ? nodes_[parent].right : nodes_[parent].left;
+
+  if (grand_parent == NULL_NODE) {
+    root_ = sibling;
+    nodes_[sibling].parent = NULL_NODE;
+    free_node(parent);
+    return;
+  }
+
+  if (nodes_[grand_parent].left == parent) {
+    nodes_[grand_parent].left = sibling;
+  } else {
+    nodes_[grand_parent].right = sibling;
+  }
+  nodes_[sibling].parent = grand_parent;
+  free_node(parent);
+  refit_from(grand_parent);
+}
+
+void AABBTree::refit_from(int32_t id) {
+  while (id != NULL_NODE) {
+    id = balance(id);
+    Node& node = nodes_[id];
+    node.height = 1 + std::max(nodes_[node.left].height, nodes_[node.right].height);
+    node.box = nodes_[node.left].box.merged(nodes_[node.right].box);
+    id = node.parent;
+  }
+}
+
+// Rotates a subtree whose children differ in height by more than one and
+// returns the index of the node now at a's position.
+int32_t AABBTree::balance(int32_t a) {
+  Node& node_a = nodes_[a];
+  if (node_a.is_leaf() || node_a.height < 2) return a;
+
+  int32_t b = node_a.left;
+  int32_t c = node_a.right;
+  int32_t skew = nodes_[c].height - nodes_[b].height;
+
+  auto rotate_up = [&](int32_t up, int32_t down) {
+    // up is a child of a with children f and g; it takes a's place and a
+    // adopts the shorter grandchild.
+    Node& n_up = nodes_[up];
+    int32_t f = n_up.left;
+    int32_t g = n_up.right;
+
+    n_up.left = a;
+    n_up.parent = nodes_[a].parent;
+    nodes_[a].parent = up;
+
+    if (n_up.parent != NULL_NODE) {
+      if (nodes_[n_up.parent].left == a) {
+        nodes_[n_up.parent].left = up;
+      } else {
+        nodes_[n_up.parent].right = up;
+      }
+    } else {
+      root_ = up;
+    }
+
+    int32_t keep = (nodes_[f].height > nodes_[g].height) ? f : g;
+    int32_t give = (keep == f) ? g : f;
+    n_up.right = keep;
+    if (nodes_[a].left == up) {
+      nodes_[a].left = give;
+    } else {
+      nodes_[a].right = give;
+    }
+    nodes_[give].parent = a;
+
+    nodes_[a].box = nodes_[down].box.merged(nodes_[give].box);
+    nodes_[a].height = 1 + std::max(nodes_[down].height, nodes_[give].height);
+    n_up.box = nodes_[a].box.merged(nodes_[keep].box);
+    n_up.height = 1 + std::max(nodes_[a].height, nodes_[keep].height);
+    return up;
+  };
+
+  if (skew > 1) return rotate_up(c, b);
+  if (skew < -1) return rotate_up(b, c);
+  return a;
+}
+
+}
@@ -0,0 +1,170 @@
+#pragma once
+
+#include "rigid_body.h"
+#include "../util/checkpoint.h"
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <limits>
+
+namespace navora::physics {
+
+struct AABB {
+  Vector3 min;
+  Vector3 max;
+
+  AABB() = default;
+  AABB(const Vector3& min, const Vector3& max) : min(min), max(max) {}
+
+  bool contains(const AABB& other) const {
+    return min.x <= other.min.x && min.y <= other.min.y && min.z <= other.min.z &&
+           max.x >= other.max.x && max.y >= other.max.y && max.z >= other.max.z;
+  }
+
+  bool overlaps(const AABB& other) const {
+    return min.x <= other.max.x && max.x >= other.min.x &&
+           min.y <= other.max.y && max.y >= other.min.y &&
+           min.z <= other.max.z && max.z >= other.min.z;
+  }
+
+  AABB merged(const AABB& other) const {
+    return AABB(Vector3(std::min(min.x, other.min.x), std::min(min.y, other.min.y), std::min(min.z, other.min.z)),
+                Vector3(std::max(max.x, other.max.x), std::max(max.y, other.max.y), std::max(max.z, other.max.z)));
+  }
+
+  AABB expanded(double amount) const {
+    Vector3 pad(amount, amount, amount);
+    return AABB(min - pad, max + pad);
+  }
+
+  // Half the surface area; only used to compare insertion costs.
+  double area() const {
+    Vector3 d = max - min;
+    return d.x * d.y + d.y * d.z + d.z * d.x;
+  }
+};
+
+// Dynamic bounding volume hierarchy over fattened leaf boxes. Leaves only move
+// when a body leaves its fat box, so most ticks touch nothing; when they do,
+// the leaf is reinserted with a surface-area cost walk and the path back to the
+// root is refit and rebalanced with AVL-style rotations. Each leaf carries a
+// user value (the body index) that the owner keeps current.
+class AABBTree {
+public:
+  static constexpr int32_t NULL_NODE = -1;
+
+  int32_t insert(const AABB& box, uint32_t user_data);
+  void remove(int32_t proxy);
+  void move(int32_t proxy, const AABB& fat_box);
+  void clear();
+
+  // Nodes are saved as is, so a restored tree has the same shape and answers
+  // queries in the same order. load() fails unless every node is either in
+  // the tree, with consistent parent and child links, or on the free list.
+  void save(util::CheckpointWriter& writer) const;
+  bool load(const util::CheckpointReader& reader);
+
+  // Whether proxy names a leaf currently in the tree.
+  bool is_leaf(int32_t proxy) const {
+    return proxy >= 0 && static_cast<size_t>(proxy) < nodes_.size() && nodes_[proxy].height >= 0 &&
+           nodes_[proxy].is_leaf();
+  }
+  // Walks every node.
+  size_t leaf_count() const;
+
+  uint32_t get_user_data(int32_t proxy) const { return nodes_[proxy].user_data; }
+  void set_user_data(int32_t proxy, uint32_t user_data) { nodes_[proxy].user_data = user_data; }
+  const AABB& get_fat_aabb(int32_t proxy) const { return nodes_[proxy].box; }
+  int32_t get_height() const { return root_ == NULL_NODE ? 0 : nodes_[root_].height; }
+
+  // Calls callback(user_data) for every leaf overlapping box. The callback
+  // returns false to stop the walk.
+  template <typename Callback>
+  void query(const AABB& box, Callback&& callback) const {
+    if (root_ == NULL_NODE) return;
+    std::vector<int32_t>& stack = traversal_stack();
+    stack.clear();
+    stack.push_back(root_);
+    while (!stack.empty()) {
+      int32_t id = stack.back();
+      stack.pop_back();
+      const Node& node = nodes_[id];
+      if (!node.box.overlaps(box)) continue;
+      if (node.is_leaf()) {
+        if (!callback(node.user_data)) return;
+      } else {
+        stack.push_back(node.left);
+        stack.push_back(node.right);
+      }
+    }
+  }
+
+  // Walks leaves whose box, inflated by radius, is hit by the ray
+  // origin + t * direction for t in [0, max_t]. callback(user_data, max_t)
+  // returns the new clip distance: max_t to continue unchanged, a smaller
+  // value after a hit, or a negative value to stop.
+  template <typename Callback>
+  void raycast(const Vector3& origin, const Vector3& direction, double max_t, double radius,
+               Callback&& callback) const {
+    if (root_ == NULL_NODE) return;
+    Vector3 inv_dir(safe_inverse(direction.x), safe_inverse(direction.y), safe_inverse(direction.z));
+    std::vector<int32_t>& stack = traversal_stack();
+    stack.clear();
+    stack.push_back(root_);
+    while (!stack.empty()) {
+      int32_t id = stack.back();
+      stack.pop_back();
+      const Node& node = nodes_[id];
+      if (!ray_hits_box(origin, inv_dir, node.box.expanded(radius), max_t)) continue;
+      if (node.is_leaf()) {
+        double clip = callback(node.user_data, max_t);
+        if (clip < 0.0) return;
+        max_t = clip;
+      } else {
+        stack.push_back(node.left);
+        stack.push_back(node.right);
+      }
+    }
+  }
+
+private:
+  struct Node {
+    AABB box;
+    int32_t parent = NULL_NODE;
+    int32_t left = NULL_NODE;
+    int32_t right = NULL_NODE;
+    int32_t height = 0;
+    uint32_t user_data = 0;
+
+    bool is_leaf() const { return left == NULL_NODE; }
+  };
+
+  static double safe_inverse(double v) {
+    return std::abs(v) > 1e-12 ? 1.0 / v : std::numeric_limits<double>::infinity();
+  }
+
+  static bool ray_hits_box(const Vector3& origin, const Vector3& inv_dir, const AABB& box, double max_t);
+
+  static std::vector<int32_t>& traversal_stack() {
+    thread_local std::vector<int32_t> stack;
+    return stack;
+  }
+
+  int32_t allocate_node();
+  void free_node(int32_t id);
+  void insert_leaf(int32_t leaf);
+  void remove_leaf(int32_t leaf);
+  void refit_from(int32_t id);
+  int32_t balance(int32_t a);
+
+  struct Roots {
+    int32_t root;
+    int32_t free_list;
+  };
+
+  std::vector<Node> nodes_;
+  int32_t root_ = NULL_NODE;
+  int32_t free_list_ = NULL_NODE;
+};
+
+}
@@ -0,0 +1,327 @@
+#pragma once
+
+#include "rigid_body.h"
+#include "../util/checkpoint.h"
+#include <cstdint>
+#include <vector>
+
+namespace navora::physics {
+
+enum BodyFlags : uint8_t {
+  BODY_STATIC = 1 << 0,
+  BODY_SLEEPING = 1 << 1
+};
+
+// Non-owning view of a contiguous run of bodies in a BodyStoreT: one pointer
+// per field, so the step pipeline runs unchanged over a whole store or over
+// one world of a SimulationBatch. Indices, including the sleep rings, are
+// relative to the first body of the view. Like a span, the view does not own
+// or resize anything and constness does not reach the bodies.
+template <typename T>
+struct BodyViewT {
+  using Scalar = T;
+  using Vector3 = Vector3T<T>;
+
+  Vector3* position = nullptr;
+  QuaternionT<T>* rotation = nullptr;
+  Vector3* scale = nullptr;
+  Vector3* linear_velocity = nullptr;
+  Vector3* angular_velocity = nullptr;
+  T* mass = nullptr;
+  T* inv_mass = nullptr;
+  CollisionShapeT<T>* shape = nullptr;
+  uint8_t* flags = nullptr;
+  T* sleep_time = nullptr;
+  uint32_t* sleep_next = nullptr;
+  uint32_t* sleep_prev = nullptr;
+  size_t count = 0;
+
+  size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+
+  bool is_static(uint32_t index) const {
+    return (flags[index] & BODY_STATIC) != 0;
+  }
+
+  bool is_sleeping(uint32_t index) const {
+    return (flags[index] & BODY_SLEEPING) != 0;
+  }
+
+  // Static and sleeping bodies are skipped by every integrator stage.
+  bool is_active(uint32_t index) const {
+    return (flags[index] & (BODY_STATIC | BODY_SLEEPING)) == 0;
+  }
+
+  // Wakes the sleeping island containing index. No-op for awake bodies.
+  void wake(uint32_t index) const {
+    if (!is_sleeping(index)) return;
+    uint32_t body = index;
+    do {
+      uint32_t next = sleep_next[body];
+      flags[body] &= static_cast<uint8_t>(~BODY_SLEEPING);
+      sleep_time[body] = 0;
+      sleep_next[body] = body;
+      sleep_prev[body] = body;
+      body = next;
+    } while (body != index);
+  }
+
+  // Puts members to sleep as one island. Members must be awake dynamic bodies.
+  void sleep(const uint32_t* members, size_t member_count) const {
+    for (size_t k = 0; k < member_count; ++k) {
+      uint32_t body = members[k];
+      flags[body] |= BODY_SLEEPING;
+      linear_velocity[body] = Vector3();
+      angular_velocity[body] = Vector3();
+      sleep_next[body] = members[(k + 1) % member_count];
+      sleep_prev[body] = members[(k + member_count - 1) % member_count];
+    }
+  }
+};
+
+// Structure-of-arrays storage for every body in a world. Each field lives in
+// its own contiguous array indexed by a dense body index, so integrator passes
+// stream over exactly the data they touch. Removal swaps the last body into
+// the freed slot; callers that map external ids to indices must follow the move.
+//
+// Sleeping bodies are threaded into one circular list per sleeping island
+// (sleep_next/sleep_prev), so waking any member wakes the whole island in time
+// proportional to its size. Awake bodies form a list of one.
+template <typename T>
+class BodyStoreT {
+public:
+  using Scalar = T;
+  using Vector3 = Vector3T<T>;
+  using RigidBody = RigidBodyT<T>;
+
+  std::vector<Vector3> position;
+  std::vector<QuaternionT<T>> rotation;
+  std::vector<Vector3> scale;
+  std::vector<Vector3> linear_velocity;
+  std::vector<Vector3> angular_velocity;
+  std::vector<T> mass;
+  std::vector<T> inv_mass;
+  std::vector<CollisionShapeT<T>> shape;
+  std::vector<uint8_t> flags;
+  std::vector<T> sleep_time;
+  std::vector<uint32_t> sleep_next;
+  std::vector<uint32_t> sleep_prev;
+
+  size_t size() const { return position.size(); }
+  bool empty() const { return position.empty(); }
+
+  bool is_static(uint32_t index) const {
+    return (flags[index] & BODY_STATIC) != 0;
+  }
+
+  bool is_sleeping(uint32_t index) const {
+    return (flags[index] & BODY_SLEEPING) != 0;
+  }
+
+  // Static and sleeping bodies are skipped by every integrator stage.
+  bool is_active(uint32_t index) const {
+    return (flags[index] & (BODY_STATIC | BODY_SLEEPING)) == 0;
+  }
+
+  // Wakes the sleeping island containing index. No-op for awake bodies.
+  void wake(uint32_t index) { view().wake(index); }
+
+  // Puts members to sleep as one island. Members must be awake dynamic bodies.
+  void sleep(const uint32_t* members, size_t count) { view().sleep(members, count); }
+
+  // Bodies [begin, begin + count), or the whole store. The view is invalidated
+  // by anything that reallocates the arrays (add, reserve). Its sleep rings
+  // index from begin, so a store split into views must keep them local.
+  BodyViewT<T> view(size_t begin, size_t count) {
+    BodyViewT<T> v;
+    v.position = position.data() + begin;
+    v.rotation = rotation.data() + begin;
+    v.scale = scale.data() + begin;
+    v.linear_velocity = linear_velocity.data() + begin;
+    v.angular_velocity = angular_velocity.data() + begin;
+    v.mass = mass.data() + begin;
+    v.inv_mass = inv_mass.data() + begin;
+    v.shape = shape.data() + begin;
+    v.flags = flags.data() + begin;
+    v.sleep_time = sleep_time.data() + begin;
+    v.sleep_next = sleep_next.data() + begin;
+    v.sleep_prev = sleep_prev.data() + begin;
+    v.count = count;
+    return v;
+  }
+  BodyViewT<T> view() { return view(0, size()); }
+
+  uint32_t add(const RigidBody& body) {
+    uint32_t index = static_cast<uint32_t>(size());
+    position.push_back(body.transform.position);
+    rotation.push_back(body.transform.rotation);
+    scale.push_back(body.transform.scale);
+    linear_velocity.push_back(body.linear_velocity);
+    angular_velocity.push_back(body.angular_velocity);
+    mass.push_back(body.mass);
+    inv_mass.push_back(body.inv_mass);
+    shape.push_back(body.shape);
+    flags.push_back(body.is_static ? BODY_STATIC : 0);
+    sleep_time.push_back(0);
+    sleep_next.push_back(index);
+    sleep_prev.push_back(index);
+    return index;
+  }
+
+  // Removes the body at index by moving the last body into its slot.
+  // Returns the previous index of the moved body, or index itself if the
+  // removed body was the last one.
+  uint32_t remove(uint32_t index) {
+    uint32_t last = static_cast<uint32_t>(size() - 1);
+    sleep_next[sleep_prev[index]] = sleep_next[index];
+    sleep_prev[sleep_next[index]] = sleep_prev[index];
+    if (index != last) {
+      position[index] = position[last];
+      rotation[index] = rotation[last];
+      scale[index] = scale[last];
+      linear_velocity[index] = linear_velocity[last];
+      angular_velocity[index] = angular_velocity[last];
+      mass[index] = mass[last];
+      inv_mass[index] = inv_mass[last];
+      shape[index] = shape[last];
+      flags[index] = flags[last];
+      sleep_time[index] = sleep_time[last];
+      if (sleep_next[last] == last) {
+        sleep_next[index] = index;
+        sleep_prev[index] = index;
+      } else {
+        sleep_next[index] = sleep_next[last];
+        sleep_prev[index] = sleep_prev[last];
+        sleep_prev[sleep_next[index]] = index;
+        sleep_next[sleep_prev[index]] = index;
+      }
+    }
+    position.pop_back();
+    rotation.pop_back();
+    scale.pop_back();
+    linear_velocity.pop_back();
+    angular_velocity.pop_back();
+    mass.pop_back();
+    inv_mass.pop_back();
+    shape.pop_back();
+    flags.pop_back();
+    sleep_time.pop_back();
+    sleep_next.pop_back();
+    sleep_prev.pop_back();
+    return (index != last) ? last : index;
+  }
+
+  void get(uint32_t index, RigidBody& body) const {
+    body.transform.position = position[index];
+    body.transform.rotation = rotation[index];
+    body.transform.scale = scale[index];
+    body.linear_velocity = linear_velocity[index];
+    body.angular_velocity = angular_velocity[index];
+    body.mass = mass[index];
+    body.inv_mass = inv_mass[index];
+    body.shape = shape[index];
+    body.is_static = is_static(index);
+  }
+
+  // Overwrites the body's state. Callers should wake() it first so its
+  // sleeping island does not keep a stale member.
+  void set(uint32_t index, const RigidBody& body) {
+    position[index] = body.transform.position;
+    rotation[index] = body.transform.rotation;
+    scale[index] = body.transform.scale;
+    linear_velocity[index] = body.linear_velocity;
+    angular_velocity[index] = body.angular_velocity;
+    mass[index] = body.mass;
+    inv_mass[index] = body.inv_mass;
+    shape[index] = body.shape;
+    flags[index] = static_cast<uint8_t>((flags[index] & ~BODY_STATIC) | (body.is_static ? BODY_STATIC : 0));
+  }
+
+  void reserve(size_t count) {
+    position.reserve(count);
+    rotation.reserve(count);
+    scale.reserve(count);
+    linear_velocity.reserve(count);
+    angular_velocity.reserve(count);
+    mass.reserve(count);
+    inv_mass.reserve(count);
+    shape.reserve(count);
+    flags.reserve(count);
+    sleep_time.reserve(count);
+    sleep_next.reserve(count);
+    sleep_prev.reserve(count);
+  }
+
+  void save(util::CheckpointWriter& writer) const {
+    writer.add(util::CHECKPOINT_BODY_POSITION, position);
+    writer.add(util::CHECKPOINT_BODY_ROTATION, rotation);
+    writer.add(util::CHECKPOINT_BODY_SCALE, scale);
+    writer.add(util::CHECKPOINT_BODY_LINEAR_VELOCITY, linear_velocity);
+    writer.add(util::CHECKPOINT_BODY_ANGULAR_VELOCITY, angular_velocity);
+    writer.add(util::CHECKPOINT_BODY_MASS, mass);
+    writer.add(util::CHECKPOINT_BODY_INV_MASS, inv_mass);
+    writer.add(util::CHECKPOINT_BODY_SHAPE, shape);
+    writer.add(util::CHECKPOINT_BODY_FLAGS, flags);
+    writer.add(util::CHECKPOINT_BODY_SLEEP_TIME, sleep_time);
+    writer.add(util::CHECKPOINT_BODY_SLEEP_NEXT, sleep_next);
+    writer.add(util::CHECKPOINT_BODY_SLEEP_PREV, sleep_prev);
+  }
+
+  // Replaces every body. False if a section is missing, the arrays disagree
+  // in length, a shape type is unknown or the sleep rings are not closed
+  // rings of sleeping bodies, in which case the store is left in an
+  // unspecified state.
+  bool load(const util::CheckpointReader& reader) {
+    if (!reader.read(util::CHECKPOINT_BODY_POSITION, position) ||
+        !reader.read(util::CHECKPOINT_BODY_ROTATION, rotation) ||
+        !reader.read(util::CHECKPOINT_BODY_SCALE, scale) ||
+        !reader.read(util::CHECKPOINT_BODY_LINEAR_VELOCITY, linear_velocity) ||
+        !reader.read(util::CHECKPOINT_BODY_ANGULAR_VELOCITY, angular_velocity) ||
+        !reader.read(util::CHECKPOINT_BODY_MASS, mass) ||
+        !reader.read(util::CHECKPOINT_BODY_INV_MASS, inv_mass) ||
+        !reader.read(util::CHECKPOINT_BODY_SHAPE, shape) ||
+        !reader.read(util::CHECKPOINT_BODY_FLAGS, flags) ||
+        !reader.read(util::CHECKPOINT_BODY_SLEEP_TIME, sleep_time) ||
+        !reader.read(util::CHECKPOINT_BODY_SLEEP_NEXT, sleep_next) ||
+        !reader.read(util::CHECKPOINT_BODY_SLEEP_PREV, sleep_prev)) {
+      return false;
+    }
+    const size_t count = size();
+    if (!(rotation.size() == count && scale.size() == count && linear_velocity.size() == count &&
+          angular_velocity.size() == count && mass.size() == count && inv_mass.size() == count &&
+          shape.size() == count && flags.size() == count && sleep_time.size() == count &&
+          sleep_next.size() == count && sleep_prev.size() == count)) {
+      return false;
+    }
+    // sleep_prev inverting sleep_next makes sleep_next a permutation, so every
+    // ring is closed; awake bodies must be rings of one.
+    for (uint32_t i = 0; i < count; ++i) {
+      const uint32_t next = sleep_next[i];
+      if (static_cast<size_t>(shape[i].type) >= SHAPE_TYPE_COUNT || next >= count || sleep_prev[i] >= count ||
+          sleep_prev[next] != i || (!is_sleeping(i) && next != i)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void clear() {
+    position.clear();
+    rotation.clear();
+    scale.clear();
+    linear_velocity.clear();
+    angular_velocity.clear();
+    mass.clear();
+    inv_mass.clear();
+    shape.clear();
+    flags.clear();
+    sleep_time.clear();
+    sleep_next.clear();
+    sleep_prev.clear();
+  }
+};
+
+using BodyView = BodyViewT<double>;
+using BodyStore = BodyStoreT<double>;
+
+}
@@ -0,0 +1,199 @@
+#include "contact_solver.h"
+#include <algorithm>
+#include <cmath>
+
+namespace navora::physics {
+
+namespace {
+
+// Cached impulses are stored oriented from the lower body index to the higher
+// one, so a pair keeps its entry when removal renumbers its bodies.
+uint64_t pair_key(uint32_t a, uint32_t b) {
+  return (a < b) ? (static_cast<uint64_t>(a) << 32) | b : (static_cast<uint64_t>(b) << 32) | a;
+}
+
+template <typename T>
+T orientation(uint32_t a, uint32_t b) {
+  return (a < b) ? T(1) : T(-1);
+}
+
+// Warm starting is skipped when the contact normal turned further than this.
+constexpr double MIN_NORMAL_ALIGNMENT = 0.95;
+
+}
+
+template <typename T>
+void ContactSolverT<T>::solve(BodyViewT<T>& bodies, const ContactListT<T>& contacts, const ContactIslands& islands,
+                              util::ThreadPool& pool, T delta_time) {
+  constraints_.resize(contacts.size());
+  const auto& order = islands.contact_order();
+  const auto& offsets = islands.island_offsets();
+
+  pool.parallel_for(islands.island_count(), [&](size_t island) {
+    const uint32_t begin = offsets[island];
+    const uint32_t end = offsets[island + 1];
+    // Restitution is measured on pre-solve velocities, before any warm
+    // start impulse in the island has been applied.
+    for (uint32_t k = begin; k < end; ++k) {
+      prepare(bodies, contacts[order[k]], constraints_[order[k]], delta_time);
+    }
+    if (settings_.warm_starting) {
+      for (uint32_t k = begin; k < end; ++k) {
+        warm_start(bodies, contacts[order[k]], constraints_[order[k]]);
+      }
+    }
+    for (int iteration = 0; iteration < settings_.iterations; ++iteration) {
+      for (uint32_t k = begin; k < end; ++k) {
+        solve_contact(bodies, contacts[order[k]], constraints_[order[k]]);
+      }
+    }
+  });
+
+  next_cache_.resize(contacts.size());
+  for (size_t c = 0; c < contacts.size(); ++c) {
+    const Contact& contact = contacts[c];
+    T sign = orientation<T>(contact.body_a, contact.body_b);
+    CachedImpulse& entry = next_cache_[c];
+    entry.key = pair_key(contact.body_a, contact.body_b);
+    entry.normal = contact.normal * sign;
+    entry.normal_impulse = constraints_[c].normal_impulse;
+    entry.tangent_impulse = constraints_[c].tangent_impulse * sign;
+  }
+  std::sort(next_cache_.begin(), next_cache_.end(),
+            [](const CachedImpulse& x, const CachedImpulse& y) { return x.key < y.key; });
+  cache_.swap(next_cache_);
+}
+
+template <typename T>
+void ContactSolverT<T>::prepare(const BodyViewT<T>& bodies, const Contact& contact, Constraint& constraint,
+                                T delta_time) const {
+  const uint32_t a = contact.body_a;
+  const uint32_t b = contact.body_b;
+  constraint.inv_mass_a = bodies.is_static(a) ? T(0) : bodies.inv_mass[a];
+  constraint.inv_mass_b = bodies.is_static(b) ? T(0) : bodies.inv_mass[b];
+  constraint.normal_impulse = 0;
+  constraint.tangent_impulse = Vector3();
+
+  T inv_mass_sum = constraint.inv_mass_a + constraint.inv_mass_b;
+  constraint.effective_mass = (inv_mass_sum < T(1e-9)) ? T(0) : T(1) / inv_mass_sum;
+  if (constraint.effective_mass == T(0)) return;
+
+  // A speculative contact (negative penetration) may close at most its gap
+  // this step; a touching one is pushed apart by the Baumgarte bias.
+  const T slop = static_cast<T>(settings_.slop);
+  T closing = (bodies.linear_velocity[b] - bodies.linear_velocity[a]).dot(contact.normal);
+  if (contact.penetration < T(0)) {
+    constraint.velocity_bias = contact.penetration / delta_time;
+  } else {
+    constraint.velocity_bias = static_cast<T>(settings_.baumgarte) / delta_time *
+                               std::max(contact.penetration - slop, T(0));
+  }
+  if (closing < -static_cast<T>(settings_.restitution_threshold) && contact.penetration > -slop) {
+    constraint.velocity_bias = std::max(constraint.velocity_bias, -static_cast<T>(settings_.restitution) * closing);
+  }
+}
+
+template <typename T>
+void ContactSolverT<T>::warm_start(BodyViewT<T>& bodies, const Contact& contact, Constraint& constraint) const {
+  if (constraint.effective_mass == T(0)) return;
+  const uint32_t a = contact.body_a;
+  const uint32_t b = contact.body_b;
+  const CachedImpulse* cached = find_cached(pair_key(a, b));
+  if (!cached) return;
+  T sign = orientation<T>(a, b);
+  if ((cached->normal * sign).dot(contact.normal) < T(MIN_NORMAL_ALIGNMENT)) return;
+
+  constraint.normal_impulse = cached->normal_impulse;
+  constraint.tangent_impulse = cached->tangent_impulse * sign;
+  Vector3 impulse = contact.normal * constraint.normal_impulse + constraint.tangent_impulse;
+  if (constraint.inv_mass_a > T(0)) bodies.linear_velocity[a] -= impulse * constraint.inv_mass_a;
+  if (constraint.inv_mass_b > T(0)) bodies.linear_velocity[b] += impulse * constraint.inv_mass_b;
+}
+
+template <typename T>
+void ContactSolverT<T>::solve_contact(BodyViewT<T>& bodies, const Contact& contact, Constraint& constraint) const {
+  if (constraint.effective_mass == T(0)) return;
+  const uint32_t a = contact.body_a;
+  const uint32_t b = contact.body_b;
+  const Vector3& normal = contact.normal;
+
+  // Friction first, bounded by the normal impulse accumulated so far.
+  Vector3 relative = bodies.linear_velocity[b] - bodies.linear_velocity[a];
+  Vector3 tangent_velocity = relative - normal * relative.dot(normal);
+  Vector3 old_tangent = constraint.tangent_impulse;
+  Vector3 tangent = old_tangent - tangent_velocity * constraint.effective_mass;
+  T max_friction = static_cast<T>(settings_.friction) * constraint.normal_impulse;
+  T tangent_sq = tangent.length_squared();
+  if (tangent_sq > max_friction * max_friction) {
+    tangent = (tangent_sq > T(0)) ? tangent * (max_friction / std::sqrt(tangent_sq)) : Vector3();
+  }
+  constraint.tangent_impulse = tangent;
+  Vector3 impulse = tangent - old_tangent;
+
+  relative = bodies.linear_velocity[b] - bodies.linear_velocity[a];
+  T closing = relative.dot(normal);
+  T old_normal = constraint.normal_impulse;
+  constraint.normal_impulse =
+    std::max(old_normal + (constraint.velocity_bias - closing) * constraint.effective_mass, T(0));
+  impulse += normal * (constraint.normal_impulse - old_normal);
+
+  if (constraint.inv_mass_a > T(0)) bodies.linear_velocity[a] -= impulse * constraint.inv_mass_a;
+  if (constraint.inv_mass_b > T(0)) bodies.linear_velocity[b] += impulse * constraint.inv_mass_b;
+}
+
+template <typename T>
+const typename ContactSolverT<T>::CachedImpulse* ContactSolverT<T>::find_cached(uint64_t key) const {
+  auto it = std::lower_bound(cache_.begin(), cache_.end(), key,
+                             [](const CachedImpulse& entry, uint64_t value) { return entry.key < value; });
+  return (it != cache_.end() && it->key == key) ? &*it : nullptr;
+}
+
+template <typename T>
+void ContactSolverT<T>::remove_body(uint32_t index, uint32_t moved_from) {
+  size_t kept = 0;
+  for (size_t k = 0; k < cache_.size(); ++k) {
+    CachedImpulse entry = cache_[k];
+    uint32_t low = static_cast<uint32_t>(entry.key >> 32);
+    uint32_t high = static_cast<uint32_t>(entry.key);
+    if (low == index || high == index) continue;
+    if (moved_from != index) {
+      if (low == moved_from) low = index;
+      if (high == moved_from) high = index;
+      if (low > high) {
+        std::swap(low, high);
+        entry.normal = entry.normal * T(-1);
+        entry.tangent_impulse = entry.tangent_impulse * T(-1);
+      }
+      entry.key = pair_key(low, high);
+    }
+    cache_[kept++] = entry;
+  }
+  cache_.resize(kept);
+  std::sort(cache_.begin(), cache_.end(),
+            [](const CachedImpulse& x, const CachedImpulse& y) { return x.key < y.key; });
+}
+
+template <typename T>
+bool ContactSolverT<T>::load(const util::CheckpointReader& reader, size_t body_count) {
+  std::vector<CachedImpulse> cache;
+  if (!reader.read(util::CHECKPOINT_SOLVER_CACHE, cache)) return false;
+  for (size_t k = 0; k < cache.size(); ++k) {
+    const uint32_t low = static_cast<uint32_t>(cache[k].key >> 32);
+    const uint32_t high = static_cast<uint32_t>(cache[k].key);
+    if (low >= high || high >= body_count || (k > 0 && cache[k - 1].key >= cache[k].key)) return false;
+  }
+  cache_.swap(cache);
+  return true;
+}
+
+template <typename T>
+void ContactSolverT<T>::clear() {
+  util::release(constraints_);
+  cache_.clear();
+  next_cache_.clear();
+}
+
+template class ContactSolverT<float>;
+template class ContactSolverT<double>;
+
+}
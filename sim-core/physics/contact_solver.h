@@ -0,0 +1,92 @@
+#pragma once
+
+#include "body_store.h"
+#include "narrowphase.h"
+#include "islands.h"
+#include "../util/checkpoint.h"
+#include "../util/thread_pool.h"
+#include <cstdint>
+#include <vector>
+
+namespace navora::physics {
+
+struct SolverSettings {
+  int iterations = 8;
+  double restitution = 0.3;
+  double friction = 0.5;
+  // Closing speeds below this do not bounce, so resting contacts stay put.
+  double restitution_threshold = 1.0;
+  // Fraction of penetration beyond slop removed per second of bias velocity.
+  double baumgarte = 0.2;
+  double slop = 0.01;
+  bool warm_starting = true;
+};
+
+// Sequential-impulse contact solver. Each contact keeps an accumulated
+// normal impulse clamped to be non-negative and an accumulated friction
+// impulse clamped to the friction cone, so later iterations can take back
+// what earlier ones overshot. Accumulated impulses are cached per body pair
+// across frames and applied up front (warm starting), which lets stacks
+// converge over several frames instead of within one.
+//
+// Islands share no dynamic bodies and are solved concurrently; contacts are
+// visited in island contact order every iteration, so results do not depend
+// on the thread count.
+template <typename T>
+class ContactSolverT {
+public:
+  explicit ContactSolverT(util::FrameArena& arena) : constraints_(arena) {}
+
+  void set_settings(const SolverSettings& settings) { settings_ = settings; }
+  const SolverSettings& get_settings() const { return settings_; }
+
+  void solve(BodyViewT<T>& bodies, const ContactListT<T>& contacts, const ContactIslands& islands,
+             util::ThreadPool& pool, T delta_time);
+
+  // Mirrors BodyStore::remove so cached pairs follow the moved body.
+  void remove_body(uint32_t index, uint32_t moved_from);
+  void clear();
+  void release_frame() { util::release(constraints_); }
+
+  // Warm-start cache, so a restored world converges exactly as the saved one
+  // would have. load() fails, leaving the cache unchanged, unless the pairs
+  // are sorted, distinct and within body_count.
+  void save(util::CheckpointWriter& writer) const { writer.add(util::CHECKPOINT_SOLVER_CACHE, cache_); }
+  bool load(const util::CheckpointReader& reader, size_t body_count);
+
+  size_t cached_pair_count() const { return cache_.size(); }
+
+private:
+  using Vector3 = Vector3T<T>;
+  using Contact = ContactT<T>;
+
+  struct CachedImpulse {
+    uint64_t key;
+    Vector3 normal;
+    T normal_impulse;
+    Vector3 tangent_impulse;
+  };
+
+  struct Constraint {
+    T inv_mass_a;
+    T inv_mass_b;
+    T effective_mass;
+    T velocity_bias;
+    T normal_impulse;
+    Vector3 tangent_impulse;
+  };
+
+  void prepare(const BodyViewT<T>& bodies, const Contact& contact, Constraint& constraint, T delta_time) const;
+  void warm_start(BodyViewT<T>& bodies, const Contact& contact, Constraint& constraint) const;
+  void solve_contact(BodyViewT<T>& bodies, const Contact& contact, Constraint& constraint) const;
+  const CachedImpulse* find_cached(uint64_t key) const;
+
+  SolverSettings settings_;
+  util::FrameVector<Constraint> constraints_;
+  std::vector<CachedImpulse> cache_;
+  std::vector<CachedImpulse> next_cache_;
+};
+
+using ContactSolver = ContactSolverT<double>;
+
+}
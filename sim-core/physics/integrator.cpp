@@ -3,12 +3,297 @@
 
 namespace navora::physics {
 
-void Integrator::step(std::vector<RigidBody>& bodies, double delta_time) {
-  apply_gravity(bodies, delta_time);
-  integrate(bodies, delta_time);
-  detect_collisions(bodies);
-  resolve_collisions(bodies);
+namespace {
+
+constexpr uint32_t NOT_IN_GRID = 0xffffffffu;
+
+uint32_t hash_cell(int32_t x, int32_t y, int32_t z) {
+  return (static_cast<uint32_t>(x) * 73856093u) ^
+         (static_cast<uint32_t>(y) * 19349663u) ^
+         (static_cast<uint32_t>(z) * 83492791u);
+}
+
+template <typename T>
+int32_t cell_coord(T value, T inv_cell_size) {
+  return static_cast<int32_t>(std::floor(value * inv_cell_size));
+}
+
+}
+
+template <typename T>
+void IntegratorT<T>::step(BodyViewT<T> bodies, double delta_time) {
+  if (frame_arena_.bytes_used() > 0) end_frame();
+
+  const uint32_t count = static_cast<uint32_t>(bodies.size());
+  moved_.reserve(count);
+  for (uint32_t i = 0; i < count; ++i) {
+    if (bodies.is_active(i)) moved_.push_back(i);
+  }
+
+  const int substeps = std::max(step_settings_.substeps, 1);
+  const T substep_time = static_cast<T>(delta_time / substeps);
+  for (int substep = 0; substep < substeps; ++substep) {
+    // Contacts are solved on velocities that already include gravity, then
+    // positions advance with the solved velocities.
+    apply_gravity(bodies, substep_time);
+    compute_margins(bodies, substep_time);
+    detect_collisions(bodies);
+    wake_touched(bodies);
+    resolve_collisions(bodies, substep_time);
+    integrate(bodies, substep_time);
+    update_sleep(bodies, substep_time);
+  }
+}
+
+template <typename T>
+void IntegratorT<T>::compute_margins(const BodyViewT<T>& bodies, T delta_time) {
+  const size_t count = bodies.size();
+  margins_.assign(count, T(0));
+  if (!step_settings_.speculative_contacts) return;
+  for (size_t i = 0; i < count; ++i) {
+    if (bodies.is_active(i)) {
+      margins_[i] = bodies.linear_velocity[i].length() * delta_time;
+    }
+  }
+}
+
+template <typename T>
+void IntegratorT<T>::end_frame() {
+  broadphase_.release_frame();
+  narrowphase_.release_frame();
+  islands_.release_frame();
+  solver_.release_frame();
+  util::release(island_sleep_time_);
+  util::release(margins_);
+  util::release(moved_);
+  util::release(contacts_);
+  frame_arena_.reset();
+}
+
+template <typename T>
+void IntegratorT<T>::update_sleep(BodyViewT<T>& bodies, T delta_time) {
+  if (!sleep_settings_.enabled) return;
+
+  const T threshold_sq = static_cast<T>(sleep_settings_.linear_threshold * sleep_settings_.linear_threshold);
+  const T time_to_sleep = static_cast<T>(sleep_settings_.time_to_sleep);
+  const auto& body_island = islands_.body_offsets();
+  const auto& members = islands_.body_order();
+  const size_t island_count = islands_.island_count();
+
+  // Bodies without contacts sleep on their own; island members only count
+  // towards their island's minimum.
+  island_sleep_time_.assign(island_count, std::numeric_limits<T>::infinity());
+  const uint32_t count = static_cast<uint32_t>(bodies.size());
+  for (uint32_t i = 0; i < count; ++i) {
+    if (!bodies.is_active(i)) continue;
+    if (bodies.linear_velocity[i].length_squared() < threshold_sq) {
+      bodies.sleep_time[i] += delta_time;
+    } else {
+      bodies.sleep_time[i] = 0;
+    }
+    if (islands_.body_island(i) == ContactIslands::NO_ISLAND && bodies.sleep_time[i] >= time_to_sleep) {
+      bodies.sleep(&i, 1);
+    }
+  }
+
+  for (size_t island = 0; island < island_count; ++island) {
+    for (uint32_t k = body_island[island]; k < body_island[island + 1]; ++k) {
+      uint32_t body = members[k];
+      island_sleep_time_[island] = std::min(island_sleep_time_[island], bodies.sleep_time[body]);
+    }
+    if (island_sleep_time_[island] >= time_to_sleep) {
+      bodies.sleep(members.data() + body_island[island], body_island[island + 1] - body_island[island]);
+    }
+  }
+}
+
+template <typename T>
+const PairList& BroadphaseT<T>::find_pairs(const BodyViewT<T>& bodies, const util::FrameVector<T>& margins) {
+  pairs_.clear();
+  if (mode_ == BroadphaseMode::BRUTE_FORCE) {
+    find_pairs_brute_force(bodies);
+  } else {
+    find_pairs_spatial_hash(bodies, margins);
+  }
+  return pairs_;
+}
+
+template <typename T>
+void BroadphaseT<T>::release_frame() {
+  util::release(radius_);
+  util::release(extent_);
+  util::release(cells_);
+  util::release(bucket_);
+  util::release(bucket_start_);
+  util::release(bucket_cursor_);
+  util::release(sorted_);
+  util::release(always_test_);
+  util::release(pairs_);
 }
 
+template <typename T>
+void BroadphaseT<T>::find_pairs_brute_force(const BodyViewT<T>& bodies) {
+  const uint32_t count = static_cast<uint32_t>(bodies.size());
+  for (uint32_t i = 0; i < count; ++i) {
+    if (!bodies.is_active(i)) continue;
+    const size_t run_begin = pairs_.size();
+    for (uint32_t j = 0; j < count; ++j) {
+      if (j == i || (j < i && bodies.is_active(j))) continue;
+      pairs_.push_back({i, j});
+    }
+    finish_run(run_begin);
+  }
 }
 
+template <typename T>
+void BroadphaseT<T>::build_grid(const BodyViewT<T>& bodies, const util::FrameVector<T>& margins) {
+  const uint32_t count = static_cast<uint32_t>(bodies.size());
+  radius_.resize(count);
+  extent_.resize(count);
+  cells_.resize(count);
+  bucket_.resize(count);
+  always_test_.clear();
+
+  // Bounds are grown by each body's speculative margin, so moving bodies stay
+  // in the grid. The derived cell fits every finite body up to four times the
+  // median radius, so one huge or fast body cannot coarsen the grid; anything
+  // wider than a cell goes on the always-test list. sorted_ is filled below
+  // and doubles as scratch for the median.
+  sorted_.clear();
+  for (uint32_t i = 0; i < count; ++i) {
+    radius_[i] = bounding_radius(bodies.shape[i], margins[i]);
+    extent_[i] = bounding_extent(bodies.shape[i], margins[i]);
+    if (std::isfinite(radius_[i])) {
+      sorted_.push_back(i);
+    }
+  }
+
+  T cell_size = static_cast<T>(cell_size_);
+  if (cell_size_ <= 0.0 && !sorted_.empty()) {
+    auto middle = sorted_.begin() + sorted_.size() / 2;
+    std::nth_element(sorted_.begin(), middle, sorted_.end(),
+                     [&](uint32_t a, uint32_t b) { return radius_[a] < radius_[b]; });
+    const T limit = T(4) * radius_[*middle];
+    T typical = 0;
+    for (uint32_t i : sorted_) {
+      if (radius_[i] <= limit) typical = std::max(typical, radius_[i]);
+    }
+    cell_size = T(2) * typical;
+  }
+  if (!(cell_size > T(1e-9))) cell_size = 1;
+  inv_cell_size_ = T(1) / cell_size;
+
+  uint32_t table_size = 16;
+  while (table_size < 2 * count) table_size <<= 1;
+  bucket_mask_ = table_size - 1;
+  bucket_start_.assign(table_size + 1, 0);
+
+  for (uint32_t i = 0; i < count; ++i) {
+    if (!std::isfinite(radius_[i]) || T(2) * radius_[i] > cell_size) {
+      bucket_[i] = NOT_IN_GRID;
+      always_test_.push_back(i);
+      continue;
+    }
+    const Vector3T<T>& p = bodies.position[i];
+    Cell cell{cell_coord(p.x, inv_cell_size_), cell_coord(p.y, inv_cell_size_), cell_coord(p.z, inv_cell_size_)};
+    cells_[i] = cell;
+    bucket_[i] = hash_cell(cell.x, cell.y, cell.z) & bucket_mask_;
+    bucket_start_[bucket_[i] + 1]++;
+  }
+
+  for (uint32_t b = 0; b < table_size; ++b) {
+    bucket_start_[b + 1] += bucket_start_[b];
+  }
+
+  bucket_cursor_.assign(bucket_start_.begin(), bucket_start_.end() - 1);
+  sorted_.resize(bucket_start_[table_size]);
+  for (uint32_t i = 0; i < count; ++i) {
+    if (bucket_[i] != NOT_IN_GRID) {
+      sorted_[bucket_cursor_[bucket_[i]]++] = i;
+    }
+  }
+}
+
+template <typename T>
+void BroadphaseT<T>::find_pairs_spatial_hash(const BodyViewT<T>& bodies, const util::FrameVector<T>& margins) {
+  build_grid(bodies, margins);
+
+  // j is paired with the driving body i unless it is also active and lower,
+  // in which case the pair was already emitted from j.
+  auto skip = [&](uint32_t i, uint32_t j) {
+    return j == i || (j < i && bodies.is_active(j));
+  };
+
+  const uint32_t count = static_cast<uint32_t>(bodies.size());
+  for (uint32_t i = 0; i < count; ++i) {
+    if (!bodies.is_active(i)) continue;
+    const size_t run_begin = pairs_.size();
+
+    if (bucket_[i] == NOT_IN_GRID) {
+      for (uint32_t j = 0; j < count; ++j) {
+        if (skip(i, j) || !boxes_overlap(bodies, i, j)) continue;
+        pairs_.push_back({i, j});
+      }
+      finish_run(run_begin);
+      continue;
+    }
+
+    const Cell& cell = cells_[i];
+    const Vector3T<T>& pos_i = bodies.position[i];
+    for (int32_t dx = -1; dx <= 1; ++dx) {
+      for (int32_t dy = -1; dy <= 1; ++dy) {
+        for (int32_t dz = -1; dz <= 1; ++dz) {
+          Cell neighbour{cell.x + dx, cell.y + dy, cell.z + dz};
+          uint32_t bucket = hash_cell(neighbour.x, neighbour.y, neighbour.z) & bucket_mask_;
+          for (uint32_t k = bucket_start_[bucket]; k < bucket_start_[bucket + 1]; ++k) {
+            uint32_t j = sorted_[k];
+            if (skip(i, j) || !(cells_[j] == neighbour)) continue;
+            T reach = radius_[i] + radius_[j];
+            if ((bodies.position[j] - pos_i).length_squared() > reach * reach) continue;
+            pairs_.push_back({i, j});
+          }
+        }
+      }
+    }
+
+    for (uint32_t j : always_test_) {
+      if (skip(i, j) || !boxes_overlap(bodies, i, j)) continue;
+      pairs_.push_back({i, j});
+    }
+
+    finish_run(run_begin);
+  }
+}
+
+template <typename T>
+bool BroadphaseT<T>::boxes_overlap(const BodyViewT<T>& bodies, uint32_t i, uint32_t j) const {
+  const Vector3T<T> d = bodies.position[j] - bodies.position[i];
+  const Vector3T<T>& a = extent_[i];
+  const Vector3T<T>& b = extent_[j];
+  return std::abs(d.x) <= a.x + b.x && std::abs(d.y) <= a.y + b.y && std::abs(d.z) <= a.z + b.z;
+}
+
+// Sorts the pairs driven by one body by partner index, then stores each pair
+// with the lower index first.
+template <typename T>
+void BroadphaseT<T>::finish_run(size_t begin) {
+  for (size_t k = begin + 1; k < pairs_.size(); ++k) {
+    BodyPair pair = pairs_[k];
+    size_t m = k;
+    while (m > begin && pairs_[m - 1].b > pair.b) {
+      pairs_[m] = pairs_[m - 1];
+      --m;
+    }
+    pairs_[m] = pair;
+  }
+  for (size_t k = begin; k < pairs_.size(); ++k) {
+    if (pairs_[k].a > pairs_[k].b) std::swap(pairs_[k].a, pairs_[k].b);
+  }
+}
+
+template class BroadphaseT<float>;
+template class BroadphaseT<double>;
+template class IntegratorT<float>;
+template class IntegratorT<double>;
+
+}
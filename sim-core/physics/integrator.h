@@ -1,144 +1,275 @@
 #pragma once
 
 #include "rigid_body.h"
+#include "body_store.h"
+#include "narrowphase.h"
+#include "islands.h"
+#include "contact_solver.h"
+#include "../util/thread_pool.h"
 #include <vector>
 #include <cstdint>
 #include <cmath>
 #include <algorithm>
+#include <limits>
+#include <memory>
 
 namespace navora::physics {
 
 constexpr double GRAVITY = -9.81;
 constexpr double DEFAULT_DELTA_TIME = 1.0 / 60.0;
 
-struct Contact {
-  Vector3 point;
-  Vector3 normal;
-  double penetration;
-  RigidBody* body_a;
-  RigidBody* body_b;
+enum class BroadphaseMode {
+  SPATIAL_HASH,
+  BRUTE_FORCE
 };
 
-class Integrator {
-public:
-  void step(std::vector<RigidBody>& bodies, double delta_time);
+// Radius of a sphere enclosing the shape grown by margin the way the
+// narrowphase grows it (boxes along each axis), or infinity for unbounded
+// shapes.
+template <typename T>
+T bounding_radius(const CollisionShapeT<T>& shape, T margin = 0) {
+  switch (shape.type) {
+    case ShapeType::SPHERE:
+      return shape.size.x + margin;
+    case ShapeType::AABB:
+      return (shape.size + Vector3T<T>(margin, margin, margin)).length();
+    case ShapeType::PLANE:
+    default:
+      return std::numeric_limits<T>::infinity();
+  }
+}
 
-private:
-  void apply_gravity(std::vector<RigidBody>& bodies, double delta_time) {
-    Vector3 gravity_force(0, GRAVITY, 0);
-    for (auto& body : bodies) {
-      if (!body.is_static) {
-        body.apply_force(gravity_force * body.mass, delta_time);
-      }
+// Half extents of a box enclosing the shape grown by margin, infinite for
+// unbounded shapes.
+template <typename T>
+Vector3T<T> bounding_extent(const CollisionShapeT<T>& shape, T margin = 0) {
+  switch (shape.type) {
+    case ShapeType::SPHERE:
+      return Vector3T<T>(shape.size.x + margin, shape.size.x + margin, shape.size.x + margin);
+    case ShapeType::AABB:
+      return shape.size + Vector3T<T>(margin, margin, margin);
+    case ShapeType::PLANE:
+    default: {
+      const T inf = std::numeric_limits<T>::infinity();
+      return Vector3T<T>(inf, inf, inf);
     }
   }
+}
+
+// Candidate pair generation for the narrowphase. Finite bodies are bucketed
+// into a uniform hash grid whose cells are at least one body diameter wide, so
+// every overlapping pair lies in neighbouring cells. The cell is sized from
+// typical bodies rather than the largest one, so a few huge or fast bodies
+// cannot coarsen the grid for everyone else. Those outliers and unbounded
+// bodies (planes) go on an always-test list and are paired only with bodies
+// whose bounding boxes overlap theirs.
+//
+// Only active (awake, dynamic) bodies drive the search: a pair is emitted from
+// the lower-indexed body when both are active, or from the active one when the
+// other is static or asleep, so resting piles cost nothing. Pairs are grouped
+// by driving body in ascending order and sorted within each group, matching
+// the brute-force path, so the two modes feed the narrowphase identical
+// contact sequences. Each pair is stored with a < b.
+template <typename T>
+class BroadphaseT {
+public:
+  explicit BroadphaseT(util::FrameArena& arena)
+    : radius_(arena), extent_(arena), cells_(arena), bucket_(arena), bucket_start_(arena),
+      bucket_cursor_(arena), sorted_(arena), always_test_(arena), pairs_(arena) {}
+
+  void set_mode(BroadphaseMode mode) { mode_ = mode; }
+  BroadphaseMode get_mode() const { return mode_; }
+
+  // A cell size of 0 derives the cell from the body radii each step.
+  void set_cell_size(double cell_size) { cell_size_ = cell_size; }
+  double get_cell_size() const { return cell_size_; }
+
+  // margins widens each body's bounding radius by its speculative distance.
+  const PairList& find_pairs(const BodyViewT<T>& bodies, const util::FrameVector<T>& margins);
+  const PairList& get_pairs() const { return pairs_; }
+  void release_frame();
+
+private:
+  struct Cell {
+    int32_t x;
+    int32_t y;
+    int32_t z;
 
-  void integrate(std::vector<RigidBody>& bodies, double delta_time) {
-    for (auto& body : bodies) {
-      body.integrate(delta_time);
+    bool operator==(const Cell& other) const {
+      return x == other.x && y == other.y && z == other.z;
     }
+  };
+
+  void find_pairs_brute_force(const BodyViewT<T>& bodies);
+  void find_pairs_spatial_hash(const BodyViewT<T>& bodies, const util::FrameVector<T>& margins);
+  void build_grid(const BodyViewT<T>& bodies, const util::FrameVector<T>& margins);
+  void finish_run(size_t begin);
+  bool boxes_overlap(const BodyViewT<T>& bodies, uint32_t i, uint32_t j) const;
+
+  BroadphaseMode mode_ = BroadphaseMode::SPATIAL_HASH;
+  double cell_size_ = 0.0;
+  T inv_cell_size_ = 1;
+  uint32_t bucket_mask_ = 0;
+
+  util::FrameVector<T> radius_;
+  util::FrameVector<Vector3T<T>> extent_;
+  util::FrameVector<Cell> cells_;
+  util::FrameVector<uint32_t> bucket_;
+  util::FrameVector<uint32_t> bucket_start_;
+  util::FrameVector<uint32_t> bucket_cursor_;
+  util::FrameVector<uint32_t> sorted_;
+  util::FrameVector<uint32_t> always_test_;
+  PairList pairs_;
+};
+
+using Broadphase = BroadphaseT<double>;
+
+struct StepSettings {
+  // Each step() runs this many sub-steps of delta_time / substeps.
+  int substeps = 1;
+  // Pairs within the distance a body covers in one sub-step get a
+  // speculative contact, and the solver only lets them close that gap, so
+  // fast bodies cannot tunnel through thin or static geometry at large steps.
+  bool speculative_contacts = true;
+};
+
+struct SleepSettings {
+  bool enabled = true;
+  // Bodies slower than this for time_to_sleep seconds become candidates; an
+  // island sleeps once every member is a candidate.
+  double linear_threshold = 0.1;
+  double time_to_sleep = 0.5;
+};
+
+// One world's step pipeline in scalar type T. float halves the bandwidth of
+// every pass and doubles the narrowphase SIMD width; double is kept for
+// precision runs. Settings stay double and are converted once per step.
+template <typename T>
+class IntegratorT {
+public:
+  // arena_capacity is the frame arena's first block; it grows to fit the
+  // largest frame either way, so small worlds can start small.
+  explicit IntegratorT(size_t arena_capacity = 64 * 1024)
+    : frame_arena_(arena_capacity), broadphase_(frame_arena_), narrowphase_(frame_arena_), islands_(frame_arena_),
+      solver_(frame_arena_), margins_(frame_arena_), island_sleep_time_(frame_arena_), moved_(frame_arena_),
+      pool_(std::make_unique<util::ThreadPool>(1)), contacts_(frame_arena_) {}
+
+  void step(BodyViewT<T> bodies, double delta_time);
+
+  // Drops the step's scratch lists (pairs, contacts, islands, constraints)
+  // and rewinds the frame arena they live in. The owner calls this once the
+  // frame is finished; step() also calls it if the previous frame was not
+  // ended.
+  void end_frame();
+  const util::FrameArena& get_frame_arena() const { return frame_arena_; }
+
+  // Bodies the last step moved: those awake when it started and every island
+  // it woke, so bodies that fell asleep during the step are included. An
+  // index may repeat. Valid until end_frame().
+  const util::FrameVector<uint32_t>& get_moved_bodies() const { return moved_; }
+
+  // Number of threads (including the caller) used to solve contact islands.
+  // Results do not depend on this value.
+  void set_thread_count(size_t thread_count) { pool_ = std::make_unique<util::ThreadPool>(thread_count); }
+  size_t get_thread_count() const { return pool_->size(); }
+
+  void set_solver_settings(const SolverSettings& settings) { solver_.set_settings(settings); }
+  const SolverSettings& get_solver_settings() const { return solver_.get_settings(); }
+
+  // Mirrors BodyStore::remove so per-pair solver state follows renumbered bodies.
+  void remove_body(uint32_t index, uint32_t moved_from) { solver_.remove_body(index, moved_from); }
+  void clear() { solver_.clear(); }
+
+  // Per-world state that carries across steps (the solver's warm-start cache).
+  void save(util::CheckpointWriter& writer) const { solver_.save(writer); }
+  // False, with the state unchanged, if the saved cache does not fit
+  // body_count bodies.
+  bool load(const util::CheckpointReader& reader, size_t body_count) {
+    if (!solver_.load(reader, body_count)) return false;
+    end_frame();
+    return true;
   }
 
-  void detect_collisions(std::vector<RigidBody>& bodies) {
-    contacts_.clear();
-    for (size_t i = 0; i < bodies.size(); ++i) {
-      for (size_t j = i + 1; j < bodies.size(); ++j) {
-        check_collision(bodies[i], bodies[j]);
+  void set_step_settings(const StepSettings& settings) { step_settings_ = settings; }
+  const StepSettings& get_step_settings() const { return step_settings_; }
+
+  void set_sleep_settings(const SleepSettings& settings) { sleep_settings_ = settings; }
+  const SleepSettings& get_sleep_settings() const { return sleep_settings_; }
+
+  BroadphaseT<T>& get_broadphase() { return broadphase_; }
+  const BroadphaseT<T>& get_broadphase() const { return broadphase_; }
+  NarrowphaseT<T>& get_narrowphase() { return narrowphase_; }
+  const NarrowphaseT<T>& get_narrowphase() const { return narrowphase_; }
+
+private:
+  void apply_gravity(BodyViewT<T>& bodies, T delta_time) {
+    const T gravity = static_cast<T>(GRAVITY);
+    const size_t count = bodies.size();
+    for (size_t i = 0; i < count; ++i) {
+      if (bodies.is_active(i)) {
+        bodies.linear_velocity[i].y += gravity * bodies.mass[i] * bodies.inv_mass[i] * delta_time;
       }
     }
   }
 
-  void check_collision(RigidBody& a, RigidBody& b) {
-    if (a.is_static && b.is_static) return;
-
-    if (a.shape.type == ShapeType::SPHERE && b.shape.type == ShapeType::SPHERE) {
-      check_sphere_sphere(a, b);
-    } else if (a.shape.type == ShapeType::SPHERE && b.shape.type == ShapeType::PLANE) {
-      check_sphere_plane(a, b);
-    } else if (a.shape.type == ShapeType::PLANE && b.shape.type == ShapeType::SPHERE) {
-      check_sphere_plane(b, a);
+  void integrate(BodyViewT<T>& bodies, T delta_time) {
+    const size_t count = bodies.size();
+    for (size_t i = 0; i < count; ++i) {
+      if (bodies.is_active(i)) {
+        bodies.position[i] += bodies.linear_velocity[i] * delta_time;
+      }
     }
   }
 
-  void check_sphere_sphere(RigidBody& a, RigidBody& b) {
-    Vector3 diff = b.transform.position - a.transform.position;
-    double dist_sq = diff.length_squared();
-    double radius_a = a.shape.size.x;
-    double radius_b = b.shape.size.x;
-    double min_dist = radius_a + radius_b;
-
-    if (dist_sq < min_dist * min_dist) {
-      Contact contact;
-      contact.body_a = &a;
-      contact.body_b = &b;
-      double dist = sqrt(dist_sq);
-      contact.normal = (dist > 1e-9) ? diff * (1.0 / dist) : Vector3(0, 1, 0);
-      contact.penetration = min_dist - dist;
-      contact.point = a.transform.position + contact.normal * radius_a;
-      contacts_.push_back(contact);
-    }
+  void detect_collisions(const BodyViewT<T>& bodies) {
+    contacts_.clear();
+    narrowphase_.collide(bodies, broadphase_.find_pairs(bodies, margins_), margins_, contacts_);
   }
 
-  void check_sphere_plane(RigidBody& sphere, RigidBody& plane) {
-    if (plane.is_static) {
-      Vector3 plane_normal = plane.shape.normal.normalized();
-      Vector3 sphere_to_plane = sphere.transform.position - plane.transform.position;
-      double distance = sphere_to_plane.dot(plane_normal);
-      double radius = sphere.shape.size.x;
-      double plane_offset = plane.shape.offset;
-
-      if (distance - radius < plane_offset) {
-        Contact contact;
-        contact.body_a = &sphere;
-        contact.body_b = &plane;
-        contact.normal = plane_normal;
-        contact.penetration = plane_offset - (distance - radius);
-        contact.point = sphere.transform.position - plane_normal * radius;
-        contacts_.push_back(contact);
+  // A contact between an active body and a sleeping one wakes the sleeper's
+  // whole island before the solver runs.
+  void wake_touched(BodyViewT<T>& bodies) {
+    for (const ContactT<T>& contact : contacts_) {
+      if (bodies.is_sleeping(contact.body_a) && bodies.is_active(contact.body_b)) {
+        wake_island(bodies, contact.body_a);
+      } else if (bodies.is_sleeping(contact.body_b) && bodies.is_active(contact.body_a)) {
+        wake_island(bodies, contact.body_b);
       }
     }
   }
 
-  void resolve_collisions(std::vector<RigidBody>& bodies) {
-    const double restitution = 0.3;
-    const double friction = 0.5;
-
-    for (auto& contact : contacts_) {
-      RigidBody* a = contact.body_a;
-      RigidBody* b = contact.body_b;
-
-      Vector3 relative_vel = b->linear_velocity - a->linear_velocity;
-      double vel_along_normal = relative_vel.dot(contact.normal);
-
-      if (vel_along_normal > 0) continue;
-
-      double inv_mass_sum = a->inv_mass + b->inv_mass;
-      if (inv_mass_sum < 1e-9) continue;
-
-      double j = -(1.0 + restitution) * vel_along_normal / inv_mass_sum;
-
-      Vector3 impulse = contact.normal * j;
-      a->apply_impulse(impulse * -1.0);
-      b->apply_impulse(impulse);
+  void wake_island(BodyViewT<T>& bodies, uint32_t index) {
+    uint32_t body = index;
+    do {
+      moved_.push_back(body);
+      body = bodies.sleep_next[body];
+    } while (body != index);
+    bodies.wake(index);
+  }
 
-      a->transform.position += contact.normal * (contact.penetration * a->inv_mass / inv_mass_sum);
-      b->transform.position -= contact.normal * (contact.penetration * b->inv_mass / inv_mass_sum);
+  void compute_margins(const BodyViewT<T>& bodies, T delta_time);
+  void update_sleep(BodyViewT<T>& bodies, T delta_time);
 
-      relative_vel = b->linear_velocity - a->linear_velocity;
-      Vector3 tangent = relative_vel - contact.normal * relative_vel.dot(contact.normal);
-      if (tangent.length_squared() > 1e-9) {
-        tangent = tangent.normalized();
-        double jt = -relative_vel.dot(tangent) / inv_mass_sum;
-        double mu = friction;
-        Vector3 friction_impulse = tangent * (jt < j * mu ? jt : j * mu);
-        a->apply_impulse(friction_impulse * -1.0);
-        b->apply_impulse(friction_impulse);
-      }
-    }
+  void resolve_collisions(BodyViewT<T>& bodies, T delta_time) {
+    islands_.build(bodies, contacts_);
+    solver_.solve(bodies, contacts_, islands_, *pool_, delta_time);
   }
 
-  std::vector<Contact> contacts_;
+  // Declared first: the scratch lists below allocate from it.
+  util::FrameArena frame_arena_;
+  BroadphaseT<T> broadphase_;
+  NarrowphaseT<T> narrowphase_;
+  ContactIslands islands_;
+  ContactSolverT<T> solver_;
+  StepSettings step_settings_;
+  SleepSettings sleep_settings_;
+  util::FrameVector<T> margins_;
+  util::FrameVector<T> island_sleep_time_;
+  util::FrameVector<uint32_t> moved_;
+  std::unique_ptr<util::ThreadPool> pool_;
+  ContactListT<T> contacts_;
 };
 
-}
+using Integrator = IntegratorT<double>;
 
+}
@@ -0,0 +1,97 @@
+#include "islands.h"
+
+namespace navora::physics {
+
+uint32_t ContactIslands::find(uint32_t body) {
+  while (parent_[body] != body) {
+    parent_[body] = parent_[parent_[body]];
+    body = parent_[body];
+  }
+  return body;
+}
+
+void ContactIslands::unite(uint32_t a, uint32_t b) {
+  uint32_t root_a = find(a);
+  uint32_t root_b = find(b);
+  if (root_a == root_b) return;
+  // The lower index always wins so roots do not depend on contact order.
+  if (root_a < root_b) {
+    parent_[root_b] = root_a;
+  } else {
+    parent_[root_a] = root_b;
+  }
+}
+
+template <typename T>
+void ContactIslands::build(const BodyViewT<T>& bodies, const ContactListT<T>& contacts) {
+  const uint32_t body_count = static_cast<uint32_t>(bodies.size());
+  parent_.resize(body_count);
+  for (uint32_t i = 0; i < body_count; ++i) {
+    parent_[i] = i;
+  }
+  root_island_.assign(body_count, NO_ISLAND);
+
+  for (const ContactT<T>& contact : contacts) {
+    if (!bodies.is_static(contact.body_a) && !bodies.is_static(contact.body_b)) {
+      unite(contact.body_a, contact.body_b);
+    }
+  }
+
+  island_offsets_.clear();
+  island_offsets_.push_back(0);
+  contact_island_.resize(contacts.size());
+  for (size_t c = 0; c < contacts.size(); ++c) {
+    uint32_t body = bodies.is_static(contacts[c].body_a) ? contacts[c].body_b : contacts[c].body_a;
+    uint32_t root = find(body);
+    if (root_island_[root] == NO_ISLAND) {
+      root_island_[root] = static_cast<uint32_t>(island_offsets_.size() - 1);
+      island_offsets_.push_back(0);
+    }
+    uint32_t island = root_island_[root];
+    contact_island_[c] = island;
+    island_offsets_[island + 1]++;
+  }
+
+  for (size_t i = 1; i < island_offsets_.size(); ++i) {
+    island_offsets_[i] += island_offsets_[i - 1];
+  }
+
+  // Stable scatter: contacts keep their relative order inside each island.
+  contact_order_.resize(contacts.size());
+  island_cursor_.assign(island_offsets_.begin(), island_offsets_.end() - 1);
+  for (size_t c = 0; c < contacts.size(); ++c) {
+    contact_order_[island_cursor_[contact_island_[c]]++] = static_cast<uint32_t>(c);
+  }
+
+  body_island_.resize(body_count);
+  body_offsets_.assign(island_offsets_.size(), 0);
+  for (uint32_t i = 0; i < body_count; ++i) {
+    body_island_[i] = bodies.is_static(i) ? NO_ISLAND : root_island_[find(i)];
+    if (body_island_[i] != NO_ISLAND) body_offsets_[body_island_[i] + 1]++;
+  }
+  for (size_t i = 1; i < body_offsets_.size(); ++i) {
+    body_offsets_[i] += body_offsets_[i - 1];
+  }
+  body_order_.resize(body_offsets_.back());
+  island_cursor_.assign(body_offsets_.begin(), body_offsets_.end() - 1);
+  for (uint32_t i = 0; i < body_count; ++i) {
+    if (body_island_[i] != NO_ISLAND) body_order_[island_cursor_[body_island_[i]]++] = i;
+  }
+}
+
+template void ContactIslands::build(const BodyViewT<float>&, const ContactListT<float>&);
+template void ContactIslands::build(const BodyViewT<double>&, const ContactListT<double>&);
+
+void ContactIslands::release_frame() {
+  util::release(parent_);
+  util::release(root_island_);
+  util::release(contact_island_);
+  util::release(island_cursor_);
+  util::release(contact_order_);
+  util::release(island_offsets_);
+  util::release(body_island_);
+  util::release(body_order_);
+  util::release(body_offsets_);
+}
+
+}
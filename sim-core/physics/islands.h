@@ -0,0 +1,58 @@
+#pragma once
+
+#include "body_store.h"
+#include "narrowphase.h"
+#include <cstdint>
+#include <vector>
+
+namespace navora::physics {
+
+// Partitions contacts into islands: sets of dynamic bodies connected through
+// contacts. Static bodies never join islands, so two piles resting on the same
+// floor stay independent and can be solved concurrently. Islands are numbered
+// in order of their first contact and keep contacts in their original order,
+// so the partition is a pure function of the contact list.
+class ContactIslands {
+public:
+  static constexpr uint32_t NO_ISLAND = 0xffffffffu;
+
+  explicit ContactIslands(util::FrameArena& arena)
+    : parent_(arena), root_island_(arena), contact_island_(arena), island_cursor_(arena),
+      contact_order_(arena), island_offsets_(arena), body_island_(arena), body_order_(arena),
+      body_offsets_(arena) {}
+
+  template <typename T>
+  void build(const BodyViewT<T>& bodies, const ContactListT<T>& contacts);
+
+  size_t island_count() const { return island_offsets_.empty() ? 0 : island_offsets_.size() - 1; }
+
+  // Indices into the contact list for island i are
+  // contact_order[island_offsets[i]] .. contact_order[island_offsets[i + 1] - 1].
+  const util::FrameVector<uint32_t>& contact_order() const { return contact_order_; }
+  const util::FrameVector<uint32_t>& island_offsets() const { return island_offsets_; }
+
+  // Dynamic bodies of island i are
+  // body_order[body_offsets[i]] .. body_order[body_offsets[i + 1] - 1],
+  // in ascending index order. Bodies without contacts belong to no island.
+  const util::FrameVector<uint32_t>& body_order() const { return body_order_; }
+  const util::FrameVector<uint32_t>& body_offsets() const { return body_offsets_; }
+  uint32_t body_island(uint32_t body) const { return body_island_[body]; }
+
+  void release_frame();
+
+private:
+  uint32_t find(uint32_t body);
+  void unite(uint32_t a, uint32_t b);
+
+  util::FrameVector<uint32_t> parent_;
+  util::FrameVector<uint32_t> root_island_;
+  util::FrameVector<uint32_t> contact_island_;
+  util::FrameVector<uint32_t> island_cursor_;
+  util::FrameVector<uint32_t> contact_order_;
+  util::FrameVector<uint32_t> island_offsets_;
+  util::FrameVector<uint32_t> body_island_;
+  util::FrameVector<uint32_t> body_order_;
+  util::FrameVector<uint32_t> body_offsets_;
+};
+
+}
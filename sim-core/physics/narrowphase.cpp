@@ -0,0 +1,920 @@
+#include "narrowphase.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <utility>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NAVORA_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+namespace navora::physics {
+
+namespace {
+
+static_assert(sizeof(Vector3T<double>) == 3 * sizeof(double), "Vector3 must be three packed scalars");
+static_assert(sizeof(Vector3T<float>) == 3 * sizeof(float), "Vector3 must be three packed scalars");
+static_assert(sizeof(CollisionShapeT<double>) % sizeof(double) == 0, "CollisionShape must be scalar-aligned");
+static_assert(sizeof(CollisionShapeT<float>) % sizeof(float) == 0, "CollisionShape must be scalar-aligned");
+
+// Strides, in scalars, between consecutive bodies' positions and shapes.
+template <typename T>
+constexpr int POSITION_STRIDE = sizeof(Vector3T<T>) / sizeof(T);
+template <typename T>
+constexpr int SHAPE_STRIDE = sizeof(CollisionShapeT<T>) / sizeof(T);
+
+// Emits the contact for one sphere-sphere pair. The batched kernels evaluate
+// the same expressions lane by lane and fall back to this for the tail.
+template <typename T>
+void sphere_sphere_scalar(const BodyViewT<T>& bodies, const BodyPair* pairs, size_t count, const T* margin,
+                          ContactListT<T>& contacts) {
+  for (size_t k = 0; k < count; ++k) {
+    uint32_t a = pairs[k].a;
+    uint32_t b = pairs[k].b;
+    const Vector3T<T>& pos_a = bodies.position[a];
+    Vector3T<T> diff = bodies.position[b] - pos_a;
+    T dist_sq = diff.length_squared();
+    T radius_a = bodies.shape[a].size.x;
+    T radius_b = bodies.shape[b].size.x;
+    T min_dist = radius_a + radius_b;
+    T reach = min_dist + (margin[a] + margin[b]);
+
+    if (dist_sq < reach * reach) {
+      ContactT<T> contact;
+      contact.body_a = a;
+      contact.body_b = b;
+      T dist = std::sqrt(dist_sq);
+      contact.normal = (dist > T(1e-9)) ? diff * (T(1) / dist) : Vector3T<T>(0, 1, 0);
+      contact.penetration = min_dist - dist;
+      contact.point = pos_a + contact.normal * radius_a;
+      contacts.push_back(contact);
+    }
+  }
+}
+
+template <typename T>
+void sphere_plane_scalar(const BodyViewT<T>& bodies, const BodyPair* pairs, size_t count, const T* margin,
+                         ContactListT<T>& contacts) {
+  for (size_t k = 0; k < count; ++k) {
+    uint32_t sphere = pairs[k].a;
+    uint32_t plane = pairs[k].b;
+    const CollisionShapeT<T>& plane_shape = bodies.shape[plane];
+    Vector3T<T> plane_normal = plane_shape.normal.normalized();
+    Vector3T<T> sphere_to_plane = bodies.position[sphere] - bodies.position[plane];
+    T distance = sphere_to_plane.dot(plane_normal);
+    T radius = bodies.shape[sphere].size.x;
+    T plane_offset = plane_shape.offset;
+
+    if (distance - radius < plane_offset + margin[sphere]) {
+      ContactT<T> contact;
+      contact.body_a = sphere;
+      contact.body_b = plane;
+      contact.normal = plane_normal * T(-1);
+      contact.penetration = plane_offset - (distance - radius);
+      contact.point = bodies.position[sphere] - plane_normal * radius;
+      contacts.push_back(contact);
+    }
+  }
+}
+
+template <typename T>
+void sphere_aabb_scalar(const BodyViewT<T>& bodies, const BodyPair* pairs, size_t count, const T* margin,
+                        ContactListT<T>& contacts) {
+  for (size_t k = 0; k < count; ++k) {
+    uint32_t sphere = pairs[k].a;
+    uint32_t box = pairs[k].b;
+    const Vector3T<T>& center = bodies.position[sphere];
+    const Vector3T<T>& box_center = bodies.position[box];
+    const Vector3T<T>& half = bodies.shape[box].size;
+    T radius = bodies.shape[sphere].size.x;
+
+    Vector3T<T> closest(std::clamp(center.x, box_center.x - half.x, box_center.x + half.x),
+                        std::clamp(center.y, box_center.y - half.y, box_center.y + half.y),
+                        std::clamp(center.z, box_center.z - half.z, box_center.z + half.z));
+    Vector3T<T> diff = closest - center;
+    T dist_sq = diff.length_squared();
+
+    ContactT<T> contact;
+    contact.body_a = sphere;
+    contact.body_b = box;
+    if (dist_sq > T(1e-18)) {
+      T reach = radius + (margin[sphere] + margin[box]);
+      if (dist_sq >= reach * reach) continue;
+      T dist = std::sqrt(dist_sq);
+      contact.normal = diff * (T(1) / dist);
+      contact.penetration = radius - dist;
+      contact.point = closest;
+    } else {
+      // Center inside the box: push out through the nearest face.
+      Vector3T<T> local = center - box_center;
+      T depth[3] = {half.x - std::abs(local.x), half.y - std::abs(local.y), half.z - std::abs(local.z)};
+      T sign[3] = {local.x < 0 ? T(-1) : T(1), local.y < 0 ? T(-1) : T(1), local.z < 0 ? T(-1) : T(1)};
+      int axis = (depth[1] < depth[0]) ? 1 : 0;
+      if (depth[2] < depth[axis]) axis = 2;
+      Vector3T<T> face(axis == 0 ? sign[0] : T(0), axis == 1 ? sign[1] : T(0), axis == 2 ? sign[2] : T(0));
+      contact.normal = face * T(-1);
+      contact.penetration = radius + depth[axis];
+      contact.point = center + face * depth[axis];
+    }
+    contacts.push_back(contact);
+  }
+}
+
+template <typename T>
+void aabb_aabb_scalar(const BodyViewT<T>& bodies, const BodyPair* pairs, size_t count, const T* margin,
+                      ContactListT<T>& contacts) {
+  for (size_t k = 0; k < count; ++k) {
+    uint32_t a = pairs[k].a;
+    uint32_t b = pairs[k].b;
+    const Vector3T<T>& pos_a = bodies.position[a];
+    const Vector3T<T>& pos_b = bodies.position[b];
+    const Vector3T<T>& half_a = bodies.shape[a].size;
+    const Vector3T<T>& half_b = bodies.shape[b].size;
+    Vector3T<T> delta = pos_b - pos_a;
+    T overlap[3] = {half_a.x + half_b.x - std::abs(delta.x),
+                    half_a.y + half_b.y - std::abs(delta.y),
+                    half_a.z + half_b.z - std::abs(delta.z)};
+    T reach = margin[a] + margin[b];
+    if (overlap[0] <= -reach || overlap[1] <= -reach || overlap[2] <= -reach) continue;
+
+    // Separate along the axis of least overlap (or largest gap).
+    int axis = (overlap[1] < overlap[0]) ? 1 : 0;
+    if (overlap[2] < overlap[axis]) axis = 2;
+    T d[3] = {delta.x, delta.y, delta.z};
+    T sign = (d[axis] < 0) ? T(-1) : T(1);
+
+    Vector3T<T> lo(std::max(pos_a.x - half_a.x, pos_b.x - half_b.x),
+                   std::max(pos_a.y - half_a.y, pos_b.y - half_b.y),
+                   std::max(pos_a.z - half_a.z, pos_b.z - half_b.z));
+    Vector3T<T> hi(std::min(pos_a.x + half_a.x, pos_b.x + half_b.x),
+                   std::min(pos_a.y + half_a.y, pos_b.y + half_b.y),
+                   std::min(pos_a.z + half_a.z, pos_b.z + half_b.z));
+
+    ContactT<T> contact;
+    contact.body_a = a;
+    contact.body_b = b;
+    contact.normal = Vector3T<T>(axis == 0 ? sign : T(0), axis == 1 ? sign : T(0), axis == 2 ? sign : T(0));
+    contact.penetration = overlap[axis];
+    contact.point = (lo + hi) * T(0.5);
+    contacts.push_back(contact);
+  }
+}
+
+template <typename T>
+void aabb_plane_scalar(const BodyViewT<T>& bodies, const BodyPair* pairs, size_t count, const T* margin,
+                       ContactListT<T>& contacts) {
+  for (size_t k = 0; k < count; ++k) {
+    uint32_t box = pairs[k].a;
+    uint32_t plane = pairs[k].b;
+    const CollisionShapeT<T>& plane_shape = bodies.shape[plane];
+    const Vector3T<T>& half = bodies.shape[box].size;
+    Vector3T<T> plane_normal = plane_shape.normal.normalized();
+    T distance = (bodies.position[box] - bodies.position[plane]).dot(plane_normal);
+    T extent = std::abs(plane_normal.x) * half.x + std::abs(plane_normal.y) * half.y +
+               std::abs(plane_normal.z) * half.z;
+    T plane_offset = plane_shape.offset;
+
+    if (distance - extent < plane_offset + margin[box]) {
+      ContactT<T> contact;
+      contact.body_a = box;
+      contact.body_b = plane;
+      contact.normal = plane_normal * T(-1);
+      contact.penetration = plane_offset - (distance - extent);
+      contact.point = bodies.position[box] - plane_normal * extent;
+      contacts.push_back(contact);
+    }
+  }
+}
+
+#ifdef NAVORA_X86_SIMD
+
+// Lane values spilled from registers so hits can be emitted in pair order.
+// Sized for one 512-bit register of T.
+template <typename T>
+struct LaneResults {
+  static constexpr int LANES = 64 / sizeof(T);
+  alignas(64) T nx[LANES];
+  alignas(64) T ny[LANES];
+  alignas(64) T nz[LANES];
+  alignas(64) T pen[LANES];
+  alignas(64) T px[LANES];
+  alignas(64) T py[LANES];
+  alignas(64) T pz[LANES];
+};
+
+template <typename T>
+void emit_lanes(const BodyPair* pairs, unsigned mask, const LaneResults<T>& lanes, ContactListT<T>& contacts) {
+  while (mask) {
+    int lane = __builtin_ctz(mask);
+    mask &= mask - 1;
+    ContactT<T> contact;
+    contact.body_a = pairs[lane].a;
+    contact.body_b = pairs[lane].b;
+    contact.normal = Vector3T<T>(lanes.nx[lane], lanes.ny[lane], lanes.nz[lane]);
+    contact.penetration = lanes.pen[lane];
+    contact.point = Vector3T<T>(lanes.px[lane], lanes.py[lane], lanes.pz[lane]);
+    contacts.push_back(contact);
+  }
+}
+
+void sphere_sphere_sse2(const BodyView& bodies, const BodyPair* pairs, size_t count, const double* margin,
+                        ContactList& contacts) {
+  const double* pos = &bodies.position->x;
+  const double* radius = &bodies.shape->size.x;
+  const __m128d one = _mm_set1_pd(1.0);
+  const __m128d epsilon = _mm_set1_pd(1e-9);
+  LaneResults<double> lanes;
+
+  size_t k = 0;
+  for (; k + 2 <= count; k += 2) {
+    const size_t a0 = pairs[k].a * POSITION_STRIDE<double>, a1 = pairs[k + 1].a * POSITION_STRIDE<double>;
+    const size_t b0 = pairs[k].b * POSITION_STRIDE<double>, b1 = pairs[k + 1].b * POSITION_STRIDE<double>;
+    __m128d ax = _mm_set_pd(pos[a1], pos[a0]);
+    __m128d ay = _mm_set_pd(pos[a1 + 1], pos[a0 + 1]);
+    __m128d az = _mm_set_pd(pos[a1 + 2], pos[a0 + 2]);
+    __m128d dx = _mm_sub_pd(_mm_set_pd(pos[b1], pos[b0]), ax);
+    __m128d dy = _mm_sub_pd(_mm_set_pd(pos[b1 + 1], pos[b0 + 1]), ay);
+    __m128d dz = _mm_sub_pd(_mm_set_pd(pos[b1 + 2], pos[b0 + 2]), az);
+    __m128d ra = _mm_set_pd(radius[pairs[k + 1].a * SHAPE_STRIDE<double>],
+                            radius[pairs[k].a * SHAPE_STRIDE<double>]);
+    __m128d rb = _mm_set_pd(radius[pairs[k + 1].b * SHAPE_STRIDE<double>],
+                            radius[pairs[k].b * SHAPE_STRIDE<double>]);
+    __m128d ma = _mm_set_pd(margin[pairs[k + 1].a], margin[pairs[k].a]);
+    __m128d mb = _mm_set_pd(margin[pairs[k + 1].b], margin[pairs[k].b]);
+
+    __m128d dist_sq = _mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)), _mm_mul_pd(dz, dz));
+    __m128d min_dist = _mm_add_pd(ra, rb);
+    __m128d reach = _mm_add_pd(min_dist, _mm_add_pd(ma, mb));
+    unsigned mask = _mm_movemask_pd(_mm_cmplt_pd(dist_sq, _mm_mul_pd(reach, reach)));
+    if (!mask) continue;
+
+    __m128d dist = _mm_sqrt_pd(dist_sq);
+    __m128d inv = _mm_div_pd(one, dist);
+    __m128d valid = _mm_cmpgt_pd(dist, epsilon);
+    __m128d nx = _mm_and_pd(valid, _mm_mul_pd(dx, inv));
+    __m128d ny = _mm_or_pd(_mm_and_pd(valid, _mm_mul_pd(dy, inv)), _mm_andnot_pd(valid, one));
+    __m128d nz = _mm_and_pd(valid, _mm_mul_pd(dz, inv));
+
+    _mm_store_pd(lanes.nx, nx);
+    _mm_store_pd(lanes.ny, ny);
+    _mm_store_pd(lanes.nz, nz);
+    _mm_store_pd(lanes.pen, _mm_sub_pd(min_dist, dist));
+    _mm_store_pd(lanes.px, _mm_add_pd(ax, _mm_mul_pd(nx, ra)));
+    _mm_store_pd(lanes.py, _mm_add_pd(ay, _mm_mul_pd(ny, ra)));
+    _mm_store_pd(lanes.pz, _mm_add_pd(az, _mm_mul_pd(nz, ra)));
+    emit_lanes(pairs + k, mask, lanes, contacts);
+  }
+  sphere_sphere_scalar(bodies, pairs + k, count - k, margin, contacts);
+}
+
+__attribute__((target("avx2")))
+void sphere_sphere_avx2(const BodyView& bodies, const BodyPair* pairs, size_t count, const double* margin,
+                        ContactList& contacts) {
+  const double* pos = &bodies.position->x;
+  const double* radius = &bodies.shape->size.x;
+  const __m256d one = _mm256_set1_pd(1.0);
+  const __m256d zero = _mm256_setzero_pd();
+  const __m256d epsilon = _mm256_set1_pd(1e-9);
+  const __m256i split = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+  const __m128i position_stride = _mm_set1_epi32(POSITION_STRIDE<double>);
+  const __m128i shape_stride = _mm_set1_epi32(SHAPE_STRIDE<double>);
+  LaneResults<double> lanes;
+
+  size_t k = 0;
+  for (; k + 4 <= count; k += 4) {
+    __m256i packed = _mm256_permutevar8x32_epi32(
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pairs + k)), split);
+    __m128i ia = _mm256_castsi256_si128(packed);
+    __m128i ib = _mm256_extracti128_si256(packed, 1);
+    __m128i pa = _mm_mullo_epi32(ia, position_stride);
+    __m128i pb = _mm_mullo_epi32(ib, position_stride);
+
+    __m256d ax = _mm256_i32gather_pd(pos, pa, 8);
+    __m256d ay = _mm256_i32gather_pd(pos + 1, pa, 8);
+    __m256d az = _mm256_i32gather_pd(pos + 2, pa, 8);
+    __m256d dx = _mm256_sub_pd(_mm256_i32gather_pd(pos, pb, 8), ax);
+    __m256d dy = _mm256_sub_pd(_mm256_i32gather_pd(pos + 1, pb, 8), ay);
+    __m256d dz = _mm256_sub_pd(_mm256_i32gather_pd(pos + 2, pb, 8), az);
+    __m256d ra = _mm256_i32gather_pd(radius, _mm_mullo_epi32(ia, shape_stride), 8);
+    __m256d rb = _mm256_i32gather_pd(radius, _mm_mullo_epi32(ib, shape_stride), 8);
+    __m256d ma = _mm256_i32gather_pd(margin, ia, 8);
+    __m256d mb = _mm256_i32gather_pd(margin, ib, 8);
+
+    __m256d dist_sq = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)),
+                                    _mm256_mul_pd(dz, dz));
+    __m256d min_dist = _mm256_add_pd(ra, rb);
+    __m256d reach = _mm256_add_pd(min_dist, _mm256_add_pd(ma, mb));
+    unsigned mask = _mm256_movemask_pd(_mm256_cmp_pd(dist_sq, _mm256_mul_pd(reach, reach), _CMP_LT_OQ));
+    if (!mask) continue;
+
+    __m256d dist = _mm256_sqrt_pd(dist_sq);
+    __m256d inv = _mm256_div_pd(one, dist);
+    __m256d valid = _mm256_cmp_pd(dist, epsilon, _CMP_GT_OQ);
+    __m256d nx = _mm256_blendv_pd(zero, _mm256_mul_pd(dx, inv), valid);
+    __m256d ny = _mm256_blendv_pd(one, _mm256_mul_pd(dy, inv), valid);
+    __m256d nz = _mm256_blendv_pd(zero, _mm256_mul_pd(dz, inv), valid);
+
+    _mm256_store_pd(lanes.nx, nx);
+    _mm256_store_pd(lanes.ny, ny);
+    _mm256_store_pd(lanes.nz, nz);
+    _mm256_store_pd(lanes.pen, _mm256_sub_pd(min_dist, dist));
+    _mm256_store_pd(lanes.px, _mm256_add_pd(ax, _mm256_mul_pd(nx, ra)));
+    _mm256_store_pd(lanes.py, _mm256_add_pd(ay, _mm256_mul_pd(ny, ra)));
+    _mm256_store_pd(lanes.pz, _mm256_add_pd(az, _mm256_mul_pd(nz, ra)));
+    emit_lanes(pairs + k, mask, lanes, contacts);
+  }
+  sphere_sphere_scalar(bodies, pairs + k, count - k, margin, contacts);
+}
+
+__attribute__((target("avx512f")))
+void sphere_sphere_avx512(const BodyView& bodies, const BodyPair* pairs, size_t count, const double* margin,
+                          ContactList& contacts) {
+  const double* pos = &bodies.position->x;
+  const double* radius = &bodies.shape->size.x;
+  const __m512d one = _mm512_set1_pd(1.0);
+  const __m512d zero = _mm512_setzero_pd();
+  const __m512d epsilon = _mm512_set1_pd(1e-9);
+  const __m256i position_stride = _mm256_set1_epi32(POSITION_STRIDE<double>);
+  const __m256i shape_stride = _mm256_set1_epi32(SHAPE_STRIDE<double>);
+  LaneResults<double> lanes;
+
+  size_t k = 0;
+  for (; k + 8 <= count; k += 8) {
+    // Each BodyPair is one 64-bit lane with a in the low half and b in the high half.
+    __m512i packed = _mm512_loadu_si512(pairs + k);
+    __m256i ia = _mm512_cvtepi64_epi32(packed);
+    __m256i ib = _mm512_cvtepi64_epi32(_mm512_srli_epi64(packed, 32));
+    __m256i pa = _mm256_mullo_epi32(ia, position_stride);
+    __m256i pb = _mm256_mullo_epi32(ib, position_stride);
+
+    __m512d ax = _mm512_i32gather_pd(pa, pos, 8);
+    __m512d ay = _mm512_i32gather_pd(pa, pos + 1, 8);
+    __m512d az = _mm512_i32gather_pd(pa, pos + 2, 8);
+    __m512d dx = _mm512_sub_pd(_mm512_i32gather_pd(pb, pos, 8), ax);
+    __m512d dy = _mm512_sub_pd(_mm512_i32gather_pd(pb, pos + 1, 8), ay);
+    __m512d dz = _mm512_sub_pd(_mm512_i32gather_pd(pb, pos + 2, 8), az);
+    __m512d ra = _mm512_i32gather_pd(_mm256_mullo_epi32(ia, shape_stride), radius, 8);
+    __m512d rb = _mm512_i32gather_pd(_mm256_mullo_epi32(ib, shape_stride), radius, 8);
+    __m512d ma = _mm512_i32gather_pd(ia, margin, 8);
+    __m512d mb = _mm512_i32gather_pd(ib, margin, 8);
+
+    __m512d dist_sq = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(dx, dx), _mm512_mul_pd(dy, dy)),
+                                    _mm512_mul_pd(dz, dz));
+    __m512d min_dist = _mm512_add_pd(ra, rb);
+    __m512d reach = _mm512_add_pd(min_dist, _mm512_add_pd(ma, mb));
+    __mmask8 mask = _mm512_cmp_pd_mask(dist_sq, _mm512_mul_pd(reach, reach), _CMP_LT_OQ);
+    if (!mask) continue;
+
+    __m512d dist = _mm512_sqrt_pd(dist_sq);
+    __m512d inv = _mm512_div_pd(one, dist);
+    __mmask8 valid = _mm512_cmp_pd_mask(dist, epsilon, _CMP_GT_OQ);
+    __m512d nx = _mm512_mask_blend_pd(valid, zero, _mm512_mul_pd(dx, inv));
+    __m512d ny = _mm512_mask_blend_pd(valid, one, _mm512_mul_pd(dy, inv));
+    __m512d nz = _mm512_mask_blend_pd(valid, zero, _mm512_mul_pd(dz, inv));
+
+    _mm512_store_pd(lanes.nx, nx);
+    _mm512_store_pd(lanes.ny, ny);
+    _mm512_store_pd(lanes.nz, nz);
+    _mm512_store_pd(lanes.pen, _mm512_sub_pd(min_dist, dist));
+    _mm512_store_pd(lanes.px, _mm512_add_pd(ax, _mm512_mul_pd(nx, ra)));
+    _mm512_store_pd(lanes.py, _mm512_add_pd(ay, _mm512_mul_pd(ny, ra)));
+    _mm512_store_pd(lanes.pz, _mm512_add_pd(az, _mm512_mul_pd(nz, ra)));
+    emit_lanes(pairs + k, mask, lanes, contacts);
+  }
+  sphere_sphere_scalar(bodies, pairs + k, count - k, margin, contacts);
+}
+
+__attribute__((target("avx2")))
+void sphere_plane_avx2(const BodyView& bodies, const BodyPair* pairs, size_t count, const double* margin,
+                       ContactList& contacts) {
+  const double* pos = &bodies.position->x;
+  const double* radius = &bodies.shape->size.x;
+  const double* normal = &bodies.shape->normal.x;
+  const double* offset = &bodies.shape->offset;
+  const __m256d one = _mm256_set1_pd(1.0);
+  const __m256d minus_one = _mm256_set1_pd(-1.0);
+  const __m256d zero = _mm256_setzero_pd();
+  const __m256d epsilon = _mm256_set1_pd(1e-9);
+  const __m256i split = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+  const __m128i position_stride = _mm_set1_epi32(POSITION_STRIDE<double>);
+  const __m128i shape_stride = _mm_set1_epi32(SHAPE_STRIDE<double>);
+  LaneResults<double> lanes;
+
+  size_t k = 0;
+  for (; k + 4 <= count; k += 4) {
+    __m256i packed = _mm256_permutevar8x32_epi32(
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pairs + k)), split);
+    __m128i is = _mm256_castsi256_si128(packed);
+    __m128i ip = _mm256_extracti128_si256(packed, 1);
+    __m128i ps = _mm_mullo_epi32(is, position_stride);
+    __m128i pp = _mm_mullo_epi32(ip, position_stride);
+    __m128i sp = _mm_mullo_epi32(ip, shape_stride);
+
+    __m256d raw_x = _mm256_i32gather_pd(normal, sp, 8);
+    __m256d raw_y = _mm256_i32gather_pd(normal + 1, sp, 8);
+    __m256d raw_z = _mm256_i32gather_pd(normal + 2, sp, 8);
+    __m256d len = _mm256_sqrt_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(raw_x, raw_x),
+                                                             _mm256_mul_pd(raw_y, raw_y)),
+                                               _mm256_mul_pd(raw_z, raw_z)));
+    __m256d valid = _mm256_cmp_pd(len, epsilon, _CMP_NLT_UQ);
+    __m256d inv_len = _mm256_div_pd(one, len);
+    __m256d nx = _mm256_blendv_pd(zero, _mm256_mul_pd(raw_x, inv_len), valid);
+    __m256d ny = _mm256_blendv_pd(zero, _mm256_mul_pd(raw_y, inv_len), valid);
+    __m256d nz = _mm256_blendv_pd(zero, _mm256_mul_pd(raw_z, inv_len), valid);
+
+    __m256d sx = _mm256_i32gather_pd(pos, ps, 8);
+    __m256d sy = _mm256_i32gather_pd(pos + 1, ps, 8);
+    __m256d sz = _mm256_i32gather_pd(pos + 2, ps, 8);
+    __m256d tx = _mm256_sub_pd(sx, _mm256_i32gather_pd(pos, pp, 8));
+    __m256d ty = _mm256_sub_pd(sy, _mm256_i32gather_pd(pos + 1, pp, 8));
+    __m256d tz = _mm256_sub_pd(sz, _mm256_i32gather_pd(pos + 2, pp, 8));
+    __m256d distance = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(tx, nx), _mm256_mul_pd(ty, ny)),
+                                     _mm256_mul_pd(tz, nz));
+    __m256d r = _mm256_i32gather_pd(radius, _mm_mullo_epi32(is, shape_stride), 8);
+    __m256d plane_offset = _mm256_i32gather_pd(offset, sp, 8);
+    __m256d gap = _mm256_sub_pd(distance, r);
+    __m256d limit = _mm256_add_pd(plane_offset, _mm256_i32gather_pd(margin, is, 8));
+    unsigned mask = _mm256_movemask_pd(_mm256_cmp_pd(gap, limit, _CMP_LT_OQ));
+    if (!mask) continue;
+
+    _mm256_store_pd(lanes.nx, _mm256_mul_pd(nx, minus_one));
+    _mm256_store_pd(lanes.ny, _mm256_mul_pd(ny, minus_one));
+    _mm256_store_pd(lanes.nz, _mm256_mul_pd(nz, minus_one));
+    _mm256_store_pd(lanes.pen, _mm256_sub_pd(plane_offset, gap));
+    _mm256_store_pd(lanes.px, _mm256_sub_pd(sx, _mm256_mul_pd(nx, r)));
+    _mm256_store_pd(lanes.py, _mm256_sub_pd(sy, _mm256_mul_pd(ny, r)));
+    _mm256_store_pd(lanes.pz, _mm256_sub_pd(sz, _mm256_mul_pd(nz, r)));
+    emit_lanes(pairs + k, mask, lanes, contacts);
+  }
+  sphere_plane_scalar(bodies, pairs + k, count - k, margin, contacts);
+}
+
+// Float kernels: same expressions as the double ones above, with twice the
+// pairs per register.
+
+void sphere_sphere_sse2(const BodyViewT<float>& bodies, const BodyPair* pairs, size_t count, const float* margin,
+                        ContactListT<float>& contacts) {
+  const float* pos = &bodies.position->x;
+  const float* radius = &bodies.shape->size.x;
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 epsilon = _mm_set1_ps(1e-9f);
+  LaneResults<float> lanes;
+
+  size_t k = 0;
+  for (; k + 4 <= count; k += 4) {
+    const BodyPair* p = pairs + k;
+    auto gather_a = [p](const float* base, size_t stride) {
+      return _mm_set_ps(base[p[3].a * stride], base[p[2].a * stride], base[p[1].a * stride], base[p[0].a * stride]);
+    };
+    auto gather_b = [p](const float* base, size_t stride) {
+      return _mm_set_ps(base[p[3].b * stride], base[p[2].b * stride], base[p[1].b * stride], base[p[0].b * stride]);
+    };
+    __m128 ax = gather_a(pos, POSITION_STRIDE<float>);
+    __m128 ay = gather_a(pos + 1, POSITION_STRIDE<float>);
+    __m128 az = gather_a(pos + 2, POSITION_STRIDE<float>);
+    __m128 dx = _mm_sub_ps(gather_b(pos, POSITION_STRIDE<float>), ax);
+    __m128 dy = _mm_sub_ps(gather_b(pos + 1, POSITION_STRIDE<float>), ay);
+    __m128 dz = _mm_sub_ps(gather_b(pos + 2, POSITION_STRIDE<float>), az);
+    __m128 ra = gather_a(radius, SHAPE_STRIDE<float>);
+    __m128 rb = gather_b(radius, SHAPE_STRIDE<float>);
+    __m128 ma = gather_a(margin, 1);
+    __m128 mb = gather_b(margin, 1);
+
+    __m128 dist_sq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+    __m128 min_dist = _mm_add_ps(ra, rb);
+    __m128 reach = _mm_add_ps(min_dist, _mm_add_ps(ma, mb));
+    unsigned mask = _mm_movemask_ps(_mm_cmplt_ps(dist_sq, _mm_mul_ps(reach, reach)));
+    if (!mask) continue;
+
+    __m128 dist = _mm_sqrt_ps(dist_sq);
+    __m128 inv = _mm_div_ps(one, dist);
+    __m128 valid = _mm_cmpgt_ps(dist, epsilon);
+    __m128 nx = _mm_and_ps(valid, _mm_mul_ps(dx, inv));
+    __m128 ny = _mm_or_ps(_mm_and_ps(valid, _mm_mul_ps(dy, inv)), _mm_andnot_ps(valid, one));
+    __m128 nz = _mm_and_ps(valid, _mm_mul_ps(dz, inv));
+
+    _mm_store_ps(lanes.nx, nx);
+    _mm_store_ps(lanes.ny, ny);
+    _mm_store_ps(lanes.nz, nz);
+    _mm_store_ps(lanes.pen, _mm_sub_ps(min_dist, dist));
+    _mm_store_ps(lanes.px, _mm_add_ps(ax, _mm_mul_ps(nx, ra)));
+    _mm_store_ps(lanes.py, _mm_add_ps(ay, _mm_mul_ps(ny, ra)));
+    _mm_store_ps(lanes.pz, _mm_add_ps(az, _mm_mul_ps(nz, ra)));
+    emit_lanes(p, mask, lanes, contacts);
+  }
+  sphere_sphere_scalar(bodies, pairs + k, count - k, margin, contacts);
+}
+
+// Splits eight consecutive BodyPairs into their eight a and eight b indices.
+__attribute__((target("avx2")))
+inline void split_pairs_avx2(const BodyPair* pairs, __m256i& ia, __m256i& ib) {
+  const __m256i split = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+  __m256i lo = _mm256_permutevar8x32_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(pairs)), split);
+  __m256i hi = _mm256_permutevar8x32_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(pairs + 4)), split);
+  ia = _mm256_permute2x128_si256(lo, hi, 0x20);
+  ib = _mm256_permute2x128_si256(lo, hi, 0x31);
+}
+
+__attribute__((target("avx2")))
+void sphere_sphere_avx2(const BodyViewT<float>& bodies, const BodyPair* pairs, size_t count, const float* margin,
+                        ContactListT<float>& contacts) {
+  const float* pos = &bodies.position->x;
+  const float* radius = &bodies.shape->size.x;
+  const __m256 one = _mm256_set1_ps(1.0f);
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 epsilon = _mm256_set1_ps(1e-9f);
+  const __m256i position_stride = _mm256_set1_epi32(POSITION_STRIDE<float>);
+  const __m256i shape_stride = _mm256_set1_epi32(SHAPE_STRIDE<float>);
+  LaneResults<float> lanes;
+
+  size_t k = 0;
+  for (; k + 8 <= count; k += 8) {
+    __m256i ia, ib;
+    split_pairs_avx2(pairs + k, ia, ib);
+    __m256i pa = _mm256_mullo_epi32(ia, position_stride);
+    __m256i pb = _mm256_mullo_epi32(ib, position_stride);
+
+    __m256 ax = _mm256_i32gather_ps(pos, pa, 4);
+    __m256 ay = _mm256_i32gather_ps(pos + 1, pa, 4);
+    __m256 az = _mm256_i32gather_ps(pos + 2, pa, 4);
+    __m256 dx = _mm256_sub_ps(_mm256_i32gather_ps(pos, pb, 4), ax);
+    __m256 dy = _mm256_sub_ps(_mm256_i32gather_ps(pos + 1, pb, 4), ay);
+    __m256 dz = _mm256_sub_ps(_mm256_i32gather_ps(pos + 2, pb, 4), az);
+    __m256 ra = _mm256_i32gather_ps(radius, _mm256_mullo_epi32(ia, shape_stride), 4);
+    __m256 rb = _mm256_i32gather_ps(radius, _mm256_mullo_epi32(ib, shape_stride), 4);
+    __m256 ma = _mm256_i32gather_ps(margin, ia, 4);
+    __m256 mb = _mm256_i32gather_ps(margin, ib, 4);
+
+    __m256 dist_sq = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)),
+                                   _mm256_mul_ps(dz, dz));
+    __m256 min_dist = _mm256_add_ps(ra, rb);
+    __m256 reach = _mm256_add_ps(min_dist, _mm256_add_ps(ma, mb));
+    unsigned mask = _mm256_movemask_ps(_mm256_cmp_ps(dist_sq, _mm256_mul_ps(reach, reach), _CMP_LT_OQ));
+    if (!mask) continue;
+
+    __m256 dist = _mm256_sqrt_ps(dist_sq);
+    __m256 inv = _mm256_div_ps(one, dist);
+    __m256 valid = _mm256_cmp_ps(dist, epsilon, _CMP_GT_OQ);
+    __m256 nx = _mm256_blendv_ps(zero, _mm256_mul_ps(dx, inv), valid);
+    __m256 ny = _mm256_blendv_ps(one, _mm256_mul_ps(dy, inv), valid);
+    __m256 nz = _mm256_blendv_ps(zero, _mm256_mul_ps(dz, inv), valid);
+
+    _mm256_store_ps(lanes.nx, nx);
+    _mm256_store_ps(lanes.ny, ny);
+    _mm256_store_ps(lanes.nz, nz);
+    _mm256_store_ps(lanes.pen, _mm256_sub_ps(min_dist, dist));
+    _mm256_store_ps(lanes.px, _mm256_add_ps(ax, _mm256_mul_ps(nx, ra)));
+    _mm256_store_ps(lanes.py, _mm256_add_ps(ay, _mm256_mul_ps(ny, ra)));
+    _mm256_store_ps(lanes.pz, _mm256_add_ps(az, _mm256_mul_ps(nz, ra)));
+    emit_lanes(pairs + k, mask, lanes, contacts);
+  }
+  sphere_sphere_scalar(bodies, pairs + k, count - k, margin, contacts);
+}
+
+__attribute__((target("avx512f")))
+void sphere_sphere_avx512(const BodyViewT<float>& bodies, const BodyPair* pairs, size_t count, const float* margin,
+                          ContactListT<float>& contacts) {
+  const float* pos = &bodies.position->x;
+  const float* radius = &bodies.shape->size.x;
+  const __m512 one = _mm512_set1_ps(1.0f);
+  const __m512 zero = _mm512_setzero_ps();
+  const __m512 epsilon = _mm512_set1_ps(1e-9f);
+  const __m512i position_stride = _mm512_set1_epi32(POSITION_STRIDE<float>);
+  const __m512i shape_stride = _mm512_set1_epi32(SHAPE_STRIDE<float>);
+  LaneResults<float> lanes;
+
+  size_t k = 0;
+  for (; k + 16 <= count; k += 16) {
+    // Two registers of eight pairs; narrow each half to 32-bit indices and
+    // recombine into sixteen a and sixteen b indices.
+    __m512i lo = _mm512_loadu_si512(pairs + k);
+    __m512i hi = _mm512_loadu_si512(pairs + k + 8);
+    __m512i ia = _mm512_inserti64x4(_mm512_castsi256_si512(_mm512_cvtepi64_epi32(lo)),
+                                    _mm512_cvtepi64_epi32(hi), 1);
+    __m512i ib = _mm512_inserti64x4(_mm512_castsi256_si512(_mm512_cvtepi64_epi32(_mm512_srli_epi64(lo, 32))),
+                                    _mm512_cvtepi64_epi32(_mm512_srli_epi64(hi, 32)), 1);
+    __m512i pa = _mm512_mullo_epi32(ia, position_stride);
+    __m512i pb = _mm512_mullo_epi32(ib, position_stride);
+
+    __m512 ax = _mm512_i32gather_ps(pa, pos, 4);
+    __m512 ay = _mm512_i32gather_ps(pa, pos + 1, 4);
+    __m512 az = _mm512_i32gather_ps(pa, pos + 2, 4);
+    __m512 dx = _mm512_sub_ps(_mm512_i32gather_ps(pb, pos, 4), ax);
+    __m512 dy = _mm512_sub_ps(_mm512_i32gather_ps(pb, pos + 1, 4), ay);
+    __m512 dz = _mm512_sub_ps(_mm512_i32gather_ps(pb, pos + 2, 4), az);
+    __m512 ra = _mm512_i32gather_ps(_mm512_mullo_epi32(ia, shape_stride), radius, 4);
+    __m512 rb = _mm512_i32gather_ps(_mm512_mullo_epi32(ib, shape_stride), radius, 4);
+    __m512 ma = _mm512_i32gather_ps(ia, margin, 4);
+    __m512 mb = _mm512_i32gather_ps(ib, margin, 4);
+
+    __m512 dist_sq = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy)),
+                                   _mm512_mul_ps(dz, dz));
+    __m512 min_dist = _mm512_add_ps(ra, rb);
+    __m512 reach = _mm512_add_ps(min_dist, _mm512_add_ps(ma, mb));
+    __mmask16 mask = _mm512_cmp_ps_mask(dist_sq, _mm512_mul_ps(reach, reach), _CMP_LT_OQ);
+    if (!mask) continue;
+
+    __m512 dist = _mm512_sqrt_ps(dist_sq);
+    __m512 inv = _mm512_div_ps(one, dist);
+    __mmask16 valid = _mm512_cmp_ps_mask(dist, epsilon, _CMP_GT_OQ);
+    __m512 nx = _mm512_mask_blend_ps(valid, zero, _mm512_mul_ps(dx, inv));
+    __m512 ny = _mm512_mask_blend_ps(valid, one, _mm512_mul_ps(dy, inv));
+    __m512 nz = _mm512_mask_blend_ps(valid, zero, _mm512_mul_ps(dz, inv));
+
+    _mm512_store_ps(lanes.nx, nx);
+    _mm512_store_ps(lanes.ny, ny);
+    _mm512_store_ps(lanes.nz, nz);
+    _mm512_store_ps(lanes.pen, _mm512_sub_ps(min_dist, dist));
+    _mm512_store_ps(lanes.px, _mm512_add_ps(ax, _mm512_mul_ps(nx, ra)));
+    _mm512_store_ps(lanes.py, _mm512_add_ps(ay, _mm512_mul_ps(ny, ra)));
+    _mm512_store_ps(lanes.pz, _mm512_add_ps(az, _mm512_mul_ps(nz, ra)));
+    emit_lanes(pairs + k, mask, lanes, contacts);
+  }
+  sphere_sphere_scalar(bodies, pairs + k, count - k, margin, contacts);
+}
+
+__attribute__((target("avx2")))
+void sphere_plane_avx2(const BodyViewT<float>& bodies, const BodyPair* pairs, size_t count, const float* margin,
+                       ContactListT<float>& contacts) {
+  const float* pos = &bodies.position->x;
+  const float* radius = &bodies.shape->size.x;
+  const float* normal = &bodies.shape->normal.x;
+  const float* offset = &bodies.shape->offset;
+  const __m256 one = _mm256_set1_ps(1.0f);
+  const __m256 minus_one = _mm256_set1_ps(-1.0f);
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 epsilon = _mm256_set1_ps(1e-9f);
+  const __m256i position_stride = _mm256_set1_epi32(POSITION_STRIDE<float>);
+  const __m256i shape_stride = _mm256_set1_epi32(SHAPE_STRIDE<float>);
+  LaneResults<float> lanes;
+
+  size_t k = 0;
+  for (; k + 8 <= count; k += 8) {
+    __m256i is, ip;
+    split_pairs_avx2(pairs + k, is, ip);
+    __m256i ps = _mm256_mullo_epi32(is, position_stride);
+    __m256i pp = _mm256_mullo_epi32(ip, position_stride);
+    __m256i sp = _mm256_mullo_epi32(ip, shape_stride);
+
+    __m256 raw_x = _mm256_i32gather_ps(normal, sp, 4);
+    __m256 raw_y = _mm256_i32gather_ps(normal + 1, sp, 4);
+    __m256 raw_z = _mm256_i32gather_ps(normal + 2, sp, 4);
+    __m256 len = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(raw_x, raw_x),
+                                                            _mm256_mul_ps(raw_y, raw_y)),
+                                              _mm256_mul_ps(raw_z, raw_z)));
+    __m256 valid = _mm256_cmp_ps(len, epsilon, _CMP_NLT_UQ);
+    __m256 inv_len = _mm256_div_ps(one, len);
+    __m256 nx = _mm256_blendv_ps(zero, _mm256_mul_ps(raw_x, inv_len), valid);
+    __m256 ny = _mm256_blendv_ps(zero, _mm256_mul_ps(raw_y, inv_len), valid);
+    __m256 nz = _mm256_blendv_ps(zero, _mm256_mul_ps(raw_z, inv_len), valid);
+
+    __m256 sx = _mm256_i32gather_ps(pos, ps, 4);
+    __m256 sy = _mm256_i32gather_ps(pos + 1, ps, 4);
+    __m256 sz = _mm256_i32gather_ps(pos + 2, ps, 4);
+    __m256 tx = _mm256_sub_ps(sx, _mm256_i32gather_ps(pos, pp, 4));
+    __m256 ty = _mm256_sub_ps(sy, _mm256_i32gather_ps(pos + 1, pp, 4));
+    __m256 tz = _mm256_sub_ps(sz, _mm256_i32gather_ps(pos + 2, pp, 4));
+    __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tx, nx), _mm256_mul_ps(ty, ny)),
+                                    _mm256_mul_ps(tz, nz));
+    __m256 r = _mm256_i32gather_ps(radius, _mm256_mullo_epi32(is, shape_stride), 4);
+    __m256 plane_offset = _mm256_i32gather_ps(offset, sp, 4);
+    __m256 gap = _mm256_sub_ps(distance, r);
+    __m256 limit = _mm256_add_ps(plane_offset, _mm256_i32gather_ps(margin, is, 4));
+    unsigned mask = _mm256_movemask_ps(_mm256_cmp_ps(gap, limit, _CMP_LT_OQ));
+    if (!mask) continue;
+
+    _mm256_store_ps(lanes.nx, _mm256_mul_ps(nx, minus_one));
+    _mm256_store_ps(lanes.ny, _mm256_mul_ps(ny, minus_one));
+    _mm256_store_ps(lanes.nz, _mm256_mul_ps(nz, minus_one));
+    _mm256_store_ps(lanes.pen, _mm256_sub_ps(plane_offset, gap));
+    _mm256_store_ps(lanes.px, _mm256_sub_ps(sx, _mm256_mul_ps(nx, r)));
+    _mm256_store_ps(lanes.py, _mm256_sub_ps(sy, _mm256_mul_ps(ny, r)));
+    _mm256_store_ps(lanes.pz, _mm256_sub_ps(sz, _mm256_mul_ps(nz, r)));
+    emit_lanes(pairs + k, mask, lanes, contacts);
+  }
+  sphere_plane_scalar(bodies, pairs + k, count - k, margin, contacts);
+}
+
+#endif
+
+// Narrowphase for one ordered shape combination. Each supported pair is one
+// specialization providing collide(); the dispatch table below is generated
+// from these at compile time, so the reversed combination reuses the same
+// kernel with the pair swapped. static_b marks kernels whose second body
+// only collides while static (planes).
+template <ShapeType A, ShapeType B>
+struct PairKernel {
+  static constexpr bool defined = false;
+};
+
+template <>
+struct PairKernel<ShapeType::SPHERE, ShapeType::SPHERE> {
+  static constexpr bool defined = true;
+  static constexpr bool static_b = false;
+
+  template <typename T>
+  static void collide(const BodyViewT<T>& bodies, const BodyPair* pairs, size_t count, const T* margin,
+                      SimdLevel level, ContactListT<T>& contacts) {
+    switch (level) {
+#ifdef NAVORA_X86_SIMD
+      case SimdLevel::AVX512: sphere_sphere_avx512(bodies, pairs, count, margin, contacts); break;
+      case SimdLevel::AVX2: sphere_sphere_avx2(bodies, pairs, count, margin, contacts); break;
+      case SimdLevel::SSE2: sphere_sphere_sse2(bodies, pairs, count, margin, contacts); break;
+#endif
+      default: sphere_sphere_scalar(bodies, pairs, count, margin, contacts); break;
+    }
+  }
+};
+
+template <>
+struct PairKernel<ShapeType::SPHERE, ShapeType::PLANE> {
+  static constexpr bool defined = true;
+  static constexpr bool static_b = true;
+
+  template <typename T>
+  static void collide(const BodyViewT<T>& bodies, const BodyPair* pairs, size_t count, const T* margin,
+                      SimdLevel level, ContactListT<T>& contacts) {
+#ifdef NAVORA_X86_SIMD
+    if (level == SimdLevel::AVX2 || level == SimdLevel::AVX512) {
+      sphere_plane_avx2(bodies, pairs, count, margin, contacts);
+      return;
+    }
+#endif
+    sphere_plane_scalar(bodies, pairs, count, margin, contacts);
+  }
+};
+
+template <>
+struct PairKernel<ShapeType::SPHERE, ShapeType::AABB> {
+  static constexpr bool defined = true;
+  static constexpr bool static_b = false;
+
+  template <typename T>
+  static void collide(const BodyViewT<T>& bodies, const BodyPair* pairs, size_t count, const T* margin,
+                      SimdLevel, ContactListT<T>& contacts) {
+    sphere_aabb_scalar(bodies, pairs, count, margin, contacts);
+  }
+};
+
+template <>
+struct PairKernel<ShapeType::AABB, ShapeType::AABB> {
+  static constexpr bool defined = true;
+  static constexpr bool static_b = false;
+
+  template <typename T>
+  static void collide(const BodyViewT<T>& bodies, const BodyPair* pairs, size_t count, const T* margin,
+                      SimdLevel, ContactListT<T>& contacts) {
+    aabb_aabb_scalar(bodies, pairs, count, margin, contacts);
+  }
+};
+
+template <>
+struct PairKernel<ShapeType::AABB, ShapeType::PLANE> {
+  static constexpr bool defined = true;
+  static constexpr bool static_b = true;
+
+  template <typename T>
+  static void collide(const BodyViewT<T>& bodies, const BodyPair* pairs, size_t count, const T* margin,
+                      SimdLevel, ContactListT<T>& contacts) {
+    aabb_plane_scalar(bodies, pairs, count, margin, contacts);
+  }
+};
+
+template <typename T>
+using KernelFn = void (*)(const BodyViewT<T>&, const BodyPair*, size_t, const T*, SimdLevel, ContactListT<T>&);
+
+constexpr uint8_t NO_KERNEL = 0xff;
+
+struct DispatchEntry {
+  uint8_t kernel;
+  bool swap;
+  bool static_b;
+};
+
+template <size_t I>
+constexpr DispatchEntry make_entry() {
+  constexpr ShapeType a = static_cast<ShapeType>(I / SHAPE_TYPE_COUNT);
+  constexpr ShapeType b = static_cast<ShapeType>(I % SHAPE_TYPE_COUNT);
+  if constexpr (PairKernel<a, b>::defined) {
+    return {static_cast<uint8_t>(I), false, PairKernel<a, b>::static_b};
+  } else if constexpr (PairKernel<b, a>::defined) {
+    constexpr size_t reversed = (I % SHAPE_TYPE_COUNT) * SHAPE_TYPE_COUNT + I / SHAPE_TYPE_COUNT;
+    return {static_cast<uint8_t>(reversed), true, PairKernel<b, a>::static_b};
+  } else {
+    return {NO_KERNEL, false, false};
+  }
+}
+
+template <typename T, size_t I>
+constexpr KernelFn<T> make_kernel() {
+  constexpr ShapeType a = static_cast<ShapeType>(I / SHAPE_TYPE_COUNT);
+  constexpr ShapeType b = static_cast<ShapeType>(I % SHAPE_TYPE_COUNT);
+  if constexpr (PairKernel<a, b>::defined) {
+    return &PairKernel<a, b>::template collide<T>;
+  } else {
+    return nullptr;
+  }
+}
+
+template <size_t... I>
+constexpr std::array<DispatchEntry, SHAPE_PAIR_COUNT> make_dispatch_table(std::index_sequence<I...>) {
+  return {make_entry<I>()...};
+}
+
+template <typename T, size_t... I>
+constexpr std::array<KernelFn<T>, SHAPE_PAIR_COUNT> make_kernel_table(std::index_sequence<I...>) {
+  return {make_kernel<T, I>()...};
+}
+
+// Indexed by type_a * SHAPE_TYPE_COUNT + type_b.
+constexpr auto DISPATCH = make_dispatch_table(std::make_index_sequence<SHAPE_PAIR_COUNT>{});
+// Indexed by DispatchEntry::kernel; run in index order.
+template <typename T>
+constexpr auto KERNELS = make_kernel_table<T>(std::make_index_sequence<SHAPE_PAIR_COUNT>{});
+
+static_assert(DISPATCH[static_cast<size_t>(ShapeType::PLANE) * SHAPE_TYPE_COUNT +
+                       static_cast<size_t>(ShapeType::SPHERE)].swap,
+              "reversed pairs must reuse the canonical kernel");
+
+}
+
+SimdLevel detect_simd_level() {
+#ifdef NAVORA_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) return SimdLevel::AVX512;
+  if (__builtin_cpu_supports("avx2")) return SimdLevel::AVX2;
+  if (__builtin_cpu_supports("sse2")) return SimdLevel::SSE2;
+#endif
+  return SimdLevel::SCALAR;
+}
+
+const char* simd_level_name(SimdLevel level) {
+  switch (level) {
+    case SimdLevel::SSE2: return "sse2";
+    case SimdLevel::AVX2: return "avx2";
+    case SimdLevel::AVX512: return "avx512";
+    case SimdLevel::SCALAR:
+    default: return "scalar";
+  }
+}
+
+template <typename T>
+void NarrowphaseT<T>::set_simd_level(SimdLevel level) {
+  SimdLevel supported = detect_simd_level();
+  level_ = (static_cast<int>(level) > static_cast<int>(supported)) ? supported : level;
+}
+
+template <typename T>
+void NarrowphaseT<T>::collide(const BodyViewT<T>& bodies, const PairList& pairs, const util::FrameVector<T>& margins,
+                              ContactListT<T>& contacts) {
+  // Counting sort by kernel: orient each pair, count per kernel, then scatter
+  // in pair order so every batch keeps broadphase order.
+  batched_.resize(pairs.size());
+  kernel_.resize(pairs.size());
+  batch_offsets_.assign(SHAPE_PAIR_COUNT + 1, 0);
+  for (size_t k = 0; k < pairs.size(); ++k) {
+    const BodyPair& pair = pairs[k];
+    size_t type_a = static_cast<size_t>(bodies.shape[pair.a].type);
+    size_t type_b = static_cast<size_t>(bodies.shape[pair.b].type);
+    const DispatchEntry& entry = DISPATCH[type_a * SHAPE_TYPE_COUNT + type_b];
+    BodyPair ordered = entry.swap ? BodyPair{pair.b, pair.a} : pair;
+    bool skip = entry.kernel == NO_KERNEL || (entry.static_b && !bodies.is_static(ordered.b));
+    batched_[k] = ordered;
+    kernel_[k] = skip ? NO_KERNEL : entry.kernel;
+    if (!skip) batch_offsets_[entry.kernel + 1]++;
+  }
+  for (size_t k = 1; k <= SHAPE_PAIR_COUNT; ++k) {
+    batch_offsets_[k] += batch_offsets_[k - 1];
+  }
+
+  // Scatter in place would clobber unread pairs, so the sorted copy goes
+  // after the oriented pairs in the same buffer.
+  const size_t count = pairs.size();
+  batched_.resize(count + batch_offsets_[SHAPE_PAIR_COUNT]);
+  for (size_t k = 0; k < count; ++k) {
+    if (kernel_[k] != NO_KERNEL) batched_[count + batch_offsets_[kernel_[k]]++] = batched_[k];
+  }
+
+  uint32_t begin = 0;
+  for (size_t k = 0; k < SHAPE_PAIR_COUNT; ++k) {
+    uint32_t end = batch_offsets_[k];
+    if (KERNELS<T>[k] && end > begin) {
+      KERNELS<T>[k](bodies, batched_.data() + count + begin, end - begin, margins.data(), level_, contacts);
+    }
+    begin = end;
+  }
+}
+
+template <typename T>
+void NarrowphaseT<T>::release_frame() {
+  util::release(kernel_);
+  util::release(batch_offsets_);
+  util::release(batched_);
+}
+
+template class NarrowphaseT<float>;
+template class NarrowphaseT<double>;
+
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "body_store.h"
+#include "../util/frame_arena.h"
+#include <cstdint>
+#include <vector>
+
+namespace navora::physics {
+
+constexpr size_t SHAPE_PAIR_COUNT = SHAPE_TYPE_COUNT * SHAPE_TYPE_COUNT;
+
+struct BodyPair {
+  uint32_t a;
+  uint32_t b;
+};
+
+// normal points from body_a towards body_b. Negative penetration is a
+// speculative contact: the bodies are that far apart.
+template <typename T>
+struct ContactT {
+  uint32_t body_a;
+  uint32_t body_b;
+  T penetration;
+  Vector3T<T> normal;
+  Vector3T<T> point;
+};
+
+// Per-step scratch lists, allocated from the integrator's frame arena.
+using PairList = util::FrameVector<BodyPair>;
+template <typename T>
+using ContactListT = util::FrameVector<ContactT<T>>;
+
+using Contact = ContactT<double>;
+using ContactList = ContactListT<double>;
+
+enum class SimdLevel {
+  SCALAR,
+  SSE2,
+  AVX2,
+  AVX512
+};
+
+// Widest instruction set the CPU and OS support for the narrowphase kernels.
+SimdLevel detect_simd_level();
+const char* simd_level_name(SimdLevel level);
+
+// Batched contact generation for broadphase pairs. Pairs are split by shape
+// combination through a dispatch table generated at compile time from the
+// per-pair kernels, then each batch runs its kernel in one call. Sphere
+// kernels fill one SSE2, AVX2 or AVX-512 register with pairs (2, 4 or 8 in
+// double, 4, 8 or 16 in float); every level performs the same operations in
+// the same order as the scalar kernel, and contacts are emitted in pair order
+// within each batch, so all levels produce bit-identical contact buffers.
+template <typename T>
+class NarrowphaseT {
+public:
+  explicit NarrowphaseT(util::FrameArena& arena)
+    : level_(detect_simd_level()), kernel_(arena), batch_offsets_(arena), batched_(arena) {}
+
+  // Requests a kernel level; anything wider than the CPU supports is clamped.
+  void set_simd_level(SimdLevel level);
+  SimdLevel get_simd_level() const { return level_; }
+
+  // margins holds each body's speculative distance for this step (see
+  // StepSettings); pairs closer than the sum of their margins produce a
+  // contact with negative penetration.
+  void collide(const BodyViewT<T>& bodies, const PairList& pairs, const util::FrameVector<T>& margins,
+               ContactListT<T>& contacts);
+  void release_frame();
+
+private:
+  SimdLevel level_;
+  // Pairs grouped by kernel: batch k is
+  // batched[batch_offsets[k]] .. batched[batch_offsets[k + 1] - 1].
+  util::FrameVector<uint8_t> kernel_;
+  util::FrameVector<uint32_t> batch_offsets_;
+  PairList batched_;
+};
+
+using Narrowphase = NarrowphaseT<double>;
+
+}
@@ -1,79 +1,99 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <cmath>
 
 namespace navora::physics {
 
-struct Vector3 {
-  double x = 0.0;
-  double y = 0.0;
-  double z = 0.0;
+// Math and body types are templated on the scalar so a world can run in
+// float (half the memory traffic, twice the SIMD lanes) or double. The
+// unsuffixed names are the double instantiations.
+template <typename T>
+struct Vector3T {
+  T x = 0;
+  T y = 0;
+  T z = 0;
 
-  Vector3() = default;
-  Vector3(double x, double y, double z) : x(x), y(y), z(z) {}
+  Vector3T() = default;
+  Vector3T(T x, T y, T z) : x(x), y(y), z(z) {}
 
-  Vector3 operator+(const Vector3& other) const {
-    return Vector3(x + other.x, y + other.y, z + other.z);
+  template <typename U>
+  explicit Vector3T(const Vector3T<U>& other)
+    : x(static_cast<T>(other.x)), y(static_cast<T>(other.y)), z(static_cast<T>(other.z)) {}
+
+  Vector3T operator+(const Vector3T& other) const {
+    return Vector3T(x + other.x, y + other.y, z + other.z);
   }
 
-  Vector3 operator-(const Vector3& other) const {
-    return Vector3(x - other.x, y - other.y, z - other.z);
+  Vector3T operator-(const Vector3T& other) const {
+    return Vector3T(x - other.x, y - other.y, z - other.z);
   }
 
-  Vector3 operator*(double scalar) const {
-    return Vector3(x * scalar, y * scalar, z * scalar);
+  Vector3T operator*(T scalar) const {
+    return Vector3T(x * scalar, y * scalar, z * scalar);
   }
 
-  Vector3& operator+=(const Vector3& other) {
+  Vector3T& operator+=(const Vector3T& other) {
     x += other.x;
     y += other.y;
     z += other.z;
     return *this;
   }
 
-  Vector3& operator-=(const Vector3& other) {
+  Vector3T& operator-=(const Vector3T& other) {
     x -= other.x;
     y -= other.y;
     z -= other.z;
     return *this;
   }
 
-  double dot(const Vector3& other) const {
+  T dot(const Vector3T& other) const {
     return x * other.x + y * other.y + z * other.z;
   }
 
-  double length_squared() const {
+  T length_squared() const {
     return x * x + y * y + z * z;
   }
 
-  double length() const {
-    return sqrt(length_squared());
+  T length() const {
+    return std::sqrt(length_squared());
   }
 
-  Vector3 normalized() const {
-    double len = length();
-    if (len < 1e-9) return Vector3(0, 0, 0);
-    return *this * (1.0 / len);
+  Vector3T normalized() const {
+    T len = length();
+    if (len < T(1e-9)) return Vector3T(0, 0, 0);
+    return *this * (T(1) / len);
   }
 };
 
-struct Quaternion {
-  double x = 0.0;
-  double y = 0.0;
-  double z = 0.0;
-  double w = 1.0;
+template <typename T>
+struct QuaternionT {
+  T x = 0;
+  T y = 0;
+  T z = 0;
+  T w = 1;
+
+  QuaternionT() = default;
+  QuaternionT(T x, T y, T z, T w) : x(x), y(y), z(z), w(w) {}
 
-  Quaternion() = default;
-  Quaternion(double x, double y, double z, double w) : x(x), y(y), z(z), w(w) {}
+  template <typename U>
+  explicit QuaternionT(const QuaternionT<U>& other)
+    : x(static_cast<T>(other.x)), y(static_cast<T>(other.y)), z(static_cast<T>(other.z)),
+      w(static_cast<T>(other.w)) {}
 };
 
-struct Transform {
-  Vector3 position;
-  Quaternion rotation;
-  Vector3 scale;
+template <typename T>
+struct TransformT {
+  Vector3T<T> position;
+  QuaternionT<T> rotation;
+  Vector3T<T> scale;
+
+  TransformT() : scale(1, 1, 1) {}
 
-  Transform() : scale(1.0, 1.0, 1.0) {}
+  template <typename U>
+  explicit TransformT(const TransformT<U>& other)
+    : position(other.position), rotation(other.rotation), scale(other.scale) {}
 };
 
 enum class ShapeType {
@@ -82,42 +102,69 @@ enum class ShapeType {
   AABB
 };
 
-struct CollisionShape {
+constexpr size_t SHAPE_TYPE_COUNT = 3;
+static_assert(static_cast<size_t>(ShapeType::AABB) + 1 == SHAPE_TYPE_COUNT, "SHAPE_TYPE_COUNT must cover ShapeType");
+
+template <typename T>
+struct CollisionShapeT {
   ShapeType type = ShapeType::SPHERE;
-  Vector3 size;
-  Vector3 normal;
-  double offset = 0.0;
+  Vector3T<T> size;
+  Vector3T<T> normal;
+  T offset = 0;
+
+  CollisionShapeT() = default;
+
+  template <typename U>
+  explicit CollisionShapeT(const CollisionShapeT<U>& other)
+    : type(other.type), size(other.size), normal(other.normal), offset(static_cast<T>(other.offset)) {}
 };
 
-struct RigidBody {
-  Transform transform;
-  Vector3 linear_velocity;
-  Vector3 angular_velocity;
-  double mass = 1.0;
-  double inv_mass = 1.0;
-  CollisionShape shape;
+template <typename T>
+struct RigidBodyT {
+  TransformT<T> transform;
+  Vector3T<T> linear_velocity;
+  Vector3T<T> angular_velocity;
+  T mass = 1;
+  T inv_mass = 1;
+  CollisionShapeT<T> shape;
   bool is_static = false;
 
-  RigidBody() {
+  RigidBodyT() {
     shape.type = ShapeType::SPHERE;
-    shape.size = Vector3(1.0, 1.0, 1.0);
+    shape.size = Vector3T<T>(1, 1, 1);
   }
 
-  void apply_force(const Vector3& force, double delta_time) {
+  // Converts between precisions, e.g. a float world's body for the USD
+  // stage or the wire format, which are double.
+  template <typename U>
+  explicit RigidBodyT(const RigidBodyT<U>& other)
+    : transform(other.transform), linear_velocity(other.linear_velocity),
+      angular_velocity(other.angular_velocity), mass(static_cast<T>(other.mass)),
+      inv_mass(static_cast<T>(other.inv_mass)), shape(other.shape), is_static(other.is_static) {}
+
+  void apply_force(const Vector3T<T>& force, T delta_time) {
     if (is_static) return;
     linear_velocity = linear_velocity + force * (inv_mass * delta_time);
   }
 
-  void apply_impulse(const Vector3& impulse) {
+  void apply_impulse(const Vector3T<T>& impulse) {
     if (is_static) return;
     linear_velocity = linear_velocity + impulse * inv_mass;
   }
 
-  void integrate(double delta_time) {
+  void integrate(T delta_time) {
     if (is_static) return;
     transform.position = transform.position + linear_velocity * delta_time;
   }
 };
 
-}
+using Vector3 = Vector3T<double>;
+using Quaternion = QuaternionT<double>;
+using Transform = TransformT<double>;
+using CollisionShape = CollisionShapeT<double>;
+using RigidBody = RigidBodyT<double>;
 
+using Vector3f = Vector3T<float>;
+using RigidBodyf = RigidBodyT<float>;
+
+}
@@ -0,0 +1,378 @@
+#include "scene_query.h"
+#include "integrator.h"
+#include <algorithm>
+#include <cmath>
+
+namespace navora::physics {
+
+namespace {
+
+Vector3 closest_point_on_box(const Vector3& point, const Vector3& min, const Vector3& max) {
+  return Vector3(std::clamp(point.x, min.x, max.x),
+                 std::clamp(point.y, min.y, max.y),
+                 std::clamp(point.z, min.z, max.z));
+}
+
+// Casts a sphere of the given radius (0 for a ray) from origin along the unit
+// direction against a single body. Fills hit and returns true on a hit within
+// max_t. Starting inside the shape reports a hit at distance 0.
+template <typename T>
+bool cast_body(const BodyStoreT<T>& bodies, uint32_t index, const Vector3& origin, const Vector3& direction,
+               double radius, double max_t, QueryHit& hit) {
+  const CollisionShape shape(bodies.shape[index]);
+  const Vector3 position(bodies.position[index]);
+
+  switch (shape.type) {
+    case ShapeType::SPHERE: {
+      double reach = shape.size.x + radius;
+      Vector3 offset = origin - position;
+      double b = offset.dot(direction);
+      double c = offset.length_squared() - reach * reach;
+      double t = 0.0;
+      if (c > 0.0) {
+        if (b > 0.0) return false;
+        double discriminant = b * b - c;
+        if (discriminant < 0.0) return false;
+        t = -b - sqrt(discriminant);
+      }
+      if (t > max_t) return false;
+      Vector3 center = origin + direction * t;
+      Vector3 normal = (center - position).normalized();
+      if (normal.length_squared() < 0.5) normal = direction * -1.0;
+      hit.distance = t;
+      hit.normal = normal;
+      hit.point = position + normal * shape.size.x;
+      break;
+    }
+    case ShapeType::PLANE: {
+      Vector3 normal = shape.normal.normalized();
+      double distance = (origin - position).dot(normal) - shape.offset - radius;
+      double t = 0.0;
+      if (distance > 0.0) {
+        double denom = normal.dot(direction);
+        if (denom >= -1e-12) return false;
+        t = -distance / denom;
+      }
+      if (t > max_t) return false;
+      hit.distance = t;
+      hit.normal = normal;
+      hit.point = origin + direction * t - normal * radius;
+      break;
+    }
+    case ShapeType::AABB: {
+      Vector3 extent = shape.size + Vector3(radius, radius, radius);
+      const double o[3] = {origin.x, origin.y, origin.z};
+      const double d[3] = {direction.x, direction.y, direction.z};
+      const double lo[3] = {position.x - extent.x, position.y - extent.y, position.z - extent.z};
+      const double hi[3] = {position.x + extent.x, position.y + extent.y, position.z + extent.z};
+      double t_min = 0.0;
+      double t_max = max_t;
+      int entry_axis = -1;
+      double entry_sign = 0.0;
+      for (int axis = 0; axis < 3; ++axis) {
+        if (std::abs(d[axis]) < 1e-12) {
+          if (o[axis] < lo[axis] || o[axis] > hi[axis]) return false;
+          continue;
+        }
+        double inv = 1.0 / d[axis];
+        double t1 = (lo[axis] - o[axis]) * inv;
+        double t2 = (hi[axis] - o[axis]) * inv;
+        double sign = -1.0;
+        if (t1 > t2) {
+          std::swap(t1, t2);
+          sign = 1.0;
+        }
+        if (t1 > t_min) {
+          t_min = t1;
+          entry_axis = axis;
+          entry_sign = sign;
+        }
+        t_max = std::min(t_max, t2);
+        if (t_min > t_max) return false;
+      }
+      Vector3 normal = direction * -1.0;
+      if (entry_axis == 0) normal = Vector3(entry_sign, 0, 0);
+      if (entry_axis == 1) normal = Vector3(0, entry_sign, 0);
+      if (entry_axis == 2) normal = Vector3(0, 0, entry_sign);
+      Vector3 center = origin + direction * t_min;
+      hit.distance = t_min;
+      hit.normal = normal;
+      hit.point = closest_point_on_box(center, position - shape.size, position + shape.size);
+      break;
+    }
+    default:
+      return false;
+  }
+
+  hit.hit = true;
+  hit.body = index;
+  return true;
+}
+
+template <typename T>
+bool sphere_overlaps_body(const BodyStoreT<T>& bodies, uint32_t index, const Sphere& sphere) {
+  const CollisionShape shape(bodies.shape[index]);
+  const Vector3 position(bodies.position[index]);
+  switch (shape.type) {
+    case ShapeType::SPHERE: {
+      double reach = shape.size.x + sphere.radius;
+      return (sphere.center - position).length_squared() <= reach * reach;
+    }
+    case ShapeType::PLANE: {
+      Vector3 normal = shape.normal.normalized();
+      return (sphere.center - position).dot(normal) - shape.offset <= sphere.radius;
+    }
+    case ShapeType::AABB: {
+      Vector3 closest = closest_point_on_box(sphere.center, position - shape.size, position + shape.size);
+      return (sphere.center - closest).length_squared() <= sphere.radius * sphere.radius;
+    }
+    default:
+      return false;
+  }
+}
+
+template <typename T>
+bool box_overlaps_body(const BodyStoreT<T>& bodies, uint32_t index, const AABB& box) {
+  const CollisionShape shape(bodies.shape[index]);
+  const Vector3 position(bodies.position[index]);
+  switch (shape.type) {
+    case ShapeType::SPHERE: {
+      double radius = shape.size.x;
+      Vector3 closest = closest_point_on_box(position, box.min, box.max);
+      return (position - closest).length_squared() <= radius * radius;
+    }
+    case ShapeType::PLANE: {
+      Vector3 normal = shape.normal.normalized();
+      Vector3 center = (box.min + box.max) * 0.5;
+      Vector3 half = (box.max - box.min) * 0.5;
+      double extent = std::abs(normal.x) * half.x + std::abs(normal.y) * half.y + std::abs(normal.z) * half.z;
+      return (center - position).dot(normal) - shape.offset <= extent;
+    }
+    case ShapeType::AABB:
+      return box.overlaps(AABB(position - shape.size, position + shape.size));
+    default:
+      return false;
+  }
+}
+
+}
+
+template <typename T>
+AABB compute_aabb(const BodyStoreT<T>& bodies, uint32_t index) {
+  const CollisionShape shape(bodies.shape[index]);
+  const Vector3 position(bodies.position[index]);
+  Vector3 extent = (shape.type == ShapeType::AABB) ? shape.size
+                                                   : Vector3(shape.size.x, shape.size.x, shape.size.x);
+  return AABB(position - extent, position + extent);
+}
+
+template <typename T>
+void SceneQuery::add(const BodyStoreT<T>& bodies, uint32_t index) {
+  if (std::isfinite(bounding_radius(bodies.shape[index]))) {
+    proxies_.push_back(tree_.insert(compute_aabb(bodies, index).expanded(margin_), index));
+  } else {
+    proxies_.push_back(AABBTree::NULL_NODE);
+    unbounded_.push_back(index);
+  }
+}
+
+void SceneQuery::remove(uint32_t index, uint32_t moved_from) {
+  int32_t proxy = proxies_[index];
+  if (proxy != AABBTree::NULL_NODE) {
+    tree_.remove(proxy);
+  } else {
+    unbounded_.erase(std::find(unbounded_.begin(), unbounded_.end(), index));
+  }
+
+  if (moved_from != index) {
+    int32_t moved_proxy = proxies_[moved_from];
+    proxies_[index] = moved_proxy;
+    if (moved_proxy != AABBTree::NULL_NODE) {
+      tree_.set_user_data(moved_proxy, index);
+    } else {
+      *std::find(unbounded_.begin(), unbounded_.end(), moved_from) = index;
+    }
+  }
+  proxies_.pop_back();
+}
+
+template <typename T>
+void SceneQuery::update(const BodyStoreT<T>& bodies, uint32_t index) {
+  int32_t& proxy = proxies_[index];
+  bool bounded = std::isfinite(bounding_radius(bodies.shape[index]));
+
+  if (proxy == AABBTree::NULL_NODE) {
+    if (!bounded) return;
+    unbounded_.erase(std::find(unbounded_.begin(), unbounded_.end(), index));
+    proxy = tree_.insert(compute_aabb(bodies, index).expanded(margin_), index);
+  } else if (!bounded) {
+    tree_.remove(proxy);
+    proxy = AABBTree::NULL_NODE;
+    unbounded_.push_back(index);
+  } else {
+    tree_.move(proxy, compute_aabb(bodies, index).expanded(margin_));
+  }
+}
+
+template <typename T>
+void SceneQuery::refit(const BodyStoreT<T>& bodies, const uint32_t* moved, size_t moved_count, double delta_time) {
+  for (size_t k = 0; k < moved_count; ++k) {
+    const uint32_t i = moved[k];
+    int32_t proxy = proxies_[i];
+    if (proxy == AABBTree::NULL_NODE) continue;
+
+    AABB box = compute_aabb(bodies, i);
+    if (tree_.get_fat_aabb(proxy).contains(box)) continue;
+
+    // Stretch the new fat box along the current motion so a steadily moving
+    // body is not reinserted every tick.
+    AABB fat = box.expanded(margin_);
+    Vector3 displacement = Vector3(bodies.linear_velocity[i]) * delta_time;
+    if (displacement.x < 0.0) fat.min.x += displacement.x; else fat.max.x += displacement.x;
+    if (displacement.y < 0.0) fat.min.y += displacement.y; else fat.max.y += displacement.y;
+    if (displacement.z < 0.0) fat.min.z += displacement.z; else fat.max.z += displacement.z;
+    tree_.move(proxy, fat);
+  }
+}
+
+void SceneQuery::clear() {
+  tree_.clear();
+  proxies_.clear();
+  unbounded_.clear();
+}
+
+void SceneQuery::save(util::CheckpointWriter& writer) const {
+  tree_.save(writer);
+  writer.add(util::CHECKPOINT_QUERY_PROXIES, proxies_);
+  writer.add(util::CHECKPOINT_QUERY_UNBOUNDED, unbounded_);
+}
+
+bool SceneQuery::load(const util::CheckpointReader& reader, size_t body_count) {
+  if (!tree_.load(reader) || !reader.read(util::CHECKPOINT_QUERY_PROXIES, proxies_) ||
+      !reader.read(util::CHECKPOINT_QUERY_UNBOUNDED, unbounded_) || proxies_.size() != body_count) {
+    return false;
+  }
+  // Every body is either a tree leaf carrying its index or listed once in
+  // unbounded_, and the tree has no other leaves.
+  size_t bounded = 0;
+  for (uint32_t i = 0; i < body_count; ++i) {
+    if (proxies_[i] == AABBTree::NULL_NODE) continue;
+    if (!tree_.is_leaf(proxies_[i]) || tree_.get_user_data(proxies_[i]) != i) return false;
+    bounded++;
+  }
+  if (bounded != tree_.leaf_count() || bounded + unbounded_.size() != body_count) return false;
+  std::vector<bool> listed(body_count, false);
+  for (uint32_t body : unbounded_) {
+    if (body >= body_count || proxies_[body] != AABBTree::NULL_NODE || listed[body]) return false;
+    listed[body] = true;
+  }
+  return true;
+}
+
+template <typename T>
+QueryHit SceneQuery::cast(const BodyStoreT<T>& bodies, const Vector3& origin, const Vector3& direction,
+                          double radius, double max_distance) const {
+  QueryHit best;
+  double length = direction.length();
+  if (length < 1e-12) return best;
+  Vector3 unit = direction * (1.0 / length);
+
+  tree_.raycast(origin, unit, max_distance, radius, [&](uint32_t body, double max_t) {
+    QueryHit hit;
+    if (cast_body(bodies, body, origin, unit, radius, max_t, hit)) {
+      best = hit;
+      return hit.distance;
+    }
+    return max_t;
+  });
+
+  double max_t = best.hit ? best.distance : max_distance;
+  for (uint32_t body : unbounded_) {
+    QueryHit hit;
+    if (cast_body(bodies, body, origin, unit, radius, max_t, hit)) {
+      best = hit;
+      max_t = hit.distance;
+    }
+  }
+  return best;
+}
+
+template <typename T>
+void SceneQuery::raycast(const BodyStoreT<T>& bodies, const std::vector<Ray>& rays,
+                         std::vector<QueryHit>& hits) const {
+  hits.resize(rays.size());
+  for (size_t q = 0; q < rays.size(); ++q) {
+    hits[q] = cast(bodies, rays[q].origin, rays[q].direction, 0.0, rays[q].max_distance);
+  }
+}
+
+template <typename T>
+void SceneQuery::sweep_sphere(const BodyStoreT<T>& bodies, const std::vector<SphereSweep>& sweeps,
+                              std::vector<QueryHit>& hits) const {
+  hits.resize(sweeps.size());
+  for (size_t q = 0; q < sweeps.size(); ++q) {
+    const SphereSweep& sweep = sweeps[q];
+    hits[q] = cast(bodies, sweep.origin, sweep.direction, sweep.radius, sweep.max_distance);
+  }
+}
+
+template <typename T>
+void SceneQuery::overlap_sphere(const BodyStoreT<T>& bodies, const std::vector<Sphere>& spheres,
+                                OverlapResults& results) const {
+  results.clear();
+  results.offsets.push_back(0);
+  for (const Sphere& sphere : spheres) {
+    size_t begin = results.bodies.size();
+    AABB box = AABB(sphere.center, sphere.center).expanded(sphere.radius);
+    tree_.query(box, [&](uint32_t body) {
+      if (sphere_overlaps_body(bodies, body, sphere)) results.bodies.push_back(body);
+      return true;
+    });
+    for (uint32_t body : unbounded_) {
+      if (sphere_overlaps_body(bodies, body, sphere)) results.bodies.push_back(body);
+    }
+    std::sort(results.bodies.begin() + begin, results.bodies.end());
+    results.offsets.push_back(static_cast<uint32_t>(results.bodies.size()));
+  }
+}
+
+template <typename T>
+void SceneQuery::overlap_aabb(const BodyStoreT<T>& bodies, const std::vector<AABB>& boxes,
+                              OverlapResults& results) const {
+  results.clear();
+  results.offsets.push_back(0);
+  for (const AABB& box : boxes) {
+    size_t begin = results.bodies.size();
+    tree_.query(box, [&](uint32_t body) {
+      if (box_overlaps_body(bodies, body, box)) results.bodies.push_back(body);
+      return true;
+    });
+    for (uint32_t body : unbounded_) {
+      if (box_overlaps_body(bodies, body, box)) results.bodies.push_back(body);
+    }
+    std::sort(results.bodies.begin() + begin, results.bodies.end());
+    results.offsets.push_back(static_cast<uint32_t>(results.bodies.size()));
+  }
+}
+
+template AABB compute_aabb(const BodyStoreT<float>&, uint32_t);
+template void SceneQuery::add(const BodyStoreT<float>&, uint32_t);
+template void SceneQuery::update(const BodyStoreT<float>&, uint32_t);
+template void SceneQuery::refit(const BodyStoreT<float>&, const uint32_t*, size_t, double);
+template void SceneQuery::raycast(const BodyStoreT<float>&, const std::vector<Ray>&, std::vector<QueryHit>&) const;
+template void SceneQuery::sweep_sphere(const BodyStoreT<float>&, const std::vector<SphereSweep>&,
+                                       std::vector<QueryHit>&) const;
+template void SceneQuery::overlap_sphere(const BodyStoreT<float>&, const std::vector<Sphere>&, OverlapResults&) const;
+template void SceneQuery::overlap_aabb(const BodyStoreT<float>&, const std::vector<AABB>&, OverlapResults&) const;
+
+template AABB compute_aabb(const BodyStoreT<double>&, uint32_t);
+template void SceneQuery::add(const BodyStoreT<double>&, uint32_t);
+template void SceneQuery::update(const BodyStoreT<double>&, uint32_t);
+template void SceneQuery::refit(const BodyStoreT<double>&, const uint32_t*, size_t, double);
+template void SceneQuery::raycast(const BodyStoreT<double>&, const std::vector<Ray>&, std::vector<QueryHit>&) const;
+template void SceneQuery::sweep_sphere(const BodyStoreT<double>&, const std::vector<SphereSweep>&,
+                                       std::vector<QueryHit>&) const;
+template void SceneQuery::overlap_sphere(const BodyStoreT<double>&, const std::vector<Sphere>&, OverlapResults&) const;
+template void SceneQuery::overlap_aabb(const BodyStoreT<double>&, const std::vector<AABB>&, OverlapResults&) const;
+
+}
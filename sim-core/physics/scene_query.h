@@ -0,0 +1,107 @@
+#pragma once
+
+#include "aabb_tree.h"
+#include "body_store.h"
+#include <cstdint>
+#include <vector>
+#include <limits>
+
+namespace navora::physics {
+
+struct Ray {
+  Vector3 origin;
+  Vector3 direction;
+  double max_distance = std::numeric_limits<double>::infinity();
+};
+
+struct SphereSweep {
+  Vector3 origin;
+  Vector3 direction;
+  double radius = 0.0;
+  double max_distance = std::numeric_limits<double>::infinity();
+};
+
+struct Sphere {
+  Vector3 center;
+  double radius = 0.0;
+};
+
+struct QueryHit {
+  bool hit = false;
+  uint32_t body = 0;
+  double distance = 0.0;
+  Vector3 point;
+  Vector3 normal;
+};
+
+// Overlap results for a batch of queries, flattened so a batch fills two
+// arrays instead of one vector per query. Bodies hit by query q are
+// bodies[offsets[q]] .. bodies[offsets[q + 1] - 1].
+struct OverlapResults {
+  std::vector<uint32_t> offsets;
+  std::vector<uint32_t> bodies;
+
+  size_t query_count() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+
+  void clear() {
+    offsets.clear();
+    bodies.clear();
+  }
+};
+
+// Spatial queries over a BodyStore backed by a dynamic AABB tree. Bounded
+// bodies each own a tree leaf holding a fattened box; unbounded bodies (planes)
+// are few and are tested directly. The owner reports every add, remove and
+// teleport, and calls refit() after each step so moving bodies are reinserted
+// once they leave their fat boxes. Queries and the tree are always double;
+// bodies of a float world are widened as they are read.
+class SceneQuery {
+public:
+  void set_margin(double margin) { margin_ = margin; }
+  double get_margin() const { return margin_; }
+
+  template <typename T>
+  void add(const BodyStoreT<T>& bodies, uint32_t index);
+  // Mirrors BodyStore::remove: index was removed and the body previously at
+  // moved_from (if different) now lives at index.
+  void remove(uint32_t index, uint32_t moved_from);
+  template <typename T>
+  void update(const BodyStoreT<T>& bodies, uint32_t index);
+  // moved lists the bodies the step moved (Integrator::get_moved_bodies()).
+  template <typename T>
+  void refit(const BodyStoreT<T>& bodies, const uint32_t* moved, size_t moved_count, double delta_time);
+  void clear();
+
+  void save(util::CheckpointWriter& writer) const;
+  // body_count must match the bodies the saved state was built over.
+  bool load(const util::CheckpointReader& reader, size_t body_count);
+
+  const AABBTree& get_tree() const { return tree_; }
+
+  template <typename T>
+  void raycast(const BodyStoreT<T>& bodies, const std::vector<Ray>& rays, std::vector<QueryHit>& hits) const;
+  template <typename T>
+  void sweep_sphere(const BodyStoreT<T>& bodies, const std::vector<SphereSweep>& sweeps,
+                    std::vector<QueryHit>& hits) const;
+  template <typename T>
+  void overlap_sphere(const BodyStoreT<T>& bodies, const std::vector<Sphere>& spheres,
+                      OverlapResults& results) const;
+  template <typename T>
+  void overlap_aabb(const BodyStoreT<T>& bodies, const std::vector<AABB>& boxes, OverlapResults& results) const;
+
+private:
+  template <typename T>
+  QueryHit cast(const BodyStoreT<T>& bodies, const Vector3& origin, const Vector3& direction,
+                double radius, double max_distance) const;
+
+  double margin_ = 0.1;
+  AABBTree tree_;
+  std::vector<int32_t> proxies_;
+  std::vector<uint32_t> unbounded_;
+};
+
+// Tight world-space box around a bounded body's collision shape.
+template <typename T>
+AABB compute_aabb(const BodyStoreT<T>& bodies, uint32_t index);
+
+}
@@ -3,23 +3,20 @@
 
 namespace navora::scene {
 
-void SceneGraph::set_parent(const std::string& child_id, const std::string& parent_id) {
-  Entity* child = get_entity(child_id);
-  Entity* parent = get_entity(parent_id);
+void SceneGraph::set_parent(EntityHandle child_handle, EntityHandle parent_handle) {
+  Entity* child = get_entity(child_handle);
+  Entity* parent = get_entity(parent_handle);
   if (!child || !parent) return;
 
-  if (!child->parent_id.empty()) {
-    Entity* old_parent = get_entity(child->parent_id);
-    if (old_parent) {
-      old_parent->child_ids.erase(
-        std::remove(old_parent->child_ids.begin(), old_parent->child_ids.end(), child_id),
-        old_parent->child_ids.end()
-      );
-    }
+  if (Entity* old_parent = get_entity(child->parent)) {
+    old_parent->children.erase(
+      std::remove(old_parent->children.begin(), old_parent->children.end(), child_handle),
+      old_parent->children.end()
+    );
   }
 
-  child->parent_id = parent_id;
-  parent->child_ids.push_back(child_id);
+  child->parent = parent_handle;
+  parent->children.push_back(child_handle);
 }
 
 }
@@ -1,8 +1,8 @@
 #pragma once
 
+#include "../entity_handle.h"
 #include "../physics/rigid_body.h"
 #include <string>
-#include <unordered_map>
 #include <vector>
 #include <memory>
 #include <algorithm>
@@ -10,70 +10,64 @@
 namespace navora::scene {
 
 struct Entity {
+  EntityHandle handle;
   std::string id;
   physics::RigidBody body;
-  std::string parent_id;
-  std::vector<std::string> child_ids;
+  EntityHandle parent;
+  std::vector<EntityHandle> children;
 
-  Entity(const std::string& id) : id(id) {}
+  Entity(EntityHandle handle, const std::string& id) : handle(handle), id(id) {}
 };
 
+// Entities are keyed by the owning Simulator's handles and stored by handle
+// slot, so lookups never hash; id is the name used when exporting.
 class SceneGraph {
 public:
-  Entity* create_entity(const std::string& id) {
-    auto entity = std::make_unique<Entity>(id);
-    Entity* ptr = entity.get();
-    entities_[id] = std::move(entity);
-    return ptr;
+  Entity* create_entity(EntityHandle handle, const std::string& id) {
+    if (handle.index >= entities_.size()) entities_.resize(handle.index + 1);
+    entities_[handle.index] = std::make_unique<Entity>(handle, id);
+    return entities_[handle.index].get();
   }
 
-  void remove_entity(const std::string& id) {
-    auto it = entities_.find(id);
-    if (it != entities_.end()) {
-      Entity* entity = it->second.get();
-      if (!entity->parent_id.empty()) {
-        Entity* parent = get_entity(entity->parent_id);
-        if (parent) {
-          parent->child_ids.erase(
-            std::remove(parent->child_ids.begin(), parent->child_ids.end(), id),
-            parent->child_ids.end()
-          );
-        }
-      }
-      for (const auto& child_id : entity->child_ids) {
-        Entity* child = get_entity(child_id);
-        if (child) {
-          child->parent_id.clear();
-        }
+  void remove_entity(EntityHandle handle) {
+    Entity* entity = get_entity(handle);
+    if (!entity) return;
+    if (Entity* parent = get_entity(entity->parent)) {
+      parent->children.erase(std::remove(parent->children.begin(), parent->children.end(), handle),
+                             parent->children.end());
+    }
+    for (EntityHandle child_handle : entity->children) {
+      if (Entity* child = get_entity(child_handle)) {
+        child->parent = EntityHandle();
       }
-      entities_.erase(it);
     }
+    entities_[handle.index].reset();
   }
 
-  Entity* get_entity(const std::string& id) {
-    auto it = entities_.find(id);
-    return (it != entities_.end()) ? it->second.get() : nullptr;
+  Entity* get_entity(EntityHandle handle) {
+    return const_cast<Entity*>(static_cast<const SceneGraph*>(this)->get_entity(handle));
   }
 
-  const Entity* get_entity(const std::string& id) const {
-    auto it = entities_.find(id);
-    return (it != entities_.end()) ? it->second.get() : nullptr;
+  const Entity* get_entity(EntityHandle handle) const {
+    if (handle.index >= entities_.size()) return nullptr;
+    const Entity* entity = entities_[handle.index].get();
+    return (entity && entity->handle == handle) ? entity : nullptr;
   }
 
-  void set_parent(const std::string& child_id, const std::string& parent_id);
+  void set_parent(EntityHandle child_handle, EntityHandle parent_handle);
 
   std::vector<Entity*> get_all_entities() {
     std::vector<Entity*> result;
-    for (auto& [id, entity] : entities_) {
-      result.push_back(entity.get());
+    for (auto& entity : entities_) {
+      if (entity) result.push_back(entity.get());
     }
     return result;
   }
 
   std::vector<const Entity*> get_all_entities() const {
     std::vector<const Entity*> result;
-    for (const auto& [id, entity] : entities_) {
-      result.push_back(entity.get());
+    for (const auto& entity : entities_) {
+      if (entity) result.push_back(entity.get());
     }
     return result;
   }
@@ -83,7 +77,7 @@ public:
   }
 
 private:
-  std::unordered_map<std::string, std::unique_ptr<Entity>> entities_;
+  std::vector<std::unique_ptr<Entity>> entities_;
 };
 
 }
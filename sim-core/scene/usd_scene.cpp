@@ -1,7 +1,10 @@
 #include "usd_scene.h"
+#include "../usd/usd_export.h"
 #include <pxr/base/gf/vec3d.h>
 #include <pxr/base/gf/quatd.h>
-#include <pxr/usd/usdGeom/xformCommonAPI.h>
+#include <pxr/base/gf/vec3f.h>
+#include <pxr/usd/sdf/changeBlock.h>
+#include <pxr/usd/usdGeom/cube.h>
 #include <pxr/usd/usdPhysics/massAPI.h>
 
 namespace navora::scene {
@@ -24,81 +27,131 @@ std::string USDScene::path_to_entity_id(const std::string& path) const {
   return "";
 }
 
-bool USDScene::create_entity(const std::string& id, const physics::RigidBody& body) {
-  std::string path_str = entity_id_to_path(id);
-  pxr::SdfPath path(path_str);
+const USDScene::EntitySlot* USDScene::find_slot(EntityHandle handle) const {
+  if (handle.index >= entities_.size()) return nullptr;
+  const EntitySlot& slot = entities_[handle.index];
+  return (!handle.is_null() && slot.handle == handle) ? &slot : nullptr;
+}
+
+pxr::SdfPath USDScene::get_entity_path(EntityHandle handle) const {
+  const EntitySlot* slot = find_slot(handle);
+  return slot ? slot->path : pxr::SdfPath();
+}
+
+EntityHandle USDScene::find_entity(const pxr::SdfPath& path) const {
+  auto it = path_to_entity_.find(path);
+  return (it != path_to_entity_.end()) ? it->second : EntityHandle();
+}
+
+bool USDScene::create_entity(EntityHandle handle, const std::string& name, const physics::RigidBody& body) {
+  pxr::SdfPath path(entity_id_to_path(name));
 
-  if (entity_to_path_.find(id) != entity_to_path_.end()) {
+  if (find_slot(handle) || path_to_entity_.find(path) != path_to_entity_.end()) {
     return false;
   }
 
-  auto xform = create_xform_prim(path_str, body.transform);
-  if (!xform) {
+  EntitySlot slot;
+  slot.handle = handle;
+  slot.path = path;
+  define_entity_prim(slot);
+  if (!slot.translate) {
     return false;
   }
+  write_motion(slot, body);
+  write_properties(slot, body);
+  create_collision_shape(stage_->GetPrimAtPath(path), body.shape);
 
-  pxr::UsdPrim prim = xform.GetPrim();
-  apply_physics_schema(prim, body);
-  create_collision_shape(prim, body.shape);
-
-  entity_to_path_[id] = path;
-  path_to_entity_[path] = id;
+  if (handle.index >= entities_.size()) entities_.resize(handle.index + 1);
+  entities_[handle.index] = std::move(slot);
+  path_to_entity_[path] = handle;
   return true;
 }
 
-bool USDScene::remove_entity(const std::string& id) {
-  auto it = entity_to_path_.find(id);
-  if (it == entity_to_path_.end()) {
+bool USDScene::remove_entity(EntityHandle handle) {
+  const EntitySlot* slot = find_slot(handle);
+  if (!slot) {
     return false;
   }
 
-  pxr::SdfPath path = it->second;
+  pxr::SdfPath path = slot->path;
   stage_->RemovePrim(path);
-  entity_to_path_.erase(it);
   path_to_entity_.erase(path);
+  entities_[handle.index] = EntitySlot();
   return true;
 }
 
-bool USDScene::update_entity(const std::string& id, const physics::RigidBody& body) {
-  auto it = entity_to_path_.find(id);
-  if (it == entity_to_path_.end()) {
+void USDScene::adopt(const pxr::UsdStageRefPtr& source) {
+  entities_.clear();
+  path_to_entity_.clear();
+  dirty_.clear();
+  stage_->GetRootLayer()->TransferContent(source->Flatten());
+}
+
+bool USDScene::bind_entity(EntityHandle handle, const pxr::SdfPath& path, const physics::RigidBody& body) {
+  if (find_slot(handle) || path_to_entity_.find(path) != path_to_entity_.end()) {
     return false;
   }
-
-  pxr::SdfPath path = it->second;
-  auto prim = stage_->GetPrimAtPath(path);
-  if (!prim.IsValid()) {
+  pxr::UsdGeomXform xform(stage_->GetPrimAtPath(path));
+  if (!xform) {
     return false;
   }
 
-  auto xform = pxr::UsdGeomXform(prim);
-  update_xform_prim(xform, body.transform);
-  apply_physics_schema(prim, body);
+  EntitySlot slot;
+  slot.handle = handle;
+  slot.path = path;
+  if (bind_prim(slot, xform)) {
+    write_motion(slot, body);
+  }
+
+  if (handle.index >= entities_.size()) entities_.resize(handle.index + 1);
+  entities_[handle.index] = std::move(slot);
+  path_to_entity_[path] = handle;
   return true;
 }
 
-bool USDScene::get_entity(const std::string& id, physics::RigidBody& body) const {
-  auto it = entity_to_path_.find(id);
-  if (it == entity_to_path_.end()) {
+bool USDScene::update_entity(EntityHandle handle, const physics::RigidBody& body) {
+  if (!find_slot(handle)) {
     return false;
   }
+  EntitySlot& slot = entities_[handle.index];
+  write_motion(slot, body);
+  write_properties(slot, body);
+  slot.dirty = DIRTY_NONE;
+  return true;
+}
 
-  pxr::SdfPath path = it->second;
-  auto prim = stage_->GetPrimAtPath(path);
-  if (!prim.IsValid()) {
-    return false;
+size_t USDScene::flush(const BodySource& source) {
+  size_t written = 0;
+  physics::RigidBody body;
+  {
+    pxr::SdfChangeBlock block;
+    for (uint32_t index : dirty_) {
+      EntitySlot& slot = entities_[index];
+      const uint8_t flags = slot.dirty;
+      if (flags == DIRTY_NONE) continue;
+      slot.dirty = DIRTY_NONE;
+      if (!source(slot.handle, body)) continue;
+      if (flags & DIRTY_MOTION) write_motion(slot, body);
+      if (flags & DIRTY_PROPERTIES) write_properties(slot, body);
+      written++;
+    }
   }
+  dirty_.clear();
+  return written;
+}
 
-  auto xform = pxr::UsdGeomXform(prim);
-  pxr::GfMatrix4d local_xform;
-  bool reset_xform_stack;
-  xform.GetLocalTransformation(&local_xform, &reset_xform_stack);
+bool USDScene::get_entity(EntityHandle handle, physics::RigidBody& body) const {
+  const EntitySlot* slot = find_slot(handle);
+  if (!slot) {
+    return false;
+  }
 
-  pxr::GfVec3d translation;
-  pxr::GfQuatd rotation;
-  pxr::GfVec3d scale;
-  pxr::UsdGeomXformCommonAPI::GetRotationOrderValue(pxr::UsdGeomXformCommonAPI::RotationOrderXYZ);
-  local_xform.Factor(&translation, &rotation, &scale, nullptr);
+  pxr::GfVec3d translation(0.0);
+  pxr::GfQuatd rotation(1.0);
+  pxr::GfVec3d scale(1.0);
+  slot->translate.Get(&translation);
+  slot->orient.Get(&rotation);
+  slot->scale.Get(&scale);
 
   body.transform.position.x = translation[0];
   body.transform.position.y = translation[1];
@@ -111,119 +164,132 @@ bool USDScene::get_entity(const std::string& id, physics::RigidBody& body) const
   body.transform.scale.y = scale[1];
   body.transform.scale.z = scale[2];
 
-  auto rigid_body_api = pxr::UsdPhysicsRigidBodyAPI(prim);
-  if (rigid_body_api) {
-    pxr::GfVec3f linear_velocity;
-    if (rigid_body_api.GetVelocityAttr().Get(&linear_velocity)) {
-      body.linear_velocity.x = linear_velocity[0];
-      body.linear_velocity.y = linear_velocity[1];
-      body.linear_velocity.z = linear_velocity[2];
-    }
+  pxr::GfVec3f linear_velocity;
+  if (slot->linear_velocity.Get(&linear_velocity)) {
+    body.linear_velocity.x = linear_velocity[0];
+    body.linear_velocity.y = linear_velocity[1];
+    body.linear_velocity.z = linear_velocity[2];
+  }
 
-    pxr::GfVec3f angular_velocity;
-    if (rigid_body_api.GetAngularVelocityAttr().Get(&angular_velocity)) {
-      body.angular_velocity.x = angular_velocity[0];
-      body.angular_velocity.y = angular_velocity[1];
-      body.angular_velocity.z = angular_velocity[2];
-    }
+  pxr::GfVec3f angular_velocity;
+  if (slot->angular_velocity.Get(&angular_velocity)) {
+    body.angular_velocity.x = angular_velocity[0];
+    body.angular_velocity.y = angular_velocity[1];
+    body.angular_velocity.z = angular_velocity[2];
   }
 
-  auto mass_api = pxr::UsdPhysicsMassAPI(prim);
-  if (mass_api) {
-    double mass = 1.0;
-    if (mass_api.GetMassAttr().Get(&mass)) {
-      body.mass = mass;
-      body.inv_mass = (mass > 0.0) ? 1.0 / mass : 0.0;
-    }
+  float mass = 1.0f;
+  if (slot->mass.Get(&mass)) {
+    body.mass = mass;
+    body.inv_mass = (mass > 0.0f) ? 1.0 / mass : 0.0;
   }
 
-  auto collision_api = pxr::UsdPhysicsCollisionAPI(prim);
-  if (collision_api) {
-    bool collision_enabled = true;
-    if (collision_api.GetCollisionEnabledAttr().Get(&collision_enabled)) {
-      body.is_static = !collision_enabled;
-    }
+  bool collision_enabled = true;
+  if (slot->collision_enabled.Get(&collision_enabled)) {
+    body.is_static = !collision_enabled;
   }
 
   return true;
 }
 
-std::vector<std::string> USDScene::get_all_entity_ids() const {
-  std::vector<std::string> result;
-  for (const auto& [id, path] : entity_to_path_) {
-    result.push_back(id);
+std::vector<EntityHandle> USDScene::get_all_entities() const {
+  std::vector<EntityHandle> result;
+  for (const EntitySlot& slot : entities_) {
+    if (!slot.handle.is_null()) result.push_back(slot.handle);
   }
   return result;
 }
 
 void USDScene::clear() {
-  for (const auto& [id, path] : entity_to_path_) {
-    stage_->RemovePrim(path);
+  for (const EntitySlot& slot : entities_) {
+    if (!slot.handle.is_null()) stage_->RemovePrim(slot.path);
   }
-  entity_to_path_.clear();
+  entities_.clear();
   path_to_entity_.clear();
+  dirty_.clear();
 }
 
-pxr::UsdGeomXform USDScene::create_xform_prim(const std::string& path, const physics::Transform& transform) {
-  pxr::SdfPath sdf_path(path);
-  auto xform = pxr::UsdGeomXform::Define(stage_, sdf_path);
+// Authors the prim, its xform op stack (translate, orient, scale in double
+// precision) and the physics schemas, and caches the attributes that later
+// writes touch.
+void USDScene::define_entity_prim(EntitySlot& slot) {
+  auto xform = pxr::UsdGeomXform::Define(stage_, slot.path);
+  if (!xform) {
+    return;
+  }
+  bind_prim(slot, xform);
+}
 
-  pxr::GfVec3d translation(transform.position.x, transform.position.y, transform.position.z);
-  pxr::GfQuatd rotation(transform.rotation.w, transform.rotation.x, transform.rotation.y, transform.rotation.z);
-  pxr::GfVec3d scale(transform.scale.x, transform.scale.y, transform.scale.z);
+bool USDScene::bind_prim(EntitySlot& slot, pxr::UsdGeomXform xform) {
+  pxr::UsdPrim prim = xform.GetPrim();
 
-  auto xform_api = pxr::UsdGeomXformCommonAPI(xform);
-  xform_api.SetTranslate(translation);
-  xform_api.SetRotate(rotation);
-  xform_api.SetScale(scale);
+  bool reset_stack = false;
+  std::vector<pxr::UsdGeomXformOp> ops = xform.GetOrderedXformOps(&reset_stack);
+  const bool has_stack = ops.size() == 3 && ops[0].GetOpType() == pxr::UsdGeomXformOp::TypeTranslate &&
+                         ops[1].GetOpType() == pxr::UsdGeomXformOp::TypeOrient &&
+                         ops[2].GetOpType() == pxr::UsdGeomXformOp::TypeScale &&
+                         ops[0].GetPrecision() == pxr::UsdGeomXformOp::PrecisionDouble &&
+                         ops[1].GetPrecision() == pxr::UsdGeomXformOp::PrecisionDouble &&
+                         ops[2].GetPrecision() == pxr::UsdGeomXformOp::PrecisionDouble;
+  if (has_stack) {
+    slot.translate = ops[0];
+    slot.orient = ops[1];
+    slot.scale = ops[2];
+  } else {
+    xform.ClearXformOpOrder();
+    slot.translate = xform.AddTranslateOp(pxr::UsdGeomXformOp::PrecisionDouble);
+    slot.orient = xform.AddOrientOp(pxr::UsdGeomXformOp::PrecisionDouble);
+    slot.scale = xform.AddScaleOp(pxr::UsdGeomXformOp::PrecisionDouble);
+  }
 
-  return xform;
-}
+  auto rigid_body_api = prim.HasAPI<pxr::UsdPhysicsRigidBodyAPI>() ? pxr::UsdPhysicsRigidBodyAPI(prim)
+                                                                   : pxr::UsdPhysicsRigidBodyAPI::Apply(prim);
+  slot.linear_velocity = rigid_body_api.CreateVelocityAttr();
+  slot.angular_velocity = rigid_body_api.CreateAngularVelocityAttr();
 
-void USDScene::update_xform_prim(pxr::UsdGeomXform xform, const physics::Transform& transform) {
-  pxr::GfVec3d translation(transform.position.x, transform.position.y, transform.position.z);
-  pxr::GfQuatd rotation(transform.rotation.w, transform.rotation.x, transform.rotation.y, transform.rotation.z);
-  pxr::GfVec3d scale(transform.scale.x, transform.scale.y, transform.scale.z);
+  auto mass_api = prim.HasAPI<pxr::UsdPhysicsMassAPI>() ? pxr::UsdPhysicsMassAPI(prim)
+                                                        : pxr::UsdPhysicsMassAPI::Apply(prim);
+  slot.mass = mass_api.CreateMassAttr();
 
-  auto xform_api = pxr::UsdGeomXformCommonAPI(xform);
-  xform_api.SetTranslate(translation);
-  xform_api.SetRotate(rotation);
-  xform_api.SetScale(scale);
+  auto collision_api = prim.HasAPI<pxr::UsdPhysicsCollisionAPI>() ? pxr::UsdPhysicsCollisionAPI(prim)
+                                                                  : pxr::UsdPhysicsCollisionAPI::Apply(prim);
+  slot.collision_enabled = collision_api.CreateCollisionEnabledAttr();
+  return !has_stack;
 }
 
-void USDScene::apply_physics_schema(pxr::UsdPrim prim, const physics::RigidBody& body) {
-  auto rigid_body_api = pxr::UsdPhysicsRigidBodyAPI::Apply(prim);
-  if (rigid_body_api) {
-    pxr::GfVec3f linear_velocity(body.linear_velocity.x, body.linear_velocity.y, body.linear_velocity.z);
-    rigid_body_api.GetVelocityAttr().Set(linear_velocity);
-
-    pxr::GfVec3f angular_velocity(body.angular_velocity.x, body.angular_velocity.y, body.angular_velocity.z);
-    rigid_body_api.GetAngularVelocityAttr().Set(angular_velocity);
-  }
-
-  auto mass_api = pxr::UsdPhysicsMassAPI::Apply(prim);
-  if (mass_api) {
-    mass_api.GetMassAttr().Set(body.mass);
-  }
+void USDScene::write_motion(EntitySlot& slot, const physics::RigidBody& body) {
+  const physics::Transform& transform = body.transform;
+  slot.translate.Set(pxr::GfVec3d(transform.position.x, transform.position.y, transform.position.z));
+  slot.orient.Set(pxr::GfQuatd(transform.rotation.w, transform.rotation.x, transform.rotation.y, transform.rotation.z));
+  slot.scale.Set(pxr::GfVec3d(transform.scale.x, transform.scale.y, transform.scale.z));
+  slot.linear_velocity.Set(pxr::GfVec3f(body.linear_velocity.x, body.linear_velocity.y, body.linear_velocity.z));
+  slot.angular_velocity.Set(pxr::GfVec3f(body.angular_velocity.x, body.angular_velocity.y, body.angular_velocity.z));
+}
 
-  auto collision_api = pxr::UsdPhysicsCollisionAPI::Apply(prim);
-  if (collision_api) {
-    collision_api.GetCollisionEnabledAttr().Set(!body.is_static);
-  }
+void USDScene::write_properties(EntitySlot& slot, const physics::RigidBody& body) {
+  slot.mass.Set(static_cast<float>(body.mass));
+  slot.collision_enabled.Set(!body.is_static);
 }
 
 void USDScene::create_collision_shape(pxr::UsdPrim parent, const physics::CollisionShape& shape) {
+  const pxr::SdfPath path = parent.GetPath().AppendChild(pxr::TfToken("Shape"));
   if (shape.type == physics::ShapeType::SPHERE) {
-    auto sphere = pxr::UsdGeomSphere::Define(stage_, parent.GetPath().AppendChild(pxr::TfToken("Shape")));
-    sphere.GetRadiusAttr().Set(shape.size.x);
+    auto sphere = pxr::UsdGeomSphere::Define(stage_, path);
+    sphere.GetRadiusAttr().Set(static_cast<double>(shape.size.x));
+  } else if (shape.type == physics::ShapeType::AABB) {
+    // A unit cube scaled to the full extents, as in USDExporter.
+    auto cube = pxr::UsdGeomCube::Define(stage_, path);
+    cube.GetSizeAttr().Set(1.0);
+    cube.AddScaleOp(pxr::UsdGeomXformOp::PrecisionDouble)
+        .Set(pxr::GfVec3d(2.0 * shape.size.x, 2.0 * shape.size.y, 2.0 * shape.size.z));
   } else if (shape.type == physics::ShapeType::PLANE) {
-    auto mesh = pxr::UsdGeomMesh::Define(stage_, parent.GetPath().AppendChild(pxr::TfToken("Shape")));
-    pxr::VtVec3fArray points = {
-      pxr::GfVec3f(-100, 0, -100),
-      pxr::GfVec3f(100, 0, -100),
-      pxr::GfVec3f(100, 0, 100),
-      pxr::GfVec3f(-100, 0, 100)
-    };
+    auto mesh = pxr::UsdGeomMesh::Define(stage_, path);
+    physics::Vector3 corners[4];
+    usd::plane_quad(shape, corners);
+    pxr::VtVec3fArray points(4);
+    for (int k = 0; k < 4; ++k) {
+      points[k] = pxr::GfVec3f(corners[k].x, corners[k].y, corners[k].z);
+    }
     pxr::VtIntArray face_vertex_counts = {4};
     pxr::VtIntArray face_vertex_indices = {0, 1, 2, 3};
     mesh.GetPointsAttr().Set(points);
@@ -233,4 +299,3 @@ void USDScene::create_collision_shape(pxr::UsdPrim parent, const physics::Collis
 }
 
 }
-
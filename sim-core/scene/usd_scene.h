@@ -1,12 +1,16 @@
 #pragma once
 
+#include "../entity_handle.h"
 #include "../physics/rigid_body.h"
 #include <pxr/usd/usd/stage.h>
 #include <pxr/usd/usdGeom/xform.h>
+#include <pxr/usd/usdGeom/xformOp.h>
 #include <pxr/usd/usdGeom/sphere.h>
 #include <pxr/usd/usdGeom/mesh.h>
 #include <pxr/usd/usdPhysics/rigidBodyAPI.h>
 #include <pxr/usd/usdPhysics/collisionAPI.h>
+#include <cstdint>
+#include <functional>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -16,32 +20,95 @@ PXR_NAMESPACE_USING_DIRECTIVE
 
 namespace navora::scene {
 
+// Write-behind mirror of the simulation. The Simulator's body store is
+// authoritative; the stage is only written by flush(), for entities marked
+// dirty since the last one. Schemas are applied and xform ops are added once,
+// at creation, and flush() sets the cached attributes directly.
 class USDScene {
 public:
+  // What changed on an entity since the last flush.
+  enum DirtyFlags : uint8_t {
+    DIRTY_NONE = 0,
+    // Transform and velocities.
+    DIRTY_MOTION = 1 << 0,
+    // Mass and collision flag.
+    DIRTY_PROPERTIES = 1 << 1
+  };
+
+  // Supplies the current state of a dirty entity; false skips it.
+  using BodySource = std::function<bool(EntityHandle, physics::RigidBody&)>;
+
   USDScene();
   ~USDScene() = default;
 
   pxr::UsdStageRefPtr get_stage() const { return stage_; }
 
-  bool create_entity(const std::string& id, const physics::RigidBody& body);
-  bool remove_entity(const std::string& id);
-  bool update_entity(const std::string& id, const physics::RigidBody& body);
-  bool get_entity(const std::string& id, physics::RigidBody& body) const;
+  // Entities are keyed by the Simulator's handles; name is only used once, to
+  // build the prim path /World/Entities/<name>.
+  bool create_entity(EntityHandle handle, const std::string& name, const physics::RigidBody& body);
+  bool remove_entity(EntityHandle handle);
+
+  // Bulk loading: adopt() replaces the stage's contents with a flattened copy
+  // of source in one layer transfer, then bind_entity() registers each
+  // existing prim under a handle. Binding only authors what the prim lacks
+  // (the translate/orient/scale op stack, physics schemas), writing body into
+  // it when the op stack had to be rebuilt.
+  void adopt(const pxr::UsdStageRefPtr& source);
+  bool bind_entity(EntityHandle handle, const pxr::SdfPath& path, const physics::RigidBody& body);
+  // Writes every attribute now, bypassing the dirty set.
+  bool update_entity(EntityHandle handle, const physics::RigidBody& body);
+  bool get_entity(EntityHandle handle, physics::RigidBody& body) const;
+
+  void mark_dirty(EntityHandle handle, uint8_t flags = DIRTY_MOTION) {
+    if (handle.index >= entities_.size()) return;
+    EntitySlot& slot = entities_[handle.index];
+    if (handle.is_null() || slot.handle != handle) return;
+    if (slot.dirty == DIRTY_NONE) dirty_.push_back(handle.index);
+    slot.dirty |= flags;
+  }
+  size_t get_dirty_count() const { return dirty_.size(); }
+  // Writes the dirty entities inside one change block; returns how many.
+  size_t flush(const BodySource& source);
 
-  std::vector<std::string> get_all_entity_ids() const;
+  std::vector<EntityHandle> get_all_entities() const;
   void clear();
 
+  // Prim path of a live entity, or an empty path.
+  pxr::SdfPath get_entity_path(EntityHandle handle) const;
+  EntityHandle find_entity(const pxr::SdfPath& path) const;
+
   std::string entity_id_to_path(const std::string& id) const;
   std::string path_to_entity_id(const std::string& path) const;
 
 private:
+  struct EntitySlot {
+    EntityHandle handle;
+    pxr::SdfPath path;
+    uint8_t dirty = DIRTY_NONE;
+    pxr::UsdGeomXformOp translate;
+    pxr::UsdGeomXformOp orient;
+    pxr::UsdGeomXformOp scale;
+    pxr::UsdAttribute linear_velocity;
+    pxr::UsdAttribute angular_velocity;
+    pxr::UsdAttribute mass;
+    pxr::UsdAttribute collision_enabled;
+  };
+
+  const EntitySlot* find_slot(EntityHandle handle) const;
+
   pxr::UsdStageRefPtr stage_;
-  std::unordered_map<std::string, pxr::SdfPath> entity_to_path_;
-  std::unordered_map<pxr::SdfPath, std::string> path_to_entity_;
+  // Indexed by handle slot.
+  std::vector<EntitySlot> entities_;
+  std::unordered_map<pxr::SdfPath, EntityHandle, pxr::SdfPath::Hash> path_to_entity_;
+  // Slot indices with a non-zero dirty mask; may hold stale entries for
+  // removed entities, which flush() skips.
+  std::vector<uint32_t> dirty_;
 
-  pxr::UsdGeomXform create_xform_prim(const std::string& path, const physics::Transform& transform);
-  void update_xform_prim(pxr::UsdGeomXform xform, const physics::Transform& transform);
-  void apply_physics_schema(pxr::UsdPrim prim, const physics::RigidBody& body);
+  void define_entity_prim(EntitySlot& slot);
+  // Caches the prim's attributes; true if its op stack had to be rebuilt.
+  bool bind_prim(EntitySlot& slot, pxr::UsdGeomXform xform);
+  void write_motion(EntitySlot& slot, const physics::RigidBody& body);
+  void write_properties(EntitySlot& slot, const physics::RigidBody& body);
   void create_collision_shape(pxr::UsdPrim parent, const physics::CollisionShape& shape);
 };
 
@@ -0,0 +1,960 @@
+#include "simulator.h"
+#include "simulation_batch.h"
+#include "physics/rigid_body.h"
+#include "util/packed_transform.h"
+#include "util/tick_scheduler.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// sim_checks: self-checks for behavior the runner cannot show by printing.
+// Prints each failed check and exits non-zero if any failed.
+
+// Every heap allocation in the process, so a check can see what a frame
+// allocates beyond the frame arena's own count.
+static std::atomic<uint64_t> heap_allocations{0};
+
+void* operator new(std::size_t size) {
+  heap_allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* p = std::malloc(size ? size : 1)) return p;
+  throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+  heap_allocations.fetch_add(1, std::memory_order_relaxed);
+  const std::size_t align = static_cast<std::size_t>(alignment);
+  if (void* p = std::aligned_alloc(align, (size + align - 1) / align * align)) return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+
+namespace {
+
+using navora::Simulator;
+using navora::SimulatorT;
+using navora::physics::RigidBody;
+using navora::physics::ShapeType;
+using navora::physics::Vector3;
+
+bool check(bool condition, const std::string& what) {
+  if (!condition) std::cerr << "FAILED: " << what << "\n";
+  return condition;
+}
+
+// A floor, a pile of spheres and boxes, some unnamed, with entities removed
+// so the entity table has free slots and bodies were swap-removed. Stepped
+// until part of it sleeps and the solver's warm-start cache is full.
+template <typename T>
+void build_world(SimulatorT<T>& sim) {
+  using Body = typename SimulatorT<T>::RigidBody;
+  using Vec = typename SimulatorT<T>::Vector3;
+  Body floor;
+  floor.is_static = true;
+  floor.shape.type = ShapeType::PLANE;
+  floor.shape.normal = Vec(0, 1, 0);
+  sim.create_entity("floor", floor);
+
+  for (int i = 0; i < 240; ++i) {
+    Body body;
+    body.mass = 1.0;
+    body.inv_mass = 1.0;
+    body.shape.type = (i % 3 == 0) ? ShapeType::AABB : ShapeType::SPHERE;
+    body.shape.size = Vec(0.5, 0.5, 0.5);
+    body.transform.position = Vec((i % 6) * 1.1, 0.6 + (i / 36) * 1.2, ((i / 6) % 6) * 1.1);
+    body.linear_velocity = Vec(0.1 * (i % 5), 0, -0.1 * (i % 7));
+    if (i % 4 == 0) {
+      sim.create_entity(body);
+    } else {
+      sim.create_entity("body_" + std::to_string(i), body);
+    }
+  }
+  sim.start();
+  for (int tick = 0; tick < 90; ++tick) {
+    sim.tick();
+    if (tick % 30 == 0) {
+      sim.remove_entity("body_" + std::to_string(tick + 1));
+      sim.remove_entity(sim.get_entity_handle(7 + tick));
+    }
+  }
+}
+
+template <typename T>
+bool same_bits(const std::vector<T>& a, const std::vector<T>& b) {
+  return a.size() == b.size() && (a.empty() || std::memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0);
+}
+
+template <typename T>
+bool same_world(const SimulatorT<T>& a, const SimulatorT<T>& b) {
+  const auto& x = a.get_bodies();
+  const auto& y = b.get_bodies();
+  std::vector<navora::physics::Ray> rays;
+  for (int i = 0; i < 16; ++i) {
+    rays.push_back({Vector3(i * 0.4, 20, 2.5), Vector3(0, -1, 0.05 * i)});
+  }
+  std::vector<navora::physics::QueryHit> hits_a;
+  std::vector<navora::physics::QueryHit> hits_b;
+  a.raycast(rays, hits_a);
+  b.raycast(rays, hits_b);
+  bool same_hits = hits_a.size() == hits_b.size();
+  for (size_t i = 0; same_hits && i < hits_a.size(); ++i) {
+    same_hits = hits_a[i].hit == hits_b[i].hit && hits_a[i].body == hits_b[i].body &&
+                std::memcmp(&hits_a[i].distance, &hits_b[i].distance, sizeof(double)) == 0;
+  }
+  return a.get_tick() == b.get_tick() && a.get_sim_time() == b.get_sim_time() && same_bits(x.position, y.position) &&
+         same_bits(x.rotation, y.rotation) && same_bits(x.linear_velocity, y.linear_velocity) &&
+         same_bits(x.angular_velocity, y.angular_velocity) && same_bits(x.flags, y.flags) &&
+         same_bits(x.sleep_next, y.sleep_next) && a.get_all_entity_handles() == b.get_all_entity_handles() &&
+         a.get_all_entity_ids() == b.get_all_entity_ids() && same_hits;
+}
+
+// Address of a 32-bit field of one record in a section of image, or null.
+char* field(std::vector<char>& image, uint32_t tag, size_t record, size_t field_offset) {
+  navora::util::CheckpointHeader header;
+  std::memcpy(&header, image.data(), sizeof(header));
+  for (uint32_t s = 0; s < header.section_count; ++s) {
+    navora::util::CheckpointSectionEntry entry;
+    std::memcpy(&entry, image.data() + sizeof(header) + s * sizeof(entry), sizeof(entry));
+    if (entry.tag != tag) continue;
+    if (record >= entry.count) return nullptr;
+    return image.data() + entry.offset + record * entry.element_size + field_offset;
+  }
+  return nullptr;
+}
+
+bool poke(std::vector<char>& image, uint32_t tag, size_t record, size_t field_offset, uint32_t value) {
+  char* p = field(image, tag, record, field_offset);
+  if (p) std::memcpy(p, &value, sizeof(value));
+  return p != nullptr;
+}
+
+bool checkpoint_round_trip() {
+  Simulator original;
+  build_world(original);
+  std::vector<char> image;
+  original.save_checkpoint(image);
+
+  Simulator restored;
+  restored.start();
+  bool ok = check(restored.load_checkpoint(image.data(), image.size()), "checkpoint loads");
+  ok = ok && check(same_world(original, restored), "restored world matches the saved one");
+  // Names are indexed lazily after a restore; creating, renaming into and
+  // removing by name must all see the restored names.
+  RigidBody extra;
+  extra.transform.position = Vector3(-5, 0.5, -5);
+  ok = check(!restored.create_entity("body_2", extra) && restored.find_entity("body_2") == original.find_entity("body_2"),
+             "restored names are taken") && ok;
+  ok = check(restored.create_entity("late", extra) == original.create_entity("late", extra),
+             "a new name after a restore gets the same handle as in the saved world") && ok;
+  for (int tick = 0; ok && tick < 240; ++tick) {
+    original.tick();
+    restored.tick();
+    if (tick == 60) {
+      original.remove_entity("body_100");
+      restored.remove_entity("body_100");
+    }
+    ok = check(same_world(original, restored), "restored world steps bit-identically (tick " +
+                                                   std::to_string(tick) + ")");
+  }
+  return ok;
+}
+
+bool checkpoint_rejects_corruption() {
+  Simulator original;
+  build_world(original);
+  std::vector<char> image;
+  original.save_checkpoint(image);
+
+  // A rejected image must leave a live world as it was; twin tracks what it
+  // should hold.
+  Simulator target;
+  Simulator twin;
+  for (Simulator* sim : {&target, &twin}) {
+    build_world(*sim);
+    sim->create_entity("extra", RigidBody());
+    for (int tick = 0; tick < 30; ++tick) sim->tick();
+  }
+  auto rejects = [&](const std::vector<char>& bad, size_t size, const std::string& what) {
+    return check(!target.load_checkpoint(bad.data(), size), "rejects " + what) &&
+           check(same_world(target, twin), "rejecting " + what + " leaves the world unchanged");
+  };
+
+  bool ok = true;
+  for (size_t size = 0; ok && size < image.size(); size += 61) {
+    ok = rejects(image, size, "checkpoint truncated to " + std::to_string(size) + " bytes");
+  }
+  std::vector<char> flipped = image;
+  flipped[64] ^= 0xff;
+  ok = rejects(flipped, flipped.size(), "a flipped section count") && ok;
+
+  namespace util = navora::util;
+  const uint32_t body_count = static_cast<uint32_t>(original.get_entity_count());
+  const uint32_t node_count = static_cast<uint32_t>(2 * body_count);
+  const uint32_t live_slot = original.get_entity_handle(5).index;
+  // build_world removed body_1, so its slot is on the free list.
+  const uint32_t free_slot = 2;
+  // Tree nodes are an AABB followed by parent, left, right, height and user
+  // data; the root is an inner node of this pile.
+  uint32_t root = 0;
+  std::memcpy(&root, field(image, util::CHECKPOINT_QUERY_TREE, 0, 0), sizeof(root));
+  const struct {
+    const char* what;
+    uint32_t tag;
+    size_t record;
+    size_t field_offset;
+    uint32_t value;
+  } corruptions[] = {
+      {"sleep_next out of range", util::CHECKPOINT_BODY_SLEEP_NEXT, 3, 0, body_count},
+      {"sleep ring not closed", util::CHECKPOINT_BODY_SLEEP_NEXT, 3, 0, 4},
+      {"shape type unknown", util::CHECKPOINT_BODY_SHAPE, 5, 0, 7},
+      {"entity slot points past the bodies", util::CHECKPOINT_ENTITY_SLOTS, live_slot, 4, body_count},
+      {"entity slots alias one body", util::CHECKPOINT_ENTITY_SLOTS, live_slot, 4, 3},
+      {"entity free list loops", util::CHECKPOINT_ENTITY_SLOTS, free_slot, 4, free_slot},
+      {"proxy out of range", util::CHECKPOINT_QUERY_PROXIES, 4, 0, node_count * 4},
+      {"proxy not a leaf of its body", util::CHECKPOINT_QUERY_PROXIES, 4, 0, 0},
+      {"unbounded body out of range", util::CHECKPOINT_QUERY_UNBOUNDED, 0, 0, body_count},
+      {"tree root has a parent", util::CHECKPOINT_QUERY_TREE_NODES, root, 48, 0},
+      {"tree node child out of range", util::CHECKPOINT_QUERY_TREE_NODES, root, 52, node_count * 4},
+      {"tree nodes form a cycle", util::CHECKPOINT_QUERY_TREE_NODES, root, 56, root},
+      {"tree root out of range", util::CHECKPOINT_QUERY_TREE, 0, 0, node_count * 4},
+      {"solver pair out of range", util::CHECKPOINT_SOLVER_CACHE, 0, 0, body_count},
+  };
+  for (const auto& corruption : corruptions) {
+    std::vector<char> bad = image;
+    ok = check(poke(bad, corruption.tag, corruption.record, corruption.field_offset, corruption.value),
+               std::string("corrupt ") + corruption.what) &&
+         rejects(bad, bad.size(), corruption.what) && ok;
+  }
+  for (int tick = 0; ok && tick < 60; ++tick) {
+    target.tick();
+    twin.tick();
+    ok = check(same_world(target, twin), "world steps on unchanged after rejections (tick " + std::to_string(tick) + ")");
+  }
+  ok = check(target.load_checkpoint(image.data(), image.size()) && same_world(target, original),
+             "intact checkpoint loads after rejections") && ok;
+  return ok;
+}
+
+// Bodies far larger or faster than the pile, which the spatial hash keeps out
+// of its grid.
+void add_outliers(Simulator& sim) {
+  RigidBody slab;
+  slab.is_static = true;
+  slab.mass = 0.0;
+  slab.inv_mass = 0.0;
+  slab.shape.type = ShapeType::AABB;
+  slab.shape.size = Vector3(200, 1, 200);
+  slab.transform.position = Vector3(0, -0.9, 0);
+  sim.create_entity("slab", slab);
+
+  RigidBody bullet;
+  bullet.mass = 1.0;
+  bullet.inv_mass = 1.0;
+  bullet.shape.size = Vector3(0.2, 0.2, 0.2);
+  bullet.transform.position = Vector3(-60, 1.5, 2.5);
+  bullet.linear_velocity = Vector3(3000, 0, 0);
+  sim.create_entity("bullet", bullet);
+
+  RigidBody boulder;
+  boulder.mass = 50.0;
+  boulder.inv_mass = 1.0 / 50.0;
+  boulder.shape.type = ShapeType::AABB;
+  boulder.shape.size = Vector3(4, 4, 4);
+  boulder.transform.position = Vector3(3, 12, 3);
+  sim.create_entity("boulder", boulder);
+}
+
+// The spatial hash must hand the narrowphase the same contacts as testing
+// every pair, with derived and explicit cell sizes and with outliers on the
+// always-test list.
+bool spatial_hash_matches_brute_force() {
+  using navora::physics::BroadphaseMode;
+  Simulator brute;
+  Simulator derived;
+  Simulator explicit_cell;
+  brute.get_integrator().get_broadphase().set_mode(BroadphaseMode::BRUTE_FORCE);
+  explicit_cell.get_integrator().get_broadphase().set_cell_size(1.2);
+  bool ok = true;
+  for (Simulator* sim : {&brute, &derived, &explicit_cell}) {
+    build_world(*sim);
+    add_outliers(*sim);
+  }
+  for (int tick = 0; ok && tick < 180; ++tick) {
+    brute.tick();
+    derived.tick();
+    explicit_cell.tick();
+    ok = check(same_world(brute, derived), "spatial hash matches brute force (tick " + std::to_string(tick) + ")") &&
+         check(same_world(brute, explicit_cell),
+               "spatial hash with a set cell size matches brute force (tick " + std::to_string(tick) + ")");
+  }
+  return ok;
+}
+
+// Ticks until every dynamic body sleeps; false if that takes over 10 s.
+bool settle(Simulator& sim) {
+  const auto& bodies = sim.get_bodies();
+  for (int tick = 0; tick < 600; ++tick) {
+    bool resting = true;
+    for (uint32_t i = 0; resting && i < bodies.size(); ++i) {
+      resting = !bodies.is_active(i);
+    }
+    if (resting) return true;
+    sim.tick();
+  }
+  return false;
+}
+
+size_t awake_count(const Simulator& sim) {
+  size_t awake = 0;
+  for (uint32_t i = 0; i < sim.get_bodies().size(); ++i) {
+    awake += sim.get_bodies().is_active(i) ? 1 : 0;
+  }
+  return awake;
+}
+
+// A resting stack falls asleep, stays put while asleep, and wakes as a whole
+// on an impulse, on removal of one of its bodies and on removal of the
+// static body it rests on.
+bool sleeping() {
+  Simulator sim;
+  RigidBody floor;
+  floor.is_static = true;
+  floor.shape.type = ShapeType::PLANE;
+  floor.shape.normal = Vector3(0, 1, 0);
+  sim.create_entity("floor", floor);
+  RigidBody platform;
+  platform.is_static = true;
+  platform.mass = 0.0;
+  platform.inv_mass = 0.0;
+  platform.shape.type = ShapeType::AABB;
+  platform.shape.size = Vector3(2, 0.5, 2);
+  platform.transform.position = Vector3(0, 3, 0);
+  sim.create_entity("platform", platform);
+  for (int i = 0; i < 5; ++i) {
+    RigidBody box;
+    box.shape.type = ShapeType::AABB;
+    box.shape.size = Vector3(0.5, 0.5, 0.5);
+    box.transform.position = Vector3(0, 4.0 + 1.0 * i, 0);
+    sim.create_entity("box_" + std::to_string(i), box);
+  }
+  sim.start();
+
+  bool ok = check(settle(sim), "a resting stack falls asleep");
+  std::vector<Vector3> resting = sim.get_bodies().position;
+  for (int tick = 0; tick < 60; ++tick) sim.tick();
+  ok = check(same_bits(sim.get_bodies().position, resting), "sleeping bodies do not move") && ok;
+
+  RigidBody top;
+  sim.get_entity("box_4", top);
+  top.apply_impulse(Vector3(0.5, 0, 0));
+  sim.update_entity("box_4", top);
+  ok = check(awake_count(sim) == 5, "an impulse wakes the whole stack") && ok;
+  ok = check(settle(sim), "the stack falls asleep again after an impulse") && ok;
+
+  sim.remove_entity("box_1");
+  ok = check(awake_count(sim) == 4, "removing a body wakes the rest of its stack") && ok;
+  ok = check(settle(sim), "the stack falls asleep again after a removal") && ok;
+
+  sim.remove_entity("platform");
+  ok = check(awake_count(sim) == 4, "removing the static support wakes the stack") && ok;
+  ok = check(settle(sim), "the stack comes to rest on the floor") && ok;
+  RigidBody bottom;
+  sim.get_entity("box_0", bottom);
+  ok = check(bottom.transform.position.y < 1.0, "the stack fell to the floor") && ok;
+  return ok;
+}
+
+// With warm starting, a tall stack holds at a low iteration count without
+// sleeping to freeze it: every contact settles within the solver slop.
+bool stacking() {
+  Simulator sim;
+  navora::physics::SolverSettings solver = sim.get_integrator().get_solver_settings();
+  solver.iterations = 4;
+  sim.get_integrator().set_solver_settings(solver);
+  navora::physics::SleepSettings sleep = sim.get_integrator().get_sleep_settings();
+  sleep.enabled = false;
+  sim.get_integrator().set_sleep_settings(sleep);
+
+  RigidBody floor;
+  floor.is_static = true;
+  floor.shape.type = ShapeType::PLANE;
+  floor.shape.normal = Vector3(0, 1, 0);
+  sim.create_entity("floor", floor);
+  const int height = 12;
+  for (int i = 0; i < height; ++i) {
+    RigidBody box;
+    box.shape.type = ShapeType::AABB;
+    box.shape.size = Vector3(0.5, 0.5, 0.5);
+    box.transform.position = Vector3(0, 0.5 + 1.0 * i, 0);
+    sim.create_entity("box_" + std::to_string(i), box);
+  }
+  sim.start();
+  for (int tick = 0; tick < 600; ++tick) sim.tick();
+
+  bool ok = true;
+  double rest = 0.5;
+  for (int i = 0; ok && i < height; ++i) {
+    RigidBody box;
+    sim.get_entity("box_" + std::to_string(i), box);
+    const Vector3& p = box.transform.position;
+    const double penetration = rest - p.y;
+    ok = check(penetration < solver.slop && std::abs(p.x) < 1e-9 && std::abs(p.z) < 1e-9 &&
+                   box.linear_velocity.length() < 1e-3,
+               "box " + std::to_string(i) + " of a " + std::to_string(height) + "-box stack holds at " +
+                   std::to_string(solver.iterations) + " iterations (penetration " + std::to_string(penetration) + ")");
+    rest = p.y + 1.0;
+  }
+  return ok;
+}
+
+// Handles resolve to their own body across swap-removes, a removed entity's
+// handle is rejected by every call once its slot is reused, and names are
+// released with their entity.
+bool handles() {
+  using navora::EntityHandle;
+  using navora::EntityTable;
+  Simulator sim;
+  std::vector<EntityHandle> live;
+  for (int i = 0; i < 8; ++i) {
+    RigidBody body;
+    body.transform.position = Vector3(i, 0, 0);
+    live.push_back(i % 2 ? sim.create_entity("named_" + std::to_string(i), body) : sim.create_entity(body));
+  }
+  bool ok = check(!sim.create_entity("named_1", RigidBody()), "a taken name is refused") &&
+            check(!sim.create_entity("", RigidBody()), "an empty name is refused");
+
+  // Removing index 2 moves the last body into its place.
+  const EntityHandle stale = live[2];
+  const EntityHandle renamed = live[5];
+  ok = check(sim.remove_entity(stale), "remove by handle") && ok;
+  ok = check(sim.remove_entity("named_5"), "remove by name") && ok;
+  live.erase(live.begin() + 5);
+  live.erase(live.begin() + 2);
+  for (EntityHandle handle : live) {
+    RigidBody body;
+    const uint32_t index = sim.get_body_index(handle);
+    ok = check(index != EntityTable::NO_INDEX && sim.get_entity_handle(index) == handle &&
+                   sim.get_entity(handle, body) && body.transform.position.x == handle.index,
+               "handle " + std::to_string(handle.index) + " still resolves to its own body") && ok;
+  }
+
+  RigidBody reused_body;
+  reused_body.transform.position = Vector3(100, 0, 0);
+  const EntityHandle reused = sim.create_entity("named_5", reused_body);
+  const EntityHandle next = sim.create_entity(reused_body);
+  ok = check(reused.index == renamed.index && reused.generation == renamed.generation + 1 &&
+                 next.index == stale.index && next.generation == stale.generation + 1,
+             "freed slots are reused, most recent first, one generation on") && ok;
+
+  RigidBody body;
+  for (EntityHandle old : {stale, renamed}) {
+    ok = check(!sim.get_entity(old, body) && !sim.update_entity(old, body) && !sim.remove_entity(old) &&
+                   sim.get_body_index(old) == EntityTable::NO_INDEX,
+               "a stale handle is rejected after its slot is reused") && ok;
+  }
+  ok = check(sim.get_entity(next, body) && body.transform.position.x == 100, "the new handle owns the slot") && ok;
+  ok = check(sim.find_entity("named_5") == reused, "a released name can be taken again") && ok;
+  ok = check(!sim.get_entity(EntityHandle(), body) && !sim.remove_entity(EntityHandle(0xffff, 1)),
+             "null and out-of-range handles are rejected") && ok;
+  ok = check(sim.get_entity_id(sim.get_body_index(next)).empty() &&
+                 sim.get_entity_id(sim.get_body_index(reused)) == "named_5",
+             "ids stay with their bodies") && ok;
+  return ok;
+}
+
+// A consumer trimming to each version it reads finds every entity whose
+// state differs from what it read among the changed entities: bodies a step
+// moved, including those falling asleep or woken during it, and updated and
+// new ones. Without any consumer trimming, the removal log and the changed
+// list stay bounded by the entity count.
+bool change_tracking() {
+  using navora::EntityHandle;
+  using navora::EntityTable;
+  Simulator sim;
+  build_world(sim);
+  const auto& bodies = sim.get_bodies();
+  auto same_state = [&](uint32_t index, const RigidBody& seen) {
+    RigidBody body;
+    bodies.get(index, body);
+    return std::memcmp(&body.transform.position, &seen.transform.position, sizeof(Vector3)) == 0 &&
+           std::memcmp(&body.transform.rotation, &seen.transform.rotation, sizeof(body.transform.rotation)) == 0 &&
+           std::memcmp(&body.linear_velocity, &seen.linear_velocity, sizeof(Vector3)) == 0;
+  };
+
+  bool ok = true;
+  size_t fell_asleep = 0;
+  for (int tick = 0; ok && tick < 240; ++tick) {
+    const uint64_t version = sim.get_change_version();
+    sim.trim_changes(version);
+    std::unordered_map<uint64_t, RigidBody> seen;
+    std::vector<bool> was_active(bodies.size());
+    for (uint32_t i = 0; i < bodies.size(); ++i) {
+      bodies.get(i, seen[sim.get_entity_handle(i).to_u64()]);
+      was_active[i] = bodies.is_active(i);
+    }
+
+    RigidBody body;
+    if (tick % 40 == 0) {
+      sim.get_entity(sim.get_entity_handle(tick % bodies.size()), body);
+      body.apply_impulse(Vector3(0, 2, 0));
+      sim.update_entity(sim.get_entity_handle(tick % bodies.size()), body);
+    } else if (tick % 40 == 13) {
+      body.transform.position = Vector3(2.5, 12, 2.5);
+      sim.create_entity(body);
+    } else if (tick % 40 == 27) {
+      sim.remove_entity(sim.get_entity_handle(1 + tick % (bodies.size() - 1)));
+    }
+    sim.tick();
+
+    std::unordered_map<uint64_t, int> listed;
+    for (EntityHandle handle : sim.get_changed_entities()) {
+      if (sim.get_body_index(handle) != EntityTable::NO_INDEX) listed[handle.to_u64()]++;
+    }
+    for (uint32_t i = 0; i < bodies.size(); ++i) {
+      const EntityHandle handle = sim.get_entity_handle(i);
+      const auto& change = sim.get_entity_changes()[i];
+      const bool newer = std::max(change.moved, change.changed) > version;
+      auto it = seen.find(handle.to_u64());
+      const bool differs = it == seen.end() || !same_state(i, it->second);
+      if (differs && i < was_active.size() && was_active[i] && !bodies.is_active(i)) fell_asleep++;
+      auto entry = listed.find(handle.to_u64());
+      const int count = entry == listed.end() ? 0 : entry->second;
+      ok = check(!differs || (newer && count == 1),
+                 "tick " + std::to_string(tick) + ": changed entity " + std::to_string(handle.index) +
+                     " is listed once and marked") &&
+           check(count == (newer ? 1 : 0), "tick " + std::to_string(tick) + ": entity " +
+                                               std::to_string(handle.index) + " is listed only if marked") &&
+           ok;
+    }
+  }
+  ok = check(fell_asleep > 0, "bodies fell asleep while moving during the run") && ok;
+
+  Simulator churn;
+  RigidBody body;
+  for (int i = 0; i < 16; ++i) churn.create_entity(body);
+  const uint64_t reset = churn.get_reset_version();
+  for (int i = 0; i < 5000; ++i) {
+    churn.create_entity(body);
+    churn.remove_entity(churn.get_entity_handle(i % 16));
+  }
+  ok = check(churn.get_removals().size() <= 1024 && churn.get_reset_version() > reset,
+             "an untrimmed removal log is bounded and consumers that missed a dropped removal start over") && ok;
+  ok = check(churn.get_changed_entities().size() <= 2 * churn.get_entity_count() + 64,
+             "removed entities do not pile up in the changed list") && ok;
+  const uint64_t oldest = churn.get_removals().front().removed;
+  ok = check(churn.get_reset_version() < oldest, "consumers that hold the oldest kept removal's baseline go on") && ok;
+  return ok;
+}
+
+// The scheduler driven on a synthetic clock: late wake-ups and step cost do
+// not make the rate drift, a stall is caught up in bounded bursts with the
+// rest dropped, and overruns and slack are reported.
+bool tick_scheduler() {
+  using navora::util::TickScheduler;
+  using std::chrono::microseconds;
+  using std::chrono::milliseconds;
+  TickScheduler scheduler;
+  TickScheduler::Clock::time_point now{};
+  scheduler.start(now);
+
+  // Wake up 0-3 ms late and spend 2 ms per step, for ten seconds.
+  bool ok = true;
+  const TickScheduler::Clock::time_point stop = now + std::chrono::seconds(10);
+  for (int wake = 0; now < stop; ++wake) {
+    now = std::max(now, scheduler.next_deadline()) + microseconds(1000 * (wake % 4));
+    const int steps = scheduler.begin(now);
+    ok = check(steps == 1, "a slightly late wake-up runs one step") && ok;
+    now += milliseconds(2) * steps;
+    scheduler.end(now);
+  }
+  const auto& stats = scheduler.get_stats();
+  ok = check(stats.ticks == 601 || stats.ticks == 600, "60 Hz on deadlines holds 600 steps in 10 s (" +
+                                                           std::to_string(stats.ticks) + ")") && ok;
+  ok = check(std::abs(stats.achieved_rate - 60.0) < 0.5, "achieved rate is 60 Hz (" +
+                                                             std::to_string(stats.achieved_rate) + ")") && ok;
+  ok = check(stats.overruns == 0 && stats.dropped_ticks == 0 && stats.min_slack > 0.01,
+             "on-time steps neither overrun nor drop") && ok;
+
+  ok = check(scheduler.begin(scheduler.next_deadline() - microseconds(1)) == 0, "no step before its deadline") && ok;
+  now = scheduler.next_deadline() + milliseconds(500);
+  ok = check(scheduler.begin(now) == scheduler.get_settings().max_catch_up,
+             "a stall is caught up at most max_catch_up steps at a time") && ok;
+  scheduler.end(now);
+  ok = check(stats.dropped_ticks == 31 - scheduler.get_settings().max_catch_up && scheduler.next_deadline() > now,
+             "the rest of a stall is dropped, not owed") && ok;
+  now = scheduler.next_deadline() + milliseconds(30);
+  scheduler.begin(now - milliseconds(30));
+  scheduler.end(now);
+  ok = check(stats.overruns == 1 && stats.last_slack < 0.0 && stats.min_slack == stats.last_slack,
+             "a step finishing past the next deadline is an overrun") && ok;
+
+  navora::util::TickSchedulerSettings fast;
+  fast.max_speed = true;
+  scheduler.configure(fast);
+  scheduler.start(now);
+  ok = check(scheduler.begin(now) == 1 && scheduler.begin(now) == 1, "max speed steps on every wake-up") && ok;
+  return ok;
+}
+
+// A sweep of small worlds stepped as one batch, across threads and in
+// uneven runs, must match each world stepped alone in a Simulator.
+bool batch_matches_simulator() {
+  navora::SimulationBatch batch(3);
+  std::vector<Simulator> worlds(9);
+  for (uint32_t w = 0; w < worlds.size(); ++w) {
+    std::vector<RigidBody> bodies;
+    RigidBody floor;
+    floor.is_static = true;
+    floor.shape.type = ShapeType::PLANE;
+    floor.shape.normal = Vector3(0, 1, 0);
+    bodies.push_back(floor);
+    worlds[w].create_entity("floor", floor);
+    for (uint32_t i = 0; i < 3 + 4 * w; ++i) {
+      RigidBody body;
+      body.mass = 1.0 + 0.5 * w;
+      body.inv_mass = 1.0 / body.mass;
+      body.shape.type = (i % 2 == 0) ? ShapeType::SPHERE : ShapeType::AABB;
+      body.shape.size = Vector3(0.3 + 0.05 * w, 0.3 + 0.05 * w, 0.3 + 0.05 * w);
+      body.transform.position = Vector3(0.2 * (i % 3), 1.0 + 0.9 * i, 0.1 * w);
+      body.linear_velocity = Vector3(0, -w, 0.3 * (i % 2));
+      bodies.push_back(body);
+      worlds[w].create_entity(body);
+    }
+    batch.add_world(bodies);
+    worlds[w].start();
+  }
+
+  bool ok = true;
+  uint64_t ticks = 0;
+  for (uint64_t run : {1, 50, 7, 62}) {
+    batch.run(run);
+    ticks += run;
+    for (Simulator& world : worlds) {
+      for (uint64_t tick = 0; tick < run; ++tick) world.tick();
+    }
+    for (uint32_t w = 0; ok && w < worlds.size(); ++w) {
+      const auto view = batch.get_world(w);
+      const auto& alone = worlds[w].get_bodies();
+      bool same = view.size() == alone.size();
+      for (uint32_t i = 0; same && i < view.size(); ++i) {
+        same = std::memcmp(&view.position[i], &alone.position[i], sizeof(Vector3)) == 0 &&
+               std::memcmp(&view.linear_velocity[i], &alone.linear_velocity[i], sizeof(Vector3)) == 0 &&
+               view.flags[i] == alone.flags[i];
+      }
+      ok = check(same, "batched world " + std::to_string(w) + " matches a Simulator after " + std::to_string(ticks) +
+                           " ticks");
+    }
+  }
+  return ok;
+}
+
+// Fast bodies at a 30 Hz step: a sphere fired at a thin wall and one dropped
+// onto the floor, each covering many times its size per step, are stopped by
+// their speculative contacts instead of tunnelling.
+bool no_tunnelling() {
+  bool ok = true;
+  for (double speed : {60.0, 600.0}) {
+    Simulator sim;
+    sim.set_fixed_dt(1.0 / 30.0);
+    RigidBody floor;
+    floor.is_static = true;
+    floor.shape.type = ShapeType::PLANE;
+    floor.shape.normal = Vector3(0, 1, 0);
+    sim.create_entity("floor", floor);
+    RigidBody wall;
+    wall.is_static = true;
+    wall.mass = 0.0;
+    wall.inv_mass = 0.0;
+    wall.shape.type = ShapeType::AABB;
+    wall.shape.size = Vector3(0.05, 5, 5);
+    wall.transform.position = Vector3(0, 5, 0);
+    sim.create_entity("wall", wall);
+
+    RigidBody bullet;
+    bullet.shape.size = Vector3(0.1, 0.1, 0.1);
+    bullet.transform.position = Vector3(-30, 5, 0);
+    bullet.linear_velocity = Vector3(speed, 0, 0);
+    sim.create_entity("bullet", bullet);
+    RigidBody drop;
+    drop.shape.size = Vector3(0.1, 0.1, 0.1);
+    drop.transform.position = Vector3(20, 40, 0);
+    drop.linear_velocity = Vector3(0, -speed, 0);
+    sim.create_entity("drop", drop);
+
+    sim.start();
+    for (int tick = 0; ok && tick < 60; ++tick) {
+      sim.tick();
+      sim.get_entity("bullet", bullet);
+      sim.get_entity("drop", drop);
+      const std::string when = " at " + std::to_string(static_cast<int>(speed)) + " m/s (tick " + std::to_string(tick) + ")";
+      ok = check(bullet.transform.position.x < -0.05, "sphere does not pass through a thin wall" + when) &&
+           check(drop.transform.position.y > 0.0, "sphere does not fall through the floor" + when);
+    }
+  }
+  return ok;
+}
+
+// Once the frame arena and the solver's cache have grown to fit, a tick
+// allocates nothing, on one thread or several.
+bool steady_state_allocations() {
+  bool ok = true;
+  for (size_t threads : {1, 4}) {
+    Simulator sim;
+    sim.get_integrator().set_thread_count(threads);
+    build_world(sim);
+    for (int i = 0; i < 400; ++i) {
+      RigidBody body;
+      body.shape.size = Vector3(0.5, 0.5, 0.5);
+      body.transform.position = Vector3(-20.0 + (i % 20) * 1.05, 0.6 + (i / 100) * 1.1, -20.0 + ((i / 20) % 5) * 1.05);
+      sim.create_entity(body);
+    }
+    for (int tick = 0; tick < 30; ++tick) sim.tick();
+    for (int tick = 0; ok && tick < 60; ++tick) {
+      const uint64_t before = heap_allocations.load(std::memory_order_relaxed);
+      sim.tick();
+      const uint64_t allocations = heap_allocations.load(std::memory_order_relaxed) - before;
+      ok = check(allocations == 0, std::to_string(allocations) + " heap allocations in tick " +
+                                       std::to_string(sim.get_tick()) + " on " + std::to_string(threads) + " threads");
+    }
+  }
+  return ok;
+}
+
+// Independent islands are solved in parallel; the result must not depend on
+// how many threads solve them.
+bool threads_match_serial() {
+  Simulator serial;
+  build_world(serial);
+  for (int pile = 0; pile < 12; ++pile) {
+    for (int i = 0; i < 20; ++i) {
+      RigidBody body;
+      body.shape.type = (i % 2 == 0) ? ShapeType::AABB : ShapeType::SPHERE;
+      body.shape.size = Vector3(0.5, 0.5, 0.5);
+      body.transform.position = Vector3(20.0 + 10.0 * pile + 0.05 * (i % 3), 0.6 + 1.05 * i, -10.0);
+      body.linear_velocity = Vector3(0.2 * (pile % 3), 0, 0);
+      serial.create_entity(body);
+    }
+  }
+  std::vector<char> image;
+  serial.save_checkpoint(image);
+
+  bool ok = true;
+  for (size_t threads : {2, 3, 8}) {
+    Simulator parallel;
+    parallel.start();
+    parallel.get_integrator().set_thread_count(threads);
+    ok = check(parallel.load_checkpoint(image.data(), image.size()), "checkpoint loads") && ok;
+    Simulator reference;
+    reference.start();
+    reference.load_checkpoint(image.data(), image.size());
+    for (int tick = 0; ok && tick < 150; ++tick) {
+      reference.tick();
+      parallel.tick();
+      ok = check(same_world(reference, parallel), std::to_string(threads) + " solver threads step like one (tick " +
+                                                      std::to_string(tick) + ")");
+    }
+  }
+  return ok;
+}
+
+// Every narrowphase level the CPU supports must step a pile of spheres, boxes
+// and a plane bit-identically to the scalar kernels, in double and in float.
+template <typename T>
+bool simd_matches_scalar() {
+  using navora::physics::SimdLevel;
+  const SimdLevel supported = navora::physics::detect_simd_level();
+  bool ok = true;
+  for (int level = static_cast<int>(SimdLevel::SSE2); ok && level <= static_cast<int>(supported); ++level) {
+    SimulatorT<T> scalar;
+    SimulatorT<T> batched;
+    scalar.get_integrator().get_narrowphase().set_simd_level(SimdLevel::SCALAR);
+    batched.get_integrator().get_narrowphase().set_simd_level(static_cast<SimdLevel>(level));
+    build_world(scalar);
+    build_world(batched);
+    const std::string name = navora::physics::simd_level_name(static_cast<SimdLevel>(level));
+    ok = check(same_world(scalar, batched), name + " kernels build the same world as scalar (" +
+                                                std::to_string(sizeof(T)) + "-byte scalars)");
+    for (int tick = 0; ok && tick < 120; ++tick) {
+      scalar.tick();
+      batched.tick();
+      ok = check(same_world(scalar, batched), name + " kernels step like scalar (tick " + std::to_string(tick) + ")");
+    }
+  }
+  return ok;
+}
+
+// Encodes a moving set of entities frame by frame and decodes it the way a
+// stream consumer does, covering key frames, re-keying when an entity leaves
+// the box, index reuse after remove() and a consumer joining from
+// encode_held().
+bool packed_round_trip() {
+  using navora::physics::Quaternion;
+  using navora::util::PackedEntity;
+  using navora::util::PackedTransforms;
+  using navora::util::TransformPacker;
+  using navora::util::TransformUnpacker;
+
+  constexpr uint32_t COUNT = 64;
+  struct Truth {
+    bool live = true;
+    Vector3 position;
+    Vector3 velocity;
+    double angle = 0.0;
+  };
+  struct Decoded {
+    Vector3 position;
+    Quaternion rotation;
+    Vector3 velocity;
+  };
+  auto rotation_of = [](const Truth& t) {
+    return Quaternion(std::sin(t.angle) * 0.6, std::sin(t.angle) * 0.8, 0.0, std::cos(t.angle));
+  };
+
+  std::vector<Truth> truth(COUNT);
+  for (uint32_t i = 0; i < COUNT; ++i) {
+    truth[i].position = Vector3(i % 8, 0.5 * (i / 8), -0.25 * i);
+    // Every fourth entity rests and only appears in key frames.
+    if (i % 4 != 0) truth[i].velocity = Vector3(0.3 * (i % 5), 2.0 - 0.1 * i, 0.7);
+    truth[i].angle = 0.1 * i;
+  }
+
+  TransformPacker packer;
+  TransformUnpacker in_sequence;
+  TransformUnpacker joined;
+  bool has_joined = false;
+  std::vector<Decoded> decoded(COUNT);
+  std::vector<Decoded> decoded_joined(COUNT);
+  PackedTransforms frame;
+  std::vector<PackedEntity> entities;
+  bool ok = true;
+  int key_frames = 0;
+
+  auto close_to = [](const Truth& t, const Decoded& d, const PackedTransforms& f, const Quaternion& r) {
+    const double position_error = std::max({std::abs(d.position.x - t.position.x),
+                                            std::abs(d.position.y - t.position.y),
+                                            std::abs(d.position.z - t.position.z)});
+    const double velocity_error = std::max({std::abs(d.velocity.x - t.velocity.x),
+                                            std::abs(d.velocity.y - t.velocity.y),
+                                            std::abs(d.velocity.z - t.velocity.z)});
+    const double dot = d.rotation.x * r.x + d.rotation.y * r.y + d.rotation.z * r.z + d.rotation.w * r.w;
+    return position_error <= 0.5 * f.position_step * (1.0 + 1e-9) &&
+           velocity_error <= 0.5 * TransformPacker::VELOCITY_STEP * (1.0 + 1e-9) && std::abs(dot) > 0.9999;
+  };
+
+  for (int tick = 0; ok && tick < 400; ++tick) {
+    const double dt = 1.0 / 60.0;
+    // Leaves the box, so this frame is a key frame.
+    const bool rekey = tick == 120;
+    if (rekey) truth[6].position = Vector3(500, -300, 40);
+    if (tick == 150) {
+      truth[10].live = false;
+      packer.remove(10);
+      in_sequence.remove(10);
+    }
+    entities.clear();
+    for (uint32_t i = 0; i < COUNT; ++i) {
+      Truth& t = truth[i];
+      // Odd-numbered movers skip every other frame, so motion carries over
+      // frames an entity is absent from.
+      if (!t.live || i % 4 == 0 || (i % 2 == 1 && tick % 2 == 1)) continue;
+      t.position += t.velocity * dt;
+      t.angle += 0.02;
+      entities.push_back({i, t.position, rotation_of(t), t.velocity});
+    }
+    bool created = false;
+    if (tick == 170) {
+      truth[10] = Truth();
+      truth[10].position = Vector3(2, 3, 4);
+      truth[10].velocity = Vector3(0, 0, 0);
+      entities.push_back({10, truth[10].position, rotation_of(truth[10]), truth[10].velocity});
+      created = true;
+    }
+
+    if (tick == 0 || !packer.encode(entities, frame)) {
+      entities.clear();
+      for (uint32_t i = 0; i < COUNT; ++i) {
+        if (truth[i].live) entities.push_back({i, truth[i].position, rotation_of(truth[i]), truth[i].velocity});
+      }
+      packer.encode_key(entities, frame);
+      key_frames++;
+    }
+    ok = check(!rekey || frame.key, "re-keyed when an entity left the box") && ok;
+
+    if (created) in_sequence.remove(10);
+    in_sequence.apply(frame, [&](uint32_t index, const Vector3& position, const Quaternion& rotation,
+                                 const Vector3& velocity) {
+      decoded[index] = {position, rotation, velocity};
+      ok = check(close_to(truth[index], decoded[index], frame, rotation_of(truth[index])),
+                 "packed entity " + std::to_string(index) + " decodes within a grid cell (tick " +
+                     std::to_string(tick) + ")") && ok;
+    });
+    if (has_joined) {
+      if (created) joined.remove(10);
+      joined.apply(frame, [&](uint32_t index, const Vector3& position, const Quaternion& rotation,
+                              const Vector3& velocity) { decoded_joined[index] = {position, rotation, velocity}; });
+    }
+
+    if (tick == 200) {
+      // A consumer joining now starts from the held values.
+      PackedTransforms held;
+      packer.encode_held(held);
+      joined.apply(held, [&](uint32_t index, const Vector3& position, const Quaternion& rotation,
+                             const Vector3& velocity) { decoded_joined[index] = {position, rotation, velocity}; });
+      has_joined = true;
+    }
+    for (uint32_t i = 0; has_joined && i < COUNT; ++i) {
+      const Decoded& a = decoded[i];
+      const Decoded& b = decoded_joined[i];
+      if (!truth[i].live) continue;
+      ok = check(std::memcmp(&a.position, &b.position, sizeof(Vector3)) == 0 &&
+                     std::memcmp(&a.velocity, &b.velocity, sizeof(Vector3)) == 0 &&
+                     std::memcmp(&a.rotation, &b.rotation, sizeof(Quaternion)) == 0,
+                 "joined consumer matches the in-sequence one for entity " + std::to_string(i) + " (tick " +
+                     std::to_string(tick) + ")") && ok;
+    }
+  }
+  ok = check(key_frames < 10, "key frames stay rare") && ok;
+
+  // Velocities beyond the quantized range clamp instead of overflowing.
+  std::vector<PackedEntity> extreme = {{0, Vector3(0, 0, 0), Quaternion(), Vector3(1e12, -1e12, 0)}};
+  packer.clear();
+  packer.encode_key(extreme, frame);
+  extreme[0].linear_velocity = Vector3(-1e12, 1e12, std::nan(""));
+  ok = check(packer.encode(extreme, frame) && frame.velocities.size() == 3 && frame.velocities[0] < 0 &&
+                 frame.velocities[1] > 0,
+             "extreme velocity reversals encode") && ok;
+  return ok;
+}
+
+}
+
+int main() {
+  bool ok = true;
+  ok = spatial_hash_matches_brute_force() && ok;
+  ok = simd_matches_scalar<double>() && ok;
+  ok = simd_matches_scalar<float>() && ok;
+  ok = threads_match_serial() && ok;
+  ok = sleeping() && ok;
+  ok = stacking() && ok;
+  ok = no_tunnelling() && ok;
+  ok = handles() && ok;
+  ok = change_tracking() && ok;
+  ok = batch_matches_simulator() && ok;
+  ok = tick_scheduler() && ok;
+  ok = steady_state_allocations() && ok;
+  ok = checkpoint_round_trip() && ok;
+  ok = checkpoint_rejects_corruption() && ok;
+  ok = packed_round_trip() && ok;
+  std::cout << (ok ? "[OK] all checks passed\n" : "[FAILED]\n");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,63 @@
+#include "simulation_batch.h"
+
+namespace navora {
+
+template <typename T>
+SimulationBatchT<T>::SimulationBatchT(size_t thread_count)
+  : world_offsets_{0}, pool_(std::make_unique<util::ThreadPool>(thread_count)) {}
+
+template <typename T>
+uint32_t SimulationBatchT<T>::add_world(const std::vector<RigidBody>& bodies) {
+  const uint32_t world = static_cast<uint32_t>(integrators_.size());
+  const uint32_t begin = static_cast<uint32_t>(bodies_.size());
+  for (const RigidBody& body : bodies) {
+    uint32_t index = bodies_.add(body);
+    // Sleep rings index within the world's view.
+    bodies_.sleep_next[index] = index - begin;
+    bodies_.sleep_prev[index] = index - begin;
+    world_.push_back(world);
+  }
+  world_offsets_.push_back(static_cast<uint32_t>(bodies_.size()));
+  integrators_.push_back(std::make_unique<Integrator>(WORLD_ARENA_CAPACITY));
+  return world;
+}
+
+template <typename T>
+void SimulationBatchT<T>::reserve(size_t world_count, size_t body_count) {
+  bodies_.reserve(body_count);
+  world_.reserve(body_count);
+  world_offsets_.reserve(world_count + 1);
+  integrators_.reserve(world_count);
+}
+
+template <typename T>
+void SimulationBatchT<T>::clear() {
+  bodies_.clear();
+  world_.clear();
+  world_offsets_.assign(1, 0);
+  integrators_.clear();
+  tick_ = 0;
+  sim_time_ = 0.0;
+}
+
+template <typename T>
+void SimulationBatchT<T>::run(uint64_t ticks) {
+  const double dt = fixed_dt_;
+  pool_->parallel_for(integrators_.size(), [&](size_t world) {
+    Integrator& integrator = *integrators_[world];
+    const BodyView bodies = get_world(static_cast<uint32_t>(world));
+    for (uint64_t t = 0; t < ticks; ++t) {
+      integrator.step(bodies, dt);
+      integrator.end_frame();
+    }
+  });
+  for (uint64_t t = 0; t < ticks; ++t) {
+    tick_++;
+    sim_time_ += dt;
+  }
+}
+
+template class SimulationBatchT<float>;
+template class SimulationBatchT<double>;
+
+}
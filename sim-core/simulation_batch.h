@@ -0,0 +1,91 @@
+#pragma once
+
+#include "physics/body_store.h"
+#include "physics/integrator.h"
+#include "physics/rigid_body.h"
+#include "util/thread_pool.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace navora {
+
+// Many small, independent worlds stepped together, for parameter sweeps and
+// drop tests. Every world's bodies live back to back in one BodyStore and are
+// tagged with their world index; each world keeps its own integrator (and so
+// its own settings, warm-start cache and frame arena) and is stepped through a
+// view of its range. Worlds are spread over the thread pool, one world per
+// task, so results do not depend on the thread count and each world matches
+// a Simulator holding the same bodies.
+//
+// There are no ids or USD stage: bodies are addressed by their index within
+// the world, in the order they were added.
+template <typename T>
+class SimulationBatchT {
+public:
+  using Scalar = T;
+  using Vector3 = physics::Vector3T<T>;
+  using RigidBody = physics::RigidBodyT<T>;
+  using BodyStore = physics::BodyStoreT<T>;
+  using BodyView = physics::BodyViewT<T>;
+  using Integrator = physics::IntegratorT<T>;
+
+  static constexpr double FIXED_DT = 1.0 / 60.0;
+  // First frame arena block per world; arenas grow to the largest frame.
+  static constexpr size_t WORLD_ARENA_CAPACITY = 4 * 1024;
+
+  explicit SimulationBatchT(size_t thread_count = 1);
+
+  // Appends a world holding bodies and returns its index. Views and
+  // references into the batch are invalidated.
+  uint32_t add_world(const std::vector<RigidBody>& bodies);
+  void reserve(size_t world_count, size_t body_count);
+  void clear();
+
+  // Advances every world by ticks fixed steps. Each world runs all of its
+  // steps in one task, so the pool synchronises once per call rather than
+  // once per step.
+  void run(uint64_t ticks);
+  void tick() { run(1); }
+
+  size_t get_world_count() const { return integrators_.size(); }
+  size_t get_body_count() const { return bodies_.size(); }
+
+  // All worlds' bodies without copying. World w occupies
+  // [get_world_begin(w), get_world_begin(w) + get_world_size(w)), and
+  // get_world_tags()[i] is the world of body i.
+  const BodyStore& get_bodies() const { return bodies_; }
+  const std::vector<uint32_t>& get_world_tags() const { return world_; }
+  uint32_t get_world_begin(uint32_t world) const { return world_offsets_[world]; }
+  uint32_t get_world_size(uint32_t world) const { return world_offsets_[world + 1] - world_offsets_[world]; }
+  // Mutable view of one world, indexed from 0, for reading results in place or
+  // editing state between runs. Wake a sleeping body before changing it.
+  BodyView get_world(uint32_t world) { return bodies_.view(world_offsets_[world], get_world_size(world)); }
+
+  // Per-world settings (solver, sleep, step, broadphase).
+  Integrator& get_integrator(uint32_t world) { return *integrators_[world]; }
+  const Integrator& get_integrator(uint32_t world) const { return *integrators_[world]; }
+
+  // Threads, including the caller, that worlds are spread over.
+  void set_thread_count(size_t thread_count) { pool_ = std::make_unique<util::ThreadPool>(thread_count); }
+  size_t get_thread_count() const { return pool_->size(); }
+
+  uint64_t get_tick() const { return tick_; }
+  double get_sim_time() const { return sim_time_; }
+  void set_fixed_dt(double dt) { fixed_dt_ = dt; }
+  double get_fixed_dt() const { return fixed_dt_; }
+
+private:
+  BodyStore bodies_;
+  std::vector<uint32_t> world_;
+  std::vector<uint32_t> world_offsets_;
+  std::vector<std::unique_ptr<Integrator>> integrators_;
+  std::unique_ptr<util::ThreadPool> pool_;
+  uint64_t tick_ = 0;
+  double sim_time_ = 0.0;
+  double fixed_dt_ = FIXED_DT;
+};
+
+using SimulationBatch = SimulationBatchT<double>;
+
+}
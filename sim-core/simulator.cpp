@@ -1,125 +1,476 @@
 #include "simulator.h"
 
+#include <algorithm>
+
+#ifdef USD_FOUND
+#include "usd/usd_import.h"
+#endif
+
 namespace navora {
 
-void Simulator::tick() {
+template <typename T>
+void SimulatorT<T>::tick() {
   if (!running_) return;
 
-  const double dt = FIXED_DT;
+  const double dt = fixed_dt_;
 
+  change_version_++;
+  integrator_.step(bodies_.view(), dt);
+  const auto& moved = integrator_.get_moved_bodies();
+  scene_query_.refit(bodies_, moved.data(), moved.size(), dt);
+  for (uint32_t i : moved) {
+    note_change(i);
+    changes_[i].moved = change_version_;
 #ifdef USD_FOUND
-  auto entity_ids = scene_.get_all_entity_ids();
-  std::vector<physics::RigidBody> bodies;
-  std::vector<std::string> ids;
-
-  for (const auto& id : entity_ids) {
-    physics::RigidBody body;
-    if (scene_.get_entity(id, body)) {
-      bodies.push_back(body);
-      ids.push_back(id);
-    }
+    if (!scene_stale_) scene_.mark_dirty(handles_[i]);
+#endif
   }
 
-  integrator_.step(bodies, dt);
+  integrator_.end_frame();
 
-  for (size_t i = 0; i < ids.size(); ++i) {
-    scene_.update_entity(ids[i], bodies[i]);
-  }
-#else
-  std::vector<physics::RigidBody> bodies;
-  std::vector<std::string> ids;
+  tick_++;
+  sim_time_ += dt;
 
-  for (const auto& [id, body] : entities_) {
-    bodies.push_back(body);
-    ids.push_back(id);
+#ifdef USD_FOUND
+  if (scene_flush_interval_ != 0 && tick_ % scene_flush_interval_ == 0) {
+    flush_scene();
   }
+#endif
+}
 
-  integrator_.step(bodies, dt);
+template <typename T>
+void SimulatorT<T>::note_change(uint32_t index) {
+  const EntityChanges& change = changes_[index];
+  if (std::max(change.moved, change.changed) <= changed_since_) changed_.push_back(handles_[index]);
+}
 
-  for (size_t i = 0; i < ids.size(); ++i) {
-    entities_[ids[i]] = bodies[i];
+template <typename T>
+void SimulatorT<T>::trim_changes(uint64_t version) {
+  while (!removals_.empty() && removals_.front().removed <= version) removals_.pop_front();
+  if (version <= changed_since_) return;
+  changed_since_ = version;
+  size_t kept = 0;
+  for (EntityHandle handle : changed_) {
+    uint32_t index = entities_.find(handle);
+    if (index == EntityTable::NO_INDEX) continue;
+    const EntityChanges& change = changes_[index];
+    if (std::max(change.moved, change.changed) > version) changed_[kept++] = handle;
   }
-#endif
+  changed_.resize(kept);
+}
 
-  tick_++;
-  sim_time_ += dt;
+template <typename T>
+void SimulatorT<T>::mark_all_created() {
+  change_version_++;
+  reset_version_ = change_version_;
+  changes_.assign(bodies_.size(), EntityChanges{change_version_, change_version_, change_version_});
+  changed_.clear();
+  changed_since_ = change_version_;
+  removals_.clear();
 }
 
-bool Simulator::create_entity(const std::string& id, const physics::RigidBody& body) {
 #ifdef USD_FOUND
-  return scene_.create_entity(id, body);
-#else
-  if (entities_.find(id) != entities_.end()) {
-    return false;
+template <typename T>
+size_t SimulatorT<T>::flush_scene() {
+  sync_scene();
+  RigidBody body;
+  return scene_.flush([&](EntityHandle handle, physics::RigidBody& out) {
+    if (!get_entity(handle, body)) return false;
+    out = physics::RigidBody(body);
+    return true;
+  });
+}
+#endif
+
+#ifdef USD_FOUND
+template <typename T>
+bool SimulatorT<T>::load_usd(const std::string& path) {
+  pxr::UsdStageRefPtr stage = pxr::UsdStage::Open(path);
+  if (!stage) return false;
+  std::vector<usd::ImportedEntity> imported;
+  {
+    util::ThreadPool pool(integrator_.get_thread_count());
+    if (!usd::import_entities(stage, pool, imported)) return false;
+  }
+
+  reset();
+  scene_.adopt(stage);
+  bodies_.reserve(imported.size());
+  handles_.reserve(imported.size());
+  ids_.reserve(imported.size());
+  names_.reserve(imported.size());
+  for (const usd::ImportedEntity& entity : imported) {
+    const uint32_t index = static_cast<uint32_t>(bodies_.size());
+    EntityHandle handle = entities_.insert(index);
+    if (!scene_.bind_entity(handle, entity.path, entity.body)) {
+      entities_.erase(handle);
+      continue;
+    }
+    bodies_.add(RigidBody(entity.body));
+    handles_.push_back(handle);
+    ids_.push_back(entity.name);
+    names_[entity.name] = handle;
+    scene_query_.add(bodies_, index);
   }
-  entities_[id] = body;
-  scene_graph_.create_entity(id);
+  topology_version_++;
+  mark_all_created();
   return true;
+}
 #endif
+
+template <typename T>
+EntityHandle SimulatorT<T>::create_entity(const RigidBody& body) {
+  return add_entity(std::string(), body);
 }
 
-bool Simulator::get_entity(const std::string& id, physics::RigidBody& body) const {
-#ifdef USD_FOUND
-  return scene_.get_entity(id, body);
-#else
-  auto it = entities_.find(id);
-  if (it != entities_.end()) {
-    body = it->second;
-    return true;
+template <typename T>
+EntityHandle SimulatorT<T>::create_entity(const std::string& id, const RigidBody& body) {
+  if (id.empty() || find_entity(id)) {
+    return EntityHandle();
   }
-  return false;
-#endif
+  return add_entity(id, body);
 }
 
-bool Simulator::update_entity(const std::string& id, const physics::RigidBody& body) {
+template <typename T>
+EntityHandle SimulatorT<T>::add_entity(const std::string& id, const RigidBody& body) {
+  const uint32_t index = static_cast<uint32_t>(bodies_.size());
+  EntityHandle handle = entities_.insert(index);
+  topology_version_++;
 #ifdef USD_FOUND
-  return scene_.update_entity(id, body);
-#else
-  auto it = entities_.find(id);
-  if (it != entities_.end()) {
-    it->second = body;
-    return true;
+  if (!scene_stale_ &&
+      !scene_.create_entity(handle, id.empty() ? default_entity_name(handle) : id, physics::RigidBody(body))) {
+    entities_.erase(handle);
+    return EntityHandle();
   }
-  return false;
+#else
+  if (!scene_stale_) add_scene_entity(handle, id, body);
 #endif
+  bodies_.add(body);
+  handles_.push_back(handle);
+  ids_.push_back(id);
+  change_version_++;
+  changes_.push_back({change_version_, change_version_, change_version_});
+  changed_.push_back(handle);
+  if (!id.empty() && names_indexed_) names_[id] = handle;
+  scene_query_.add(bodies_, index);
+  return handle;
 }
 
-bool Simulator::remove_entity(const std::string& id) {
+template <typename T>
+void SimulatorT<T>::add_scene_entity(EntityHandle handle, const std::string& id, const RigidBody& body) {
+  const std::string scene_name = id.empty() ? default_entity_name(handle) : id;
 #ifdef USD_FOUND
-  return scene_.remove_entity(id);
+  scene_.create_entity(handle, scene_name, physics::RigidBody(body));
 #else
-  auto it = entities_.find(id);
-  if (it != entities_.end()) {
-    entities_.erase(it);
-    scene_graph_.remove_entity(id);
-    return true;
+  (void)body;
+  scene_graph_.create_entity(handle, scene_name);
+#endif
+}
+
+template <typename T>
+EntityHandle SimulatorT<T>::find_entity(const std::string& id) const {
+  index_names();
+  auto it = names_.find(id);
+  return (it != names_.end()) ? it->second : EntityHandle();
+}
+
+template <typename T>
+bool SimulatorT<T>::get_entity(EntityHandle handle, RigidBody& body) const {
+  uint32_t index = entities_.find(handle);
+  if (index == EntityTable::NO_INDEX) {
+    return false;
+  }
+  bodies_.get(index, body);
+  return true;
+}
+
+template <typename T>
+bool SimulatorT<T>::update_entity(EntityHandle handle, const RigidBody& body) {
+  uint32_t index = entities_.find(handle);
+  if (index == EntityTable::NO_INDEX) {
+    return false;
   }
-  return false;
+  bodies_.wake(index);
+  bodies_.set(index, body);
+  scene_query_.update(bodies_, index);
+  note_change(index);
+  change_version_++;
+  changes_[index].moved = change_version_;
+  changes_[index].changed = change_version_;
+#ifdef USD_FOUND
+  scene_.mark_dirty(handle, scene::USDScene::DIRTY_MOTION | scene::USDScene::DIRTY_PROPERTIES);
 #endif
+  return true;
 }
 
-std::vector<std::string> Simulator::get_all_entity_ids() const {
+template <typename T>
+bool SimulatorT<T>::remove_entity(EntityHandle handle) {
+  uint32_t index = entities_.find(handle);
+  if (index == EntityTable::NO_INDEX) {
+    return false;
+  }
+
+  if (!scene_stale_) {
 #ifdef USD_FOUND
-  return scene_.get_all_entity_ids();
+    scene_.remove_entity(handle);
 #else
-  std::vector<std::string> ids;
-  for (const auto& [id, body] : entities_) {
-    ids.push_back(id);
-  }
-  return ids;
+    scene_graph_.remove_entity(handle);
 #endif
+  }
+
+  wake_supported(index);
+  entities_.erase(handle);
+  if (!ids_[index].empty() && names_indexed_) names_.erase(ids_[index]);
+  change_version_++;
+  removals_.push_back({handle, ids_[index].empty() ? default_entity_name(handle) : ids_[index],
+                       changes_[index].created, change_version_});
+  // A log longer than the world costs consumers more than the full state, so
+  // the oldest removal is dropped and consumers that missed it start over.
+  if (removals_.size() > std::max<size_t>(bodies_.size(), 1024)) {
+    reset_version_ = removals_.front().removed;
+    removals_.pop_front();
+  }
+  uint32_t moved = bodies_.remove(index);
+  scene_query_.remove(index, moved);
+  integrator_.remove_body(index, moved);
+  if (moved != index) {
+    handles_[index] = handles_[moved];
+    ids_[index] = std::move(ids_[moved]);
+    changes_[index] = changes_[moved];
+    entities_.relocate(handles_[index], index);
+  }
+  handles_.pop_back();
+  ids_.pop_back();
+  changes_.pop_back();
+  // Only removals leave stale handles in changed_; dropping them once they
+  // outnumber the live entities keeps it within twice the entity count.
+  if (changed_.size() > 2 * bodies_.size() + 64) {
+    changed_.erase(std::remove_if(changed_.begin(), changed_.end(),
+                                  [&](EntityHandle listed) { return entities_.find(listed) == EntityTable::NO_INDEX; }),
+                   changed_.end());
+  }
+  topology_version_++;
+  return true;
 }
 
-void Simulator::reset() {
+template <typename T>
+bool SimulatorT<T>::get_entity(const std::string& id, RigidBody& body) const {
+  return get_entity(find_entity(id), body);
+}
+
+template <typename T>
+bool SimulatorT<T>::update_entity(const std::string& id, const RigidBody& body) {
+  return update_entity(find_entity(id), body);
+}
+
+template <typename T>
+bool SimulatorT<T>::remove_entity(const std::string& id) {
+  return remove_entity(find_entity(id));
+}
+
+template <typename T>
+void SimulatorT<T>::wake_supported(uint32_t index) {
+  bodies_.wake(index);
+  if (!bodies_.is_static(index)) return;
+
+  // Sleeping bodies resting on a removed static body lose their support.
+  if (!std::isfinite(physics::bounding_radius(bodies_.shape[index]))) {
+    for (uint32_t i = 0; i < bodies_.size(); ++i) {
+      bodies_.wake(i);
+    }
+    return;
+  }
+  std::vector<physics::AABB> boxes{physics::compute_aabb(bodies_, index).expanded(scene_query_.get_margin())};
+  physics::OverlapResults touching;
+  scene_query_.overlap_aabb(bodies_, boxes, touching);
+  for (uint32_t body : touching.bodies) {
+    bodies_.wake(body);
+  }
+}
+
+template <typename T>
+void SimulatorT<T>::index_names() const {
+  if (names_indexed_) return;
+  names_.reserve(ids_.size());
+  for (size_t i = 0; i < ids_.size(); ++i) {
+    if (!ids_[i].empty()) names_.emplace(ids_[i], handles_[i]);
+  }
+  names_indexed_ = true;
+}
+
+template <typename T>
+void SimulatorT<T>::sync_scene() {
+  if (!scene_stale_) return;
+  scene_stale_ = false;
+  RigidBody body;
+  for (uint32_t i = 0; i < bodies_.size(); ++i) {
+    bodies_.get(i, body);
+    add_scene_entity(handles_[i], ids_[i], body);
+  }
+}
+
+template <typename T>
+const std::vector<std::string>& SimulatorT<T>::get_all_entity_ids() const {
+  return ids_;
+}
+
+template <typename T>
+void SimulatorT<T>::raycast(const std::vector<physics::Ray>& rays, std::vector<physics::QueryHit>& hits) const {
+  scene_query_.raycast(bodies_, rays, hits);
+}
+
+template <typename T>
+void SimulatorT<T>::sweep_sphere(const std::vector<physics::SphereSweep>& sweeps,
+                             std::vector<physics::QueryHit>& hits) const {
+  scene_query_.sweep_sphere(bodies_, sweeps, hits);
+}
+
+template <typename T>
+void SimulatorT<T>::overlap_sphere(const std::vector<physics::Sphere>& spheres,
+                                   physics::OverlapResults& results) const {
+  scene_query_.overlap_sphere(bodies_, spheres, results);
+}
+
+template <typename T>
+void SimulatorT<T>::overlap_aabb(const std::vector<physics::AABB>& boxes, physics::OverlapResults& results) const {
+  scene_query_.overlap_aabb(bodies_, boxes, results);
+}
+
+template <typename T>
+void SimulatorT<T>::reset() {
   tick_ = 0;
   sim_time_ = 0.0;
+  topology_version_++;
+  bodies_.clear();
+  entities_.clear();
+  handles_.clear();
+  ids_.clear();
+  mark_all_created();
+  names_.clear();
+  names_indexed_ = true;
+  scene_query_.clear();
+  integrator_.clear();
 #ifdef USD_FOUND
   scene_.clear();
 #else
-  entities_.clear();
   scene_graph_.clear();
 #endif
+  scene_stale_ = false;
 }
 
+template <typename T>
+void SimulatorT<T>::write_checkpoint(util::CheckpointWriter& writer, std::vector<uint64_t>& name_offsets,
+                                     std::vector<char>& names) const {
+  CheckpointState state{static_cast<uint32_t>(sizeof(T)), static_cast<uint32_t>(sizeof(physics::CollisionShapeT<T>)),
+                        bodies_.size(), tick_, sim_time_, fixed_dt_};
+  writer.add_value(util::CHECKPOINT_SIMULATOR, state);
+
+  // Names are packed into one blob; name i is names[offsets[i] .. offsets[i + 1]).
+  name_offsets.resize(ids_.size() + 1);
+  name_offsets[0] = 0;
+  for (size_t i = 0; i < ids_.size(); ++i) {
+    name_offsets[i + 1] = name_offsets[i] + ids_[i].size();
+  }
+  names.resize(name_offsets.back());
+  for (size_t i = 0; i < ids_.size(); ++i) {
+    std::copy(ids_[i].begin(), ids_[i].end(), names.begin() + name_offsets[i]);
+  }
+  writer.add(util::CHECKPOINT_ENTITY_NAME_OFFSETS, name_offsets);
+  writer.add(util::CHECKPOINT_ENTITY_NAMES, names);
+  writer.add(util::CHECKPOINT_ENTITY_HANDLES, handles_);
+  entities_.save(writer);
+
+  bodies_.save(writer);
+  integrator_.save(writer);
+  scene_query_.save(writer);
+}
+
+template <typename T>
+void SimulatorT<T>::save_checkpoint(std::vector<char>& image) const {
+  util::CheckpointWriter writer;
+  std::vector<uint64_t> name_offsets;
+  std::vector<char> names;
+  write_checkpoint(writer, name_offsets, names);
+  writer.write(image);
+}
+
+template <typename T>
+bool SimulatorT<T>::save_checkpoint(const std::string& path) const {
+  util::CheckpointWriter writer;
+  std::vector<uint64_t> name_offsets;
+  std::vector<char> names;
+  write_checkpoint(writer, name_offsets, names);
+  return writer.write_file(path);
+}
+
+template <typename T>
+bool SimulatorT<T>::load_checkpoint(const void* data, size_t size) {
+  util::CheckpointReader reader;
+  CheckpointState state;
+  if (!reader.open(data, size) || !reader.read_value(util::CHECKPOINT_SIMULATOR, state) ||
+      state.scalar_size != sizeof(T) || state.shape_size != sizeof(physics::CollisionShapeT<T>)) {
+    return false;
+  }
+
+  // Everything is read into temporaries and validated before any of it
+  // replaces the world. The solver cache goes last: it is the one part loaded
+  // in place, and a rejected cache leaves it unchanged.
+  BodyStore bodies;
+  EntityTable entities;
+  std::vector<EntityHandle> handles;
+  physics::SceneQuery scene_query;
+  scene_query.set_margin(scene_query_.get_margin());
+  std::vector<uint64_t> name_offsets;
+  std::vector<char> names;
+  const size_t count = static_cast<size_t>(state.body_count);
+  bool complete = bodies.load(reader) && bodies.size() == count &&
+                  reader.read(util::CHECKPOINT_ENTITY_HANDLES, handles) && handles.size() == count &&
+                  reader.read(util::CHECKPOINT_ENTITY_NAME_OFFSETS, name_offsets) &&
+                  name_offsets.size() == count + 1 && reader.read(util::CHECKPOINT_ENTITY_NAMES, names) &&
+                  entities.load(reader, count) && scene_query.load(reader, count);
+  for (size_t i = 0; complete && i < count; ++i) {
+    complete = name_offsets[i] <= name_offsets[i + 1] && name_offsets[i + 1] <= names.size() &&
+               entities.find(handles[i]) == i;
+  }
+  if (!complete || !integrator_.load(reader, count)) {
+    return false;
+  }
+
+  bodies_ = std::move(bodies);
+  entities_ = std::move(entities);
+  handles_ = std::move(handles);
+  scene_query_ = std::move(scene_query);
+  ids_.resize(count);
+  for (size_t i = 0; i < count; ++i) {
+    ids_[i].assign(names.data() + name_offsets[i], names.data() + name_offsets[i + 1]);
+  }
+
+  // The name index and the scene mirror are rebuilt when first needed rather
+  // than entity by entity here.
+  names_.clear();
+  names_indexed_ = false;
+#ifdef USD_FOUND
+  scene_.clear();
+#else
+  scene_graph_.clear();
+#endif
+  scene_stale_ = true;
+
+  tick_ = state.tick;
+  sim_time_ = state.sim_time;
+  fixed_dt_ = state.fixed_dt;
+  topology_version_++;
+  mark_all_created();
+  return true;
 }
 
+template <typename T>
+bool SimulatorT<T>::load_checkpoint(const std::string& path) {
+  util::MappedFile file;
+  return file.open(path) && load_checkpoint(file.data(), file.size());
+}
+
+template class SimulatorT<float>;
+template class SimulatorT<double>;
+
+}
@@ -1,8 +1,12 @@
 #pragma once
 
+#include "entity_handle.h"
+#include "physics/body_store.h"
 #include "physics/integrator.h"
 #include "physics/rigid_body.h"
+#include "physics/scene_query.h"
 #include <cstdint>
+#include <deque>
 #include <string>
 #include <functional>
 #include <vector>
@@ -16,11 +20,20 @@
 
 namespace navora {
 
-class Simulator {
+// A world in scalar type T; see physics::IntegratorT. Simulator is the double
+// world. Time, queries and the USD stage stay double whichever T is used.
+template <typename T>
+class SimulatorT {
 public:
+  using Scalar = T;
+  using Vector3 = physics::Vector3T<T>;
+  using RigidBody = physics::RigidBodyT<T>;
+  using BodyStore = physics::BodyStoreT<T>;
+  using Integrator = physics::IntegratorT<T>;
+
   static constexpr double FIXED_DT = 1.0 / 60.0;
 
-  Simulator() : running_(false), tick_(0), sim_time_(0.0) {}
+  SimulatorT() : running_(false), tick_(0), sim_time_(0.0), fixed_dt_(FIXED_DT) {}
 
   void start() {
     running_ = true;
@@ -33,34 +46,196 @@ public:
   void tick();
 
 #ifdef USD_FOUND
-  scene::USDScene& get_scene() { return scene_; }
+  // The stage is a write-behind mirror: it holds the state as of the last
+  // flush_scene(), which tick() calls every get_scene_flush_interval() ticks.
+  // load_checkpoint() leaves it empty until the next flush or non-const
+  // get_scene() repopulates it.
+  scene::USDScene& get_scene() {
+    sync_scene();
+    return scene_;
+  }
   const scene::USDScene& get_scene() const { return scene_; }
+  // Writes entities that moved or were updated since the last flush to the
+  // stage; returns how many.
+  size_t flush_scene();
+  // 0 leaves flushing to the caller.
+  void set_scene_flush_interval(uint32_t ticks) { scene_flush_interval_ = ticks; }
+  uint32_t get_scene_flush_interval() const { return scene_flush_interval_; }
+
+  // Replaces the world with the entities under /World/Entities of a USD
+  // file; prim names become entity names. Prims are read in parallel on the
+  // integrator's thread count, the file's content becomes the stage in one
+  // layer copy and bodies are inserted in bulk, so no prim is redefined.
+  // False, with the world unchanged, if the file cannot be opened or has no
+  // /World/Entities.
+  bool load_usd(const std::string& path);
+#else
+  // Handle and name mirror of the entities; after load_checkpoint() it is
+  // repopulated on first access.
+  scene::SceneGraph& get_scene_graph() {
+    sync_scene();
+    return scene_graph_;
+  }
 #endif
 
-  bool create_entity(const std::string& id, const physics::RigidBody& body);
-  bool get_entity(const std::string& id, physics::RigidBody& body) const;
-  bool update_entity(const std::string& id, const physics::RigidBody& body);
+  // Entities are addressed by generational handles: lookup is one slot
+  // access, and a handle to a removed entity is rejected rather than aliasing
+  // whichever entity reuses its slot. Names are optional and only kept in a
+  // side table for the RPC and USD boundary; an unnamed entity appears in the
+  // scene as default_entity_name(handle).
+  EntityHandle create_entity(const RigidBody& body);
+  bool get_entity(EntityHandle handle, RigidBody& body) const;
+  bool update_entity(EntityHandle handle, const RigidBody& body);
+  bool remove_entity(EntityHandle handle);
+
+  // Returns a null handle if id is empty or already taken.
+  EntityHandle create_entity(const std::string& id, const RigidBody& body);
+  // Resolves a name once; null if there is no such entity.
+  EntityHandle find_entity(const std::string& id) const;
+  bool get_entity(const std::string& id, RigidBody& body) const;
+  bool update_entity(const std::string& id, const RigidBody& body);
   bool remove_entity(const std::string& id);
-  std::vector<std::string> get_all_entity_ids() const;
+
+  // Handles and names in body index order (names are empty for unnamed
+  // entities); valid until the next create/remove.
+  const std::vector<EntityHandle>& get_all_entity_handles() const { return handles_; }
+  const std::vector<std::string>& get_all_entity_ids() const;
+
+  // Batched spatial queries. Hits and overlap results carry body indices,
+  // which stay valid until the next create/remove; resolve them to ids with
+  // get_entity_id().
+  void raycast(const std::vector<physics::Ray>& rays, std::vector<physics::QueryHit>& hits) const;
+  void sweep_sphere(const std::vector<physics::SphereSweep>& sweeps, std::vector<physics::QueryHit>& hits) const;
+  void overlap_sphere(const std::vector<physics::Sphere>& spheres, physics::OverlapResults& results) const;
+  void overlap_aabb(const std::vector<physics::AABB>& boxes, physics::OverlapResults& results) const;
+
+  Integrator& get_integrator() { return integrator_; }
+  const Integrator& get_integrator() const { return integrator_; }
+
+  size_t get_entity_count() const { return bodies_.size(); }
+  const BodyStore& get_bodies() const { return bodies_; }
+  const std::string& get_entity_id(uint32_t index) const { return ids_[index]; }
+  EntityHandle get_entity_handle(uint32_t index) const { return handles_[index]; }
+  // Body index of a live entity, or EntityTable::NO_INDEX.
+  uint32_t get_body_index(EntityHandle handle) const { return entities_.find(handle); }
+  // Changes whenever entities are created, removed or replaced wholesale, so
+  // consumers can reuse copies of handles and names while it holds.
+  uint64_t get_topology_version() const { return topology_version_; }
+
+  // Change tracking for incremental consumers such as state streams. Every
+  // tick and every entity mutation advances the change version; each entity
+  // records the version it was created at, last moved at (moving bodies are
+  // marked every tick they are awake) and last had its shape or properties
+  // changed at. Removals are logged with their version until trimmed. A
+  // consumer holding the state as of version v sends what is newer than v;
+  // if v is older than get_reset_version() (reset, checkpoint or scene load,
+  // or removals dropped from a log grown past the entity count) it has to
+  // start over from the full state.
+  struct EntityChanges {
+    uint64_t created;
+    uint64_t moved;
+    uint64_t changed;
+  };
+  struct EntityRemoval {
+    EntityHandle handle;
+    // Name, or default_entity_name() for unnamed entities.
+    std::string name;
+    uint64_t created;
+    uint64_t removed;
+  };
+  uint64_t get_change_version() const { return change_version_; }
+  uint64_t get_reset_version() const { return reset_version_; }
+  // In body index order, like get_all_entity_handles().
+  const std::vector<EntityChanges>& get_entity_changes() const { return changes_; }
+  // Each entity created, moved or changed since the last trim_changes(), once,
+  // so a consumer at or after that version need not scan every entity.
+  // Entities removed since may still be listed; their handles no longer
+  // resolve.
+  const std::vector<EntityHandle>& get_changed_entities() const { return changed_; }
+  // Oldest first.
+  const std::deque<EntityRemoval>& get_removals() const { return removals_; }
+  // Drops removals and changed entities at or before version, once every
+  // consumer has seen them.
+  void trim_changes(uint64_t version);
 
   bool is_running() const { return running_; }
   uint64_t get_tick() const { return tick_; }
   double get_sim_time() const { return sim_time_; }
-  double get_fixed_dt() const { return FIXED_DT; }
+  // Step length for tick(). Larger steps stay stable for fast bodies with
+  // speculative contacts; combine with integrator sub-steps as needed.
+  void set_fixed_dt(double dt) { fixed_dt_ = dt; }
+  double get_fixed_dt() const { return fixed_dt_; }
   void reset();
 
+  // Binary checkpoint of the whole world: tick, time, step length, every
+  // body, the entity table and names (handles stay valid across a restore),
+  // the solver's warm-start cache and the query tree, so a restored world
+  // continues exactly as the saved one would have. See util::CheckpointWriter
+  // for the format.
+  void save_checkpoint(std::vector<char>& image) const;
+  bool save_checkpoint(const std::string& path) const;
+  // Replaces the world; the running flag is kept. False, with the world
+  // unchanged, if the data is not a complete and consistent checkpoint of a
+  // world with this scalar type.
+  bool load_checkpoint(const void* data, size_t size);
+  // Maps the file and restores from it.
+  bool load_checkpoint(const std::string& path);
+
 private:
+  // Fixed-size record at the front of a checkpoint.
+  struct CheckpointState {
+    uint32_t scalar_size;
+    uint32_t shape_size;
+    uint64_t body_count;
+    uint64_t tick;
+    double sim_time;
+    double fixed_dt;
+  };
+
+  void write_checkpoint(util::CheckpointWriter& writer, std::vector<uint64_t>& name_offsets,
+                        std::vector<char>& names) const;
+  EntityHandle add_entity(const std::string& id, const RigidBody& body);
+  void add_scene_entity(EntityHandle handle, const std::string& id, const RigidBody& body);
+  // Repopulates a scene mirror that load_checkpoint() left empty.
+  void sync_scene();
+  // Rebuilds names_ after load_checkpoint() on the first lookup by name.
+  void index_names() const;
+  void wake_supported(uint32_t index);
+  // Lists the entity in changed_ unless it already is; call before advancing
+  // its change versions.
+  void note_change(uint32_t index);
+  // Starts change tracking over: every entity counts as new.
+  void mark_all_created();
+
 #ifdef USD_FOUND
   scene::USDScene scene_;
+  uint32_t scene_flush_interval_ = 1;
 #else
   scene::SceneGraph scene_graph_;
-  std::unordered_map<std::string, physics::RigidBody> entities_;
 #endif
-  physics::Integrator integrator_;
+  bool scene_stale_ = false;
+  BodyStore bodies_;
+  physics::SceneQuery scene_query_;
+  EntityTable entities_;
+  std::vector<EntityHandle> handles_;
+  std::vector<std::string> ids_;
+  mutable std::unordered_map<std::string, EntityHandle> names_;
+  mutable bool names_indexed_ = true;
+  std::vector<EntityChanges> changes_;
+  std::vector<EntityHandle> changed_;
+  uint64_t changed_since_ = 0;
+  std::deque<EntityRemoval> removals_;
+  uint64_t change_version_ = 0;
+  uint64_t reset_version_ = 0;
+  Integrator integrator_;
   bool running_;
+  uint64_t topology_version_ = 0;
   uint64_t tick_;
   double sim_time_;
+  double fixed_dt_;
 };
 
+using Simulator = SimulatorT<double>;
+
 }
 
@@ -0,0 +1,117 @@
+#include "usd_async_export.h"
+#include <chrono>
+
+#ifdef USD_FOUND
+#include "../scene/usd_scene.h"
+#include "usd_file_export.h"
+#endif
+
+namespace navora::usd {
+
+AsyncExporter::AsyncExporter() : worker_(&AsyncExporter::work, this) {}
+
+AsyncExporter::~AsyncExporter() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  wake_.notify_one();
+  worker_.join();
+}
+
+std::future<ExportResult> AsyncExporter::submit(SceneSnapshot snapshot, const std::string& path, Callback done) {
+  auto job = std::make_unique<Job>();
+  job->snapshot = std::move(snapshot);
+  job->path = path;
+  job->done = std::move(done);
+  std::future<ExportResult> future = job->result.get_future();
+
+  std::unique_ptr<Job> replaced;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& queued : queue_) {
+      if (queued->path == path) {
+        replaced = std::move(queued);
+        queued = std::move(job);
+        status_.superseded++;
+        break;
+      }
+    }
+    if (job) queue_.push_back(std::move(job));
+  }
+  wake_.notify_one();
+
+  if (replaced) {
+    ExportResult result;
+    result.path = replaced->path;
+    result.tick = replaced->snapshot.tick;
+    result.error = "Superseded by a newer export";
+    if (replaced->done) replaced->done(result);
+    replaced->result.set_value(std::move(result));
+  }
+  return future;
+}
+
+ExportStatus AsyncExporter::get_status() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ExportStatus status = status_;
+  status.busy = busy_;
+  status.queued = queue_.size();
+  return status;
+}
+
+void AsyncExporter::wait_idle() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  idle_.wait(lock, [this] { return queue_.empty() && !busy_; });
+}
+
+void AsyncExporter::work() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    wake_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+    if (queue_.empty()) return;
+
+    std::unique_ptr<Job> job = std::move(queue_.front());
+    queue_.pop_front();
+    busy_ = true;
+    lock.unlock();
+
+    ExportResult result = write(job->snapshot, job->path);
+    // Release the snapshot before reporting.
+    job->snapshot = SceneSnapshot();
+    if (job->done) job->done(result);
+
+    lock.lock();
+    busy_ = false;
+    (result.success ? status_.completed : status_.failed)++;
+    status_.last = result;
+    job->result.set_value(std::move(result));
+    if (queue_.empty()) idle_.notify_all();
+  }
+}
+
+ExportResult AsyncExporter::write(const SceneSnapshot& snapshot, const std::string& path) {
+  const auto start = std::chrono::steady_clock::now();
+  ExportResult result;
+  result.path = path;
+  result.tick = snapshot.tick;
+
+#ifdef USD_FOUND
+  scene::USDScene scene;
+  const std::vector<EntityHandle>& handles = *snapshot.handles;
+  const std::vector<std::string>& ids = *snapshot.ids;
+  for (size_t i = 0; i < snapshot.bodies.size(); ++i) {
+    scene.create_entity(handles[i], ids[i].empty() ? default_entity_name(handles[i]) : ids[i], snapshot.bodies[i]);
+  }
+  result.success = USDFileExporter().export_to_file(scene, path);
+  if (!result.success) result.error = "Failed to write " + path;
+#else
+  result.success = USDExporter().export_snapshot(snapshot, path);
+  if (!result.success) result.error = "Failed to write " + path;
+#endif
+
+  result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return result;
+}
+
+}
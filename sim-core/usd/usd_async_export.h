@@ -0,0 +1,129 @@
+#pragma once
+
+#include "../entity_handle.h"
+#include "../physics/rigid_body.h"
+#include "../simulator.h"
+#include "usd_export.h"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace navora::usd {
+
+struct ExportResult {
+  bool success = false;
+  std::string path;
+  std::string error;
+  uint64_t tick = 0;
+  // Wall time spent authoring and writing.
+  double seconds = 0.0;
+};
+
+struct ExportStatus {
+  // A snapshot is being written.
+  bool busy = false;
+  // Snapshots waiting behind it.
+  size_t queued = 0;
+  uint64_t completed = 0;
+  uint64_t failed = 0;
+  // Queued exports replaced by a newer one to the same path.
+  uint64_t superseded = 0;
+  ExportResult last;
+};
+
+// Writes scene files on a background thread. export_async() only copies the
+// body state (handles and names are reused while the topology is unchanged),
+// so it is cheap enough to call from the tick loop under the simulation lock;
+// authoring and file writing never block the caller. A queued export is
+// replaced by a newer one to the same path, so periodic exports of a slow
+// scene cannot pile up. The destructor finishes every queued export.
+class AsyncExporter {
+public:
+  using Callback = std::function<void(const ExportResult&)>;
+
+  AsyncExporter();
+  ~AsyncExporter();
+
+  AsyncExporter(const AsyncExporter&) = delete;
+  AsyncExporter& operator=(const AsyncExporter&) = delete;
+
+  // With USD the format follows the extension, as for USDFileExporter;
+  // without it the file is always USDA text from USDExporter. done runs on
+  // the worker thread.
+  template <typename T>
+  std::future<ExportResult> export_async(const SimulatorT<T>& sim, const std::string& path,
+                                         Callback done = Callback()) {
+    SceneSnapshot snapshot;
+    capture(sim, snapshot);
+    return submit(std::move(snapshot), path, std::move(done));
+  }
+
+  std::future<ExportResult> submit(SceneSnapshot snapshot, const std::string& path, Callback done = Callback());
+
+  ExportStatus get_status() const;
+  // Blocks until every queued export has been written.
+  void wait_idle();
+
+  // Writes a snapshot on the calling thread.
+  static ExportResult write(const SceneSnapshot& snapshot, const std::string& path);
+
+private:
+  struct Job {
+    SceneSnapshot snapshot;
+    std::string path;
+    Callback done;
+    std::promise<ExportResult> result;
+  };
+
+  template <typename T>
+  void capture(const SimulatorT<T>& sim, SceneSnapshot& snapshot) {
+    snapshot.tick = sim.get_tick();
+    snapshot.sim_time = sim.get_sim_time();
+    snapshot.fixed_dt = sim.get_fixed_dt();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (source_ != &sim || source_version_ != sim.get_topology_version() || !handles_) {
+        handles_ = std::make_shared<const std::vector<EntityHandle>>(sim.get_all_entity_handles());
+        ids_ = std::make_shared<const std::vector<std::string>>(sim.get_all_entity_ids());
+        source_ = &sim;
+        source_version_ = sim.get_topology_version();
+      }
+      snapshot.handles = handles_;
+      snapshot.ids = ids_;
+    }
+    const auto& bodies = sim.get_bodies();
+    snapshot.bodies.resize(bodies.size());
+    typename SimulatorT<T>::RigidBody body;
+    for (uint32_t i = 0; i < bodies.size(); ++i) {
+      bodies.get(i, body);
+      snapshot.bodies[i] = physics::RigidBody(body);
+    }
+  }
+
+  void work();
+
+  mutable std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable idle_;
+  std::deque<std::unique_ptr<Job>> queue_;
+  bool busy_ = false;
+  bool stopping_ = false;
+  ExportStatus status_;
+
+  // Shared copies from the last capture.
+  const void* source_ = nullptr;
+  uint64_t source_version_ = 0;
+  std::shared_ptr<const std::vector<EntityHandle>> handles_;
+  std::shared_ptr<const std::vector<std::string>> ids_;
+
+  std::thread worker_;
+};
+
+}
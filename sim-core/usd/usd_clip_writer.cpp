@@ -0,0 +1,154 @@
+#include "usd_clip_writer.h"
+#include <pxr/base/gf/vec2d.h>
+#include <pxr/base/vt/array.h>
+#include <pxr/base/vt/types.h>
+#include <pxr/usd/sdf/assetPath.h>
+#include <pxr/usd/sdf/attributeSpec.h>
+#include <pxr/usd/sdf/changeBlock.h>
+#include <pxr/usd/sdf/primSpec.h>
+#include <pxr/usd/sdf/types.h>
+#include <pxr/usd/usd/clipsAPI.h>
+#include <algorithm>
+#include <cstdio>
+
+namespace navora::usd {
+
+namespace {
+
+const pxr::SdfPath& clip_root() {
+  static const pxr::SdfPath path("/World/Entities");
+  return path;
+}
+
+}
+
+USDClipWriter::USDClipWriter(scene::USDScene& scene, const std::string& directory, const std::string& name,
+                             size_t frames_per_clip)
+  : scene_(scene), directory_(directory), name_(name), frames_per_clip_(std::max<size_t>(frames_per_clip, 1)) {
+  topology_path_ = directory_ + "/" + name_ + ".usda";
+  manifest_path_ = directory_ + "/" + name_ + ".manifest.usda";
+  manifest_ = pxr::SdfLayer::CreateAnonymous(".usda");
+}
+
+bool USDClipWriter::begin_frame(double time, double dt) {
+  if (!ok_) return false;
+  if (frame_count_ == 0) {
+    rate_ = dt > 0.0 ? 1.0 / dt : 1.0 / Simulator::FIXED_DT;
+    auto layer = scene_.get_stage()->GetRootLayer();
+    layer->SetTimeCodesPerSecond(rate_);
+    layer->SetFramesPerSecond(rate_);
+    start_time_ = time;
+  }
+  if (!clip_ && !open_clip(time)) return false;
+  time_ = time;
+  return true;
+}
+
+void USDClipWriter::add_sample(EntityHandle handle, const pxr::GfVec3d& translate, const pxr::GfQuatd& orient) {
+  samples_.push_back({handle, translate, orient});
+}
+
+bool USDClipWriter::end_frame() {
+  const int64_t clip = static_cast<int64_t>(clips_.size()) - 1;
+  {
+    pxr::SdfChangeBlock block;
+    for (const Sample& sample : samples_) {
+      const EntityHandle handle = sample.handle;
+      if (handle.index >= tracks_.size()) tracks_.resize(handle.index + 1);
+      Track& track = tracks_[handle.index];
+      if (track.generation != handle.generation) {
+        const pxr::SdfPath path = scene_.get_entity_path(handle);
+        if (path.IsEmpty()) continue;
+        track.generation = handle.generation;
+        track.clip = -1;
+        track.prim = path;
+        track.translate = path.AppendProperty(pxr::TfToken("xformOp:translate"));
+        track.orient = path.AppendProperty(pxr::TfToken("xformOp:orient"));
+        define_attributes(manifest_, track);
+      }
+      if (track.clip != clip) {
+        define_attributes(clip_, track);
+        track.clip = clip;
+      }
+      clip_->SetTimeSample(track.translate, time_, sample.translate);
+      clip_->SetTimeSample(track.orient, time_, sample.orient);
+    }
+  }
+  samples_.clear();
+
+  clips_.back().end_time = time_;
+  frame_count_++;
+  if (++clip_frames_ >= frames_per_clip_) return close_clip();
+  return true;
+}
+
+bool USDClipWriter::open_clip(double time) {
+  char suffix[32];
+  std::snprintf(suffix, sizeof(suffix), ".clip.%04zu.usdc", clips_.size());
+  const std::string file = name_ + suffix;
+  clip_ = pxr::SdfLayer::CreateNew(directory_ + "/" + file);
+  if (!clip_) {
+    ok_ = false;
+    return false;
+  }
+  clip_->SetTimeCodesPerSecond(rate_);
+  clips_.push_back({"./" + file, time, time});
+  clip_frames_ = 0;
+  return true;
+}
+
+// Saves the clip and drops it from memory, then restitches the topology so
+// it covers the new clip.
+bool USDClipWriter::close_clip() {
+  if (!clip_) return true;
+  ok_ = clip_->Save() && ok_;
+  clip_.Reset();
+  return write_topology() && ok_;
+}
+
+bool USDClipWriter::finish() {
+  if (clip_) return close_clip();
+  return ok_;
+}
+
+bool USDClipWriter::write_topology() {
+  if (clips_.empty()) return ok_;
+  ok_ = manifest_->Export(manifest_path_) && ok_;
+
+  // Clip k is active from its first frame and maps stage time to the same
+  // clip time.
+  pxr::VtArray<pxr::SdfAssetPath> asset_paths;
+  pxr::VtVec2dArray active;
+  pxr::VtVec2dArray times;
+  for (size_t k = 0; k < clips_.size(); ++k) {
+    const Clip& clip = clips_[k];
+    asset_paths.push_back(pxr::SdfAssetPath(clip.asset_path));
+    active.push_back(pxr::GfVec2d(clip.start_time, static_cast<double>(k)));
+    times.push_back(pxr::GfVec2d(clip.start_time, clip.start_time));
+    times.push_back(pxr::GfVec2d(clip.end_time, clip.end_time));
+  }
+
+  auto stage = scene_.get_stage();
+  pxr::UsdClipsAPI clips(stage->GetPrimAtPath(clip_root()));
+  clips.SetClipAssetPaths(asset_paths);
+  clips.SetClipPrimPath(clip_root().GetString());
+  clips.SetClipActive(active);
+  clips.SetClipTimes(times);
+  clips.SetClipManifestAssetPath(pxr::SdfAssetPath("./" + name_ + ".manifest.usda"));
+
+  auto layer = stage->GetRootLayer();
+  layer->SetStartTimeCode(start_time_);
+  layer->SetEndTimeCode(clips_.back().end_time);
+  ok_ = layer->Export(topology_path_) && ok_;
+  return ok_;
+}
+
+// An entity recreated under a previous entity's name reuses its specs.
+void USDClipWriter::define_attributes(const pxr::SdfLayerRefPtr& layer, const Track& track) {
+  if (layer->GetAttributeAtPath(track.translate)) return;
+  pxr::SdfPrimSpecHandle prim = pxr::SdfCreatePrimInLayer(layer, track.prim);
+  pxr::SdfAttributeSpec::New(prim, track.translate.GetName(), pxr::SdfValueTypeNames->Double3);
+  pxr::SdfAttributeSpec::New(prim, track.orient.GetName(), pxr::SdfValueTypeNames->Quatd);
+}
+
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "../scene/usd_scene.h"
+#include "../simulator.h"
+#include <pxr/base/gf/quatd.h>
+#include <pxr/base/gf/vec3d.h>
+#include <pxr/usd/sdf/layer.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace navora::usd {
+
+// Streams a recording to disk as USD value clips so memory stays bounded
+// however long the run is. Translate/orient samples go into a clip layer
+// that is saved as <directory>/<name>.clip.NNNN.usdc and released every
+// frames_per_clip frames. A manifest layer declaring the sampled attributes
+// and the topology layer <directory>/<name>.usda, which is the scene's stage
+// plus the clip metadata on /World/Entities, are rewritten at every roll, so
+// the output on disk is always a complete, openable recording.
+//
+// The in-memory stage only holds topology and current values. Static bodies
+// are not sampled; their stage values apply for the whole recording.
+class USDClipWriter {
+public:
+  static constexpr size_t DEFAULT_FRAMES_PER_CLIP = 600;
+
+  USDClipWriter(scene::USDScene& scene, const std::string& directory, const std::string& name,
+                size_t frames_per_clip = DEFAULT_FRAMES_PER_CLIP);
+  ~USDClipWriter() { finish(); }
+
+  USDClipWriter(const USDClipWriter&) = delete;
+  USDClipWriter& operator=(const USDClipWriter&) = delete;
+
+  // Appends the current state at time code sim.get_tick(); false once a
+  // write has failed.
+  template <typename T>
+  bool record(const SimulatorT<T>& sim) {
+    if (!begin_frame(static_cast<double>(sim.get_tick()), sim.get_fixed_dt())) return false;
+    const auto& bodies = sim.get_bodies();
+    for (uint32_t i = 0; i < bodies.size(); ++i) {
+      if (bodies.is_static(i)) continue;
+      const auto& position = bodies.position[i];
+      const auto& rotation = bodies.rotation[i];
+      add_sample(sim.get_entity_handle(i), pxr::GfVec3d(position.x, position.y, position.z),
+                 pxr::GfQuatd(rotation.w, rotation.x, rotation.y, rotation.z));
+    }
+    return end_frame();
+  }
+
+  // Saves the open clip and the topology; recording may continue after.
+  bool finish();
+
+  const std::string& get_topology_path() const { return topology_path_; }
+  size_t get_clip_count() const { return clips_.size(); }
+  uint64_t get_frame_count() const { return frame_count_; }
+  bool ok() const { return ok_; }
+
+private:
+  struct Sample {
+    EntityHandle handle;
+    pxr::GfVec3d translate;
+    pxr::GfQuatd orient;
+  };
+
+  struct Clip {
+    std::string asset_path;
+    double start_time;
+    double end_time;
+  };
+
+  // Attribute paths of the entity last seen in a handle slot; index of the
+  // clip whose specs were created for it.
+  struct Track {
+    uint32_t generation = 0;
+    int64_t clip = -1;
+    pxr::SdfPath prim;
+    pxr::SdfPath translate;
+    pxr::SdfPath orient;
+  };
+
+  bool begin_frame(double time, double dt);
+  void add_sample(EntityHandle handle, const pxr::GfVec3d& translate, const pxr::GfQuatd& orient);
+  bool end_frame();
+  bool open_clip(double time);
+  bool close_clip();
+  bool write_topology();
+  static void define_attributes(const pxr::SdfLayerRefPtr& layer, const Track& track);
+
+  scene::USDScene& scene_;
+  std::string directory_;
+  std::string name_;
+  std::string topology_path_;
+  std::string manifest_path_;
+  size_t frames_per_clip_;
+
+  pxr::SdfLayerRefPtr clip_;
+  pxr::SdfLayerRefPtr manifest_;
+  std::vector<Clip> clips_;
+  std::vector<Track> tracks_;
+  // The frame being recorded; authored in one change block by end_frame().
+  std::vector<Sample> samples_;
+  size_t clip_frames_ = 0;
+  double rate_ = 1.0 / Simulator::FIXED_DT;
+  double time_ = 0.0;
+  double start_time_ = 0.0;
+  uint64_t frame_count_ = 0;
+  bool ok_ = true;
+};
+
+}
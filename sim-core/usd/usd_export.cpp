@@ -1,47 +1,172 @@
 #include "usd_export.h"
-#include "../physics/rigid_body.h"
+#include <cmath>
+#include <fcntl.h>
+#include <sstream>
+#include <unistd.h>
 
 namespace navora::usd {
 
+namespace {
+
+// Half-size of the quad standing in for an infinite plane.
+constexpr double PLANE_EXTENT = 100.0;
+
+physics::Vector3 cross(const physics::Vector3& a, const physics::Vector3& b) {
+  return physics::Vector3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+
+}
+
+void plane_quad(const physics::CollisionShape& shape, physics::Vector3 corners[4]) {
+  // Spanned by two tangents of the normal, through normal * offset.
+  physics::Vector3 normal = shape.normal.normalized();
+  physics::Vector3 axis = std::abs(normal.x) < 0.9 ? physics::Vector3(1, 0, 0) : physics::Vector3(0, 1, 0);
+  physics::Vector3 u = cross(axis, normal).normalized() * PLANE_EXTENT;
+  physics::Vector3 v = cross(normal, u);
+  physics::Vector3 center = normal * shape.offset;
+  corners[0] = center - u - v;
+  corners[1] = center + u - v;
+  corners[2] = center + u + v;
+  corners[3] = center - u + v;
+}
+
+bool USDExporter::export_scene(const scene::SceneGraph& graph, UsdaWriter& out) const {
+  out.text("#usda 1.0\n\n");
+  out.text("def Xform \"World\" {\n");
+
+  for (const scene::Entity* entity : graph.get_all_entities()) {
+    if (entity->parent.is_null()) {
+      export_entity(entity, graph, out, 1);
+    }
+  }
+
+  out.text("}\n");
+  return out.flush();
+}
+
 std::string USDExporter::export_scene(const scene::SceneGraph& graph) const {
-  std::string result = "#usda 1.0\n\n";
-  result += "def Xform \"World\" {\n";
+  std::ostringstream stream;
+  {
+    UsdaWriter out(stream);
+    export_scene(graph, out);
+  }
+  return stream.str();
+}
 
-  auto entities = graph.get_all_entities();
-  for (auto* entity : entities) {
-    if (entity->parent_id.empty()) {
-      result += export_entity(entity, graph, "    ");
+void USDExporter::export_entity(const scene::Entity* entity, const scene::SceneGraph& graph, UsdaWriter& out,
+                                int depth) const {
+  write_entity_begin(out, entity->id, depth);
+  write_transform(out, entity->body.transform, depth + 1);
+  write_op_order(out, depth + 1);
+  write_shape(out, entity->body.shape, depth + 1);
+
+  for (EntityHandle child_handle : entity->children) {
+    const scene::Entity* child = graph.get_entity(child_handle);
+    if (child) {
+      export_entity(child, graph, out, depth + 1);
     }
   }
 
-  result += "}\n";
-  return result;
+  write_entity_end(out, depth);
 }
 
-std::string USDExporter::export_entity(const scene::Entity* entity, const scene::SceneGraph& graph, const std::string& indent) const {
-  std::string result = indent + "def Xform \"" + entity->id + "\" {\n";
-  result += indent + "    double3 xformOp:translate = (" +
-            std::to_string(entity->body.transform.position.x) + ", " +
-            std::to_string(entity->body.transform.position.y) + ", " +
-            std::to_string(entity->body.transform.position.z) + ")\n";
-  result += indent + "    uniform token[] xformOpOrder = [\"xformOp:translate\"]\n";
+bool USDExporter::export_snapshot(const SceneSnapshot& snapshot, UsdaWriter& out) const {
+  const double rate = snapshot.fixed_dt > 0.0 ? 1.0 / snapshot.fixed_dt : 60.0;
+  const double time = static_cast<double>(snapshot.tick);
+  write_header(out, rate, time, time);
+  out.text("def Xform \"World\" {\n");
+  out.indent(1).text("def Xform \"Entities\" {\n");
 
-  if (entity->body.shape.type == physics::ShapeType::SPHERE) {
-    result += indent + "    def Sphere \"Shape\" {\n";
-    result += indent + "        double radius = " + std::to_string(entity->body.shape.size.x) + "\n";
-    result += indent + "    }\n";
+  const std::vector<EntityHandle>& handles = *snapshot.handles;
+  const std::vector<std::string>& ids = *snapshot.ids;
+  for (size_t i = 0; i < snapshot.bodies.size(); ++i) {
+    const physics::RigidBody& body = snapshot.bodies[i];
+    write_entity_begin(out, ids[i].empty() ? default_entity_name(handles[i]) : ids[i], 2);
+    write_transform(out, body.transform, 3);
+    write_op_order(out, 3);
+    write_shape(out, body.shape, 3);
+    write_entity_end(out, 2);
   }
 
-    for (const auto& child_id : entity->child_ids) {
-      const scene::Entity* child = graph.get_entity(child_id);
-      if (child) {
-        result += export_entity(child, graph, indent + "    ");
-      }
-    }
+  out.indent(1).text("}\n");
+  out.text("}\n");
+  return out.flush();
+}
+
+bool USDExporter::export_snapshot(const SceneSnapshot& snapshot, const std::string& path) const {
+  int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) return false;
+  bool ok;
+  {
+    UsdaWriter out(fd);
+    ok = export_snapshot(snapshot, out);
+  }
+  return ::close(fd) == 0 && ok;
+}
+
+void USDExporter::write_header(UsdaWriter& out, double time_codes_per_second, double start_time, double end_time) {
+  out.text("#usda 1.0\n(\n");
+  out.indent(1).text("defaultPrim = \"World\"\n");
+  out.indent(1).text("startTimeCode = ").number(start_time).text("\n");
+  out.indent(1).text("endTimeCode = ").number(end_time).text("\n");
+  out.indent(1).text("timeCodesPerSecond = ").number(time_codes_per_second).text("\n");
+  out.indent(1).text("framesPerSecond = ").number(time_codes_per_second).text("\n");
+  out.text(")\n\n");
+}
+
+void USDExporter::write_entity_begin(UsdaWriter& out, std::string_view name, int depth) {
+  out.indent(depth).text("def Xform \"").text(name).text("\" {\n");
+}
 
-  result += indent + "}\n";
-  return result;
+void USDExporter::write_entity_end(UsdaWriter& out, int depth) {
+  out.indent(depth).text("}\n");
 }
 
+void USDExporter::write_transform(UsdaWriter& out, const physics::Transform& transform, int depth) {
+  const auto& p = transform.position;
+  const auto& r = transform.rotation;
+  const auto& s = transform.scale;
+  out.indent(depth).text("double3 xformOp:translate = ").tuple(p.x, p.y, p.z).text("\n");
+  out.indent(depth).text("quatd xformOp:orient = ").tuple(r.w, r.x, r.y, r.z).text("\n");
+  out.indent(depth).text("double3 xformOp:scale = ").tuple(s.x, s.y, s.z).text("\n");
 }
 
+void USDExporter::write_op_order(UsdaWriter& out, int depth) {
+  out.indent(depth).text("uniform token[] xformOpOrder = [\"xformOp:translate\", \"xformOp:orient\", \"xformOp:scale\"]\n");
+}
+
+void USDExporter::write_shape(UsdaWriter& out, const physics::CollisionShape& shape, int depth) {
+  switch (shape.type) {
+    case physics::ShapeType::SPHERE:
+      out.indent(depth).text("def Sphere \"Shape\" {\n");
+      out.indent(depth + 1).text("double radius = ").number(shape.size.x).text("\n");
+      out.indent(depth).text("}\n");
+      break;
+    case physics::ShapeType::AABB:
+      // A unit cube scaled to the full extents.
+      out.indent(depth).text("def Cube \"Shape\" {\n");
+      out.indent(depth + 1).text("double size = 1\n");
+      out.indent(depth + 1).text("double3 xformOp:scale = ")
+          .tuple(2.0 * shape.size.x, 2.0 * shape.size.y, 2.0 * shape.size.z).text("\n");
+      out.indent(depth + 1).text("uniform token[] xformOpOrder = [\"xformOp:scale\"]\n");
+      out.indent(depth).text("}\n");
+      break;
+    case physics::ShapeType::PLANE: {
+      physics::Vector3 corners[4];
+      plane_quad(shape, corners);
+      out.indent(depth).text("def Mesh \"Shape\" {\n");
+      out.indent(depth + 1).text("int[] faceVertexCounts = [4]\n");
+      out.indent(depth + 1).text("int[] faceVertexIndices = [0, 1, 2, 3]\n");
+      out.indent(depth + 1).text("point3f[] points = [");
+      for (int k = 0; k < 4; ++k) {
+        if (k > 0) out.text(", ");
+        out.tuple(static_cast<float>(corners[k].x), static_cast<float>(corners[k].y), static_cast<float>(corners[k].z));
+      }
+      out.text("]\n");
+      out.indent(depth).text("}\n");
+      break;
+    }
+  }
+}
+
+}
@@ -1,7 +1,13 @@
 #pragma once
 
+#include "../entity_handle.h"
+#include "../physics/rigid_body.h"
 #include "../scene/scene_graph.h"
+#include "usda_writer.h"
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace navora::usd {
@@ -13,13 +19,46 @@ struct USDNode {
   std::vector<std::string> children;
 };
 
+// A world's exportable state at a tick boundary. Handles and names are shared
+// between snapshots while the world's topology is unchanged.
+struct SceneSnapshot {
+  uint64_t tick = 0;
+  double sim_time = 0.0;
+  double fixed_dt = 0.0;
+  std::shared_ptr<const std::vector<EntityHandle>> handles;
+  std::shared_ptr<const std::vector<std::string>> ids;
+  std::vector<physics::RigidBody> bodies;
+};
+
+// Corners of the quad that stands in for an infinite plane in exported
+// scenes, in the body's local frame and wound counter-clockwise about the
+// plane normal.
+void plane_quad(const physics::CollisionShape& shape, physics::Vector3 corners[4]);
+
+// Text USDA export that needs no USD install. Documents are streamed through
+// a UsdaWriter, so memory stays flat however large the scene is. Entities get
+// the same prim layout as USDScene: a translate/orient/scale op stack and a
+// Shape child (Sphere, Cube for AABB, Mesh quad for PLANE).
 class USDExporter {
 public:
+  // The scene graph's hierarchy under /World.
+  bool export_scene(const scene::SceneGraph& graph, UsdaWriter& out) const;
   std::string export_scene(const scene::SceneGraph& graph) const;
 
+  // A snapshot under /World/Entities, the layout USDScene builds.
+  bool export_snapshot(const SceneSnapshot& snapshot, UsdaWriter& out) const;
+  bool export_snapshot(const SceneSnapshot& snapshot, const std::string& path) const;
+
+  // Building blocks shared with UsdaRecorder.
+  static void write_header(UsdaWriter& out, double time_codes_per_second, double start_time, double end_time);
+  static void write_entity_begin(UsdaWriter& out, std::string_view name, int depth);
+  static void write_entity_end(UsdaWriter& out, int depth);
+  static void write_transform(UsdaWriter& out, const physics::Transform& transform, int depth);
+  static void write_op_order(UsdaWriter& out, int depth);
+  static void write_shape(UsdaWriter& out, const physics::CollisionShape& shape, int depth);
+
 private:
-  std::string export_entity(const scene::Entity* entity, const scene::SceneGraph& graph, const std::string& indent) const;
+  void export_entity(const scene::Entity* entity, const scene::SceneGraph& graph, UsdaWriter& out, int depth) const;
 };
 
 }
-
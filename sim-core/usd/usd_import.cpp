@@ -0,0 +1,121 @@
+#include "usd_import.h"
+#include <pxr/base/gf/matrix4d.h>
+#include <pxr/base/gf/transform.h>
+#include <pxr/base/gf/vec3f.h>
+#include <pxr/usd/usdGeom/cube.h>
+#include <pxr/usd/usdGeom/mesh.h>
+#include <pxr/usd/usdGeom/sphere.h>
+#include <pxr/usd/usdGeom/xformable.h>
+#include <pxr/usd/usdPhysics/collisionAPI.h>
+#include <pxr/usd/usdPhysics/massAPI.h>
+#include <pxr/usd/usdPhysics/rigidBodyAPI.h>
+
+namespace navora::usd {
+
+namespace {
+
+physics::Vector3 to_vector(const pxr::GfVec3d& v) {
+  return physics::Vector3(v[0], v[1], v[2]);
+}
+
+physics::Vector3 to_vector(const pxr::GfVec3f& v) {
+  return physics::Vector3(v[0], v[1], v[2]);
+}
+
+void read_transform(const pxr::UsdPrim& prim, physics::Transform& transform) {
+  pxr::GfMatrix4d local(1.0);
+  bool reset_stack = false;
+  pxr::UsdGeomXformable(prim).GetLocalTransformation(&local, &reset_stack);
+  const pxr::GfTransform decomposed(local);
+  const pxr::GfQuatd rotation = decomposed.GetRotation().GetQuat();
+  transform.position = to_vector(decomposed.GetTranslation());
+  transform.rotation = physics::Quaternion(rotation.GetImaginary()[0], rotation.GetImaginary()[1],
+                                           rotation.GetImaginary()[2], rotation.GetReal());
+  transform.scale = to_vector(decomposed.GetScale());
+}
+
+bool read_shape(const pxr::UsdPrim& prim, physics::CollisionShape& shape) {
+  for (const pxr::UsdPrim& child : prim.GetChildren()) {
+    if (pxr::UsdGeomSphere sphere{child}) {
+      double radius = 1.0;
+      sphere.GetRadiusAttr().Get(&radius);
+      shape.type = physics::ShapeType::SPHERE;
+      shape.size = physics::Vector3(radius, radius, radius);
+      return true;
+    }
+    if (pxr::UsdGeomCube cube{child}) {
+      double size = 2.0;
+      cube.GetSizeAttr().Get(&size);
+      physics::Transform local;
+      read_transform(child, local);
+      shape.type = physics::ShapeType::AABB;
+      shape.size = physics::Vector3(0.5 * size * local.scale.x, 0.5 * size * local.scale.y, 0.5 * size * local.scale.z);
+      return true;
+    }
+    if (pxr::UsdGeomMesh mesh{child}) {
+      pxr::VtVec3fArray points;
+      if (!mesh.GetPointsAttr().Get(&points) || points.size() < 3) continue;
+      const physics::Vector3 a = to_vector(points[0]);
+      const physics::Vector3 e1 = to_vector(points[1]) - a;
+      const physics::Vector3 e2 = to_vector(points[2]) - a;
+      const physics::Vector3 normal = physics::Vector3(e1.y * e2.z - e1.z * e2.y, e1.z * e2.x - e1.x * e2.z,
+                                                       e1.x * e2.y - e1.y * e2.x).normalized();
+      if (normal.length_squared() == 0.0) continue;
+      shape.type = physics::ShapeType::PLANE;
+      shape.normal = normal;
+      shape.offset = normal.dot(a);
+      return true;
+    }
+  }
+  return false;
+}
+
+void read_entity(const pxr::UsdPrim& prim, ImportedEntity& entity) {
+  entity.path = prim.GetPath();
+  entity.name = prim.GetName().GetString();
+  physics::RigidBody& body = entity.body;
+  read_transform(prim, body.transform);
+  read_shape(prim, body.shape);
+
+  bool is_static = true;
+  if (prim.HasAPI<pxr::UsdPhysicsRigidBodyAPI>()) {
+    pxr::UsdPhysicsRigidBodyAPI rigid_body(prim);
+    bool enabled = true;
+    rigid_body.GetRigidBodyEnabledAttr().Get(&enabled);
+    is_static = !enabled;
+    pxr::GfVec3f velocity;
+    if (rigid_body.GetVelocityAttr().Get(&velocity)) body.linear_velocity = to_vector(velocity);
+    if (rigid_body.GetAngularVelocityAttr().Get(&velocity)) body.angular_velocity = to_vector(velocity);
+  }
+  if (prim.HasAPI<pxr::UsdPhysicsCollisionAPI>()) {
+    bool collision_enabled = true;
+    pxr::UsdPhysicsCollisionAPI(prim).GetCollisionEnabledAttr().Get(&collision_enabled);
+    is_static = is_static || !collision_enabled;
+  }
+  body.is_static = is_static;
+
+  // UsdPhysics reads a zero mass as "derive from density"; keep the default.
+  float mass = 0.0f;
+  if (prim.HasAPI<pxr::UsdPhysicsMassAPI>() && pxr::UsdPhysicsMassAPI(prim).GetMassAttr().Get(&mass) && mass > 0.0f) {
+    body.mass = mass;
+  }
+  body.inv_mass = body.is_static ? 0.0 : 1.0 / body.mass;
+}
+
+}
+
+bool import_entities(const pxr::UsdStageRefPtr& stage, util::ThreadPool& pool, std::vector<ImportedEntity>& entities) {
+  entities.clear();
+  pxr::UsdPrim root = stage->GetPrimAtPath(pxr::SdfPath("/World/Entities"));
+  if (!root) return false;
+
+  std::vector<pxr::UsdPrim> prims;
+  for (const pxr::UsdPrim& child : root.GetChildren()) {
+    if (child.IsA<pxr::UsdGeomXformable>()) prims.push_back(child);
+  }
+  entities.resize(prims.size());
+  pool.parallel_for(prims.size(), [&](size_t i) { read_entity(prims[i], entities[i]); });
+  return true;
+}
+
+}
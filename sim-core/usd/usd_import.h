@@ -0,0 +1,31 @@
+#pragma once
+
+#include "../physics/rigid_body.h"
+#include "../util/thread_pool.h"
+#include <pxr/usd/usd/stage.h>
+#include <string>
+#include <vector>
+
+namespace navora::usd {
+
+struct ImportedEntity {
+  pxr::SdfPath path;
+  std::string name;
+  physics::RigidBody body;
+};
+
+// Reads the children of /World/Entities into bodies, one prim subtree per
+// task on pool; the stage is only read, which USD allows concurrently.
+// Understands the layout USDScene and USDExporter write as well as plain
+// UsdPhysics scenes:
+//   - the prim's local transform (any op stack),
+//   - RigidBodyAPI velocities; a prim without the API, or with it disabled,
+//     is static, as is one with collisions disabled,
+//   - MassAPI mass,
+//   - a Sphere, Cube or Mesh child as SPHERE, AABB or PLANE (the plane
+//     through the mesh's first three points).
+// Entities come back in prim order. False if the stage has no
+// /World/Entities.
+bool import_entities(const pxr::UsdStageRefPtr& stage, util::ThreadPool& pool, std::vector<ImportedEntity>& entities);
+
+}
@@ -0,0 +1,73 @@
+#include "usd_recorder.h"
+#include <pxr/usd/sdf/changeBlock.h>
+#include <algorithm>
+
+namespace navora::usd {
+
+USDRecorder::USDRecorder(scene::USDScene& scene, size_t batch_frames)
+  : scene_(scene), layer_(scene.get_stage()->GetRootLayer()), batch_frames_(std::max<size_t>(batch_frames, 1)) {}
+
+void USDRecorder::begin_frame(double time, double dt) {
+  if (frame_count_ == 0) {
+    const double rate = dt > 0.0 ? 1.0 / dt : 1.0 / Simulator::FIXED_DT;
+    layer_->SetTimeCodesPerSecond(rate);
+    layer_->SetFramesPerSecond(rate);
+    layer_->SetStartTimeCode(time);
+    start_time_ = time;
+  }
+  end_time_ = time;
+  frames_.push_back({time, samples_.size()});
+}
+
+void USDRecorder::add_sample(EntityHandle handle, const pxr::GfVec3d& translate, const pxr::GfQuatd& orient,
+                             bool is_static) {
+  if (handle.index >= tracks_.size()) tracks_.resize(handle.index + 1);
+  Track& track = tracks_[handle.index];
+  if (track.generation != handle.generation) {
+    const pxr::SdfPath path = scene_.get_entity_path(handle);
+    if (path.IsEmpty()) return;
+    track.generation = handle.generation;
+    track.static_recorded = false;
+    track.translate = path.AppendProperty(pxr::TfToken("xformOp:translate"));
+    track.orient = path.AppendProperty(pxr::TfToken("xformOp:orient"));
+  }
+  if (is_static) {
+    if (track.static_recorded) return;
+    track.static_recorded = true;
+  }
+  samples_.push_back({handle, translate, orient});
+}
+
+void USDRecorder::end_frame() {
+  frames_.back().end = samples_.size();
+  frame_count_++;
+  if (frames_.size() >= batch_frames_) flush();
+}
+
+void USDRecorder::flush() {
+  if (frames_.empty()) return;
+  {
+    pxr::SdfChangeBlock block;
+    size_t begin = 0;
+    for (const Frame& frame : frames_) {
+      for (size_t s = begin; s < frame.end; ++s) {
+        const Sample& sample = samples_[s];
+        const Track& track = tracks_[sample.handle.index];
+        // Skip entities removed (and possibly replaced) since the frame; their
+        // prims are gone.
+        if (track.generation != sample.handle.generation || scene_.get_entity_path(sample.handle).IsEmpty()) {
+          continue;
+        }
+        layer_->SetTimeSample(track.translate, frame.time, sample.translate);
+        layer_->SetTimeSample(track.orient, frame.time, sample.orient);
+      }
+      begin = frame.end;
+    }
+  }
+  layer_->SetStartTimeCode(start_time_);
+  layer_->SetEndTimeCode(end_time_);
+  frames_.clear();
+  samples_.clear();
+}
+
+}
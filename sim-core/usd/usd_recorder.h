@@ -0,0 +1,88 @@
+#pragma once
+
+#include "../scene/usd_scene.h"
+#include "../simulator.h"
+#include <pxr/base/gf/quatd.h>
+#include <pxr/base/gf/vec3d.h>
+#include <pxr/usd/sdf/layer.h>
+#include <cstdint>
+#include <vector>
+
+namespace navora::usd {
+
+// Records a simulation as translate/orient time samples on the scene's root
+// layer, one time code per tick, for timeline scrubbing in USD viewers.
+// Frames are buffered and authored straight on the SdfLayer, batch_frames at
+// a time inside one SdfChangeBlock, instead of through per-prim Usd calls.
+// Static bodies get a single sample. Call flush() (or destroy the recorder)
+// before exporting the stage. The samples shadow the default values the
+// Simulator's write-behind mirror keeps, so a recording run can set its scene
+// flush interval to 0.
+class USDRecorder {
+public:
+  static constexpr size_t DEFAULT_BATCH_FRAMES = 64;
+
+  explicit USDRecorder(scene::USDScene& scene, size_t batch_frames = DEFAULT_BATCH_FRAMES);
+  ~USDRecorder() { flush(); }
+
+  USDRecorder(const USDRecorder&) = delete;
+  USDRecorder& operator=(const USDRecorder&) = delete;
+
+  // Appends the current state at time code sim.get_tick(). The stage's
+  // timeCodesPerSecond is taken from the step length on the first frame.
+  template <typename T>
+  void record(const SimulatorT<T>& sim) {
+    begin_frame(static_cast<double>(sim.get_tick()), sim.get_fixed_dt());
+    const auto& bodies = sim.get_bodies();
+    for (uint32_t i = 0; i < bodies.size(); ++i) {
+      const auto& position = bodies.position[i];
+      const auto& rotation = bodies.rotation[i];
+      add_sample(sim.get_entity_handle(i), pxr::GfVec3d(position.x, position.y, position.z),
+                 pxr::GfQuatd(rotation.w, rotation.x, rotation.y, rotation.z), bodies.is_static(i));
+    }
+    end_frame();
+  }
+
+  // Authors every buffered frame and updates the layer's time range.
+  void flush();
+
+  uint64_t get_frame_count() const { return frame_count_; }
+  size_t get_buffered_frames() const { return frames_.size(); }
+
+private:
+  struct Sample {
+    EntityHandle handle;
+    pxr::GfVec3d translate;
+    pxr::GfQuatd orient;
+  };
+
+  struct Frame {
+    double time;
+    // End of this frame's samples in samples_.
+    size_t end;
+  };
+
+  // Attribute paths of the entity last seen in a handle slot.
+  struct Track {
+    uint32_t generation = 0;
+    bool static_recorded = false;
+    pxr::SdfPath translate;
+    pxr::SdfPath orient;
+  };
+
+  void begin_frame(double time, double dt);
+  void add_sample(EntityHandle handle, const pxr::GfVec3d& translate, const pxr::GfQuatd& orient, bool is_static);
+  void end_frame();
+
+  scene::USDScene& scene_;
+  pxr::SdfLayerHandle layer_;
+  size_t batch_frames_;
+  std::vector<Frame> frames_;
+  std::vector<Sample> samples_;
+  std::vector<Track> tracks_;
+  uint64_t frame_count_ = 0;
+  double start_time_ = 0.0;
+  double end_time_ = 0.0;
+};
+
+}
@@ -0,0 +1,119 @@
+#include "usda_recorder.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace navora::usd {
+
+UsdaRecorder::UsdaRecorder(const std::string& spool_path, size_t memory_budget)
+  : spool_path_(spool_path), memory_budget_(memory_budget) {
+  spool_ = ::open(spool_path_.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  ok_ = spool_ >= 0;
+}
+
+UsdaRecorder::~UsdaRecorder() {
+  if (spool_ >= 0) {
+    ::close(spool_);
+    ::unlink(spool_path_.c_str());
+  }
+}
+
+// Frame f occupies poses_.size() records at offset f * poses_.size().
+bool UsdaRecorder::append_frame() {
+  const char* data = reinterpret_cast<const char*>(poses_.data());
+  const size_t bytes = poses_.size() * sizeof(Pose);
+  const off_t offset = static_cast<off_t>((times_.size() - 1) * bytes);
+  size_t written = 0;
+  while (ok_ && written < bytes) {
+    ssize_t n = ::pwrite(spool_, data + written, bytes - written, offset + static_cast<off_t>(written));
+    ok_ = n > 0;
+    if (ok_) written += static_cast<size_t>(n);
+  }
+  return ok_;
+}
+
+// Loads columns [first, first + count) of every frame, frame-major.
+bool UsdaRecorder::read_block(size_t first, size_t count, std::vector<Pose>& block) const {
+  block.resize(times_.size() * count);
+  const size_t frame_bytes = poses_.size() * sizeof(Pose);
+  const size_t bytes = count * sizeof(Pose);
+  for (size_t f = 0; f < times_.size(); ++f) {
+    char* data = reinterpret_cast<char*>(block.data() + f * count);
+    const off_t offset = static_cast<off_t>(f * frame_bytes + first * sizeof(Pose));
+    size_t read = 0;
+    while (read < bytes) {
+      ssize_t n = ::pread(spool_, data + read, bytes - read, offset + static_cast<off_t>(read));
+      if (n <= 0) return false;
+      read += static_cast<size_t>(n);
+    }
+  }
+  return true;
+}
+
+void UsdaRecorder::write_samples(UsdaWriter& out, const std::vector<Pose>& block, size_t column,
+                                 size_t columns) const {
+  out.indent(3).text("double3 xformOp:translate.timeSamples = {\n");
+  for (size_t f = 0; f < times_.size(); ++f) {
+    const Pose& pose = block[f * columns + column];
+    out.indent(4).number(times_[f]).text(": ").tuple(pose.position[0], pose.position[1], pose.position[2]).text(",\n");
+  }
+  out.indent(3).text("}\n");
+  out.indent(3).text("quatd xformOp:orient.timeSamples = {\n");
+  for (size_t f = 0; f < times_.size(); ++f) {
+    const Pose& pose = block[f * columns + column];
+    out.indent(4).number(times_[f]).text(": ")
+        .tuple(pose.rotation[0], pose.rotation[1], pose.rotation[2], pose.rotation[3]).text(",\n");
+  }
+  out.indent(3).text("}\n");
+}
+
+bool UsdaRecorder::finish(const std::string& path) {
+  int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) return false;
+  bool ok;
+  {
+    UsdaWriter out(fd);
+    ok = finish(out);
+  }
+  return ::close(fd) == 0 && ok;
+}
+
+bool UsdaRecorder::finish(UsdaWriter& out) {
+  if (!ok_ || times_.empty()) return false;
+
+  // Columns per block so that a block of every frame fits the budget.
+  const size_t columns_per_block =
+      std::max<size_t>(1, memory_budget_ / (times_.size() * sizeof(Pose)));
+  std::vector<Pose> block;
+  size_t block_first = 0;
+  size_t block_count = 0;
+  size_t column = 0;
+
+  USDExporter::write_header(out, time_codes_per_second_, times_.front(), times_.back());
+  out.text("def Xform \"World\" {\n");
+  out.indent(1).text("def Xform \"Entities\" {\n");
+  for (const Entity& entity : entities_) {
+    USDExporter::write_entity_begin(out, entity.name, 2);
+    if (entity.moving) {
+      if (column >= block_first + block_count) {
+        block_first = column;
+        block_count = std::min(columns_per_block, moving_.size() - column);
+        if (!read_block(block_first, block_count, block)) return false;
+      }
+      write_samples(out, block, column - block_first, block_count);
+      const auto& s = entity.body.transform.scale;
+      out.indent(3).text("double3 xformOp:scale = ").tuple(s.x, s.y, s.z).text("\n");
+      column++;
+    } else {
+      USDExporter::write_transform(out, entity.body.transform, 3);
+    }
+    USDExporter::write_op_order(out, 3);
+    USDExporter::write_shape(out, entity.body.shape, 3);
+    USDExporter::write_entity_end(out, 2);
+  }
+  out.indent(1).text("}\n");
+  out.text("}\n");
+  return out.flush();
+}
+
+}
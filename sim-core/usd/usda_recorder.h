@@ -0,0 +1,102 @@
+#pragma once
+
+#include "../simulator.h"
+#include "usd_export.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace navora::usd {
+
+// Time-sampled USDA recording without a USD install. Each record() appends
+// the poses of the moving bodies to a binary spool file; finish() transposes
+// the spool into per-attribute timeSamples, reading it in column blocks that
+// fit memory_budget. Memory stays flat in the run length apart from one time
+// code per frame, so multi-GB documents can be written.
+//
+// The entity set is taken from the first frame: entities created later are
+// not recorded, removed ones hold their last pose. Static bodies are written
+// once with default values.
+class UsdaRecorder {
+public:
+  static constexpr size_t DEFAULT_MEMORY_BUDGET = 64 * 1024 * 1024;
+
+  explicit UsdaRecorder(const std::string& spool_path, size_t memory_budget = DEFAULT_MEMORY_BUDGET);
+  ~UsdaRecorder();
+
+  UsdaRecorder(const UsdaRecorder&) = delete;
+  UsdaRecorder& operator=(const UsdaRecorder&) = delete;
+
+  // Appends the current state at time code sim.get_tick(); false once a
+  // write has failed.
+  template <typename T>
+  bool record(const SimulatorT<T>& sim) {
+    if (!ok_) return false;
+    if (times_.empty()) begin(sim);
+    times_.push_back(static_cast<double>(sim.get_tick()));
+    const auto& bodies = sim.get_bodies();
+    for (size_t k = 0; k < moving_.size(); ++k) {
+      const uint32_t index = sim.get_body_index(entities_[moving_[k]].handle);
+      if (index == EntityTable::NO_INDEX) continue;
+      const auto& p = bodies.position[index];
+      const auto& r = bodies.rotation[index];
+      Pose& pose = poses_[k];
+      pose = {p.x, p.y, p.z, r.w, r.x, r.y, r.z};
+    }
+    return append_frame();
+  }
+
+  // Writes the document to path; the spool is kept, so recording may go on.
+  bool finish(const std::string& path);
+  bool finish(UsdaWriter& out);
+
+  uint64_t get_frame_count() const { return times_.size(); }
+  bool ok() const { return ok_; }
+
+private:
+  struct Pose {
+    double position[3];
+    // w, x, y, z
+    double rotation[4];
+  };
+
+  struct Entity {
+    EntityHandle handle;
+    std::string name;
+    physics::RigidBody body;
+    bool moving;
+  };
+
+  template <typename T>
+  void begin(const SimulatorT<T>& sim) {
+    const auto& bodies = sim.get_bodies();
+    typename SimulatorT<T>::RigidBody body;
+    for (uint32_t i = 0; i < bodies.size(); ++i) {
+      const EntityHandle handle = sim.get_entity_handle(i);
+      const std::string& id = sim.get_entity_id(i);
+      bodies.get(i, body);
+      const bool moving = !bodies.is_static(i);
+      if (moving) moving_.push_back(static_cast<uint32_t>(entities_.size()));
+      entities_.push_back({handle, id.empty() ? default_entity_name(handle) : id, physics::RigidBody(body), moving});
+    }
+    poses_.resize(moving_.size());
+    time_codes_per_second_ = sim.get_fixed_dt() > 0.0 ? 1.0 / sim.get_fixed_dt() : 1.0 / Simulator::FIXED_DT;
+  }
+
+  bool append_frame();
+  bool read_block(size_t first, size_t count, std::vector<Pose>& block) const;
+  void write_samples(UsdaWriter& out, const std::vector<Pose>& block, size_t column, size_t columns) const;
+
+  std::string spool_path_;
+  int spool_ = -1;
+  size_t memory_budget_;
+  std::vector<Entity> entities_;
+  // Entities sampled every frame, in spool column order.
+  std::vector<uint32_t> moving_;
+  std::vector<Pose> poses_;
+  std::vector<double> times_;
+  double time_codes_per_second_ = 1.0 / Simulator::FIXED_DT;
+  bool ok_ = true;
+};
+
+}
@@ -0,0 +1,75 @@
+#include "usda_writer.h"
+#include <charconv>
+#include <cstring>
+#include <unistd.h>
+
+namespace navora::usd {
+
+namespace {
+
+// Longest shortest-round-trip double, e.g. "-2.2250738585072014e-308".
+constexpr size_t MAX_NUMBER_CHARS = 32;
+
+}
+
+UsdaWriter::UsdaWriter(std::ostream& out) : buffer_(BUFFER_SIZE), out_(&out) {}
+
+UsdaWriter::UsdaWriter(int fd) : buffer_(BUFFER_SIZE), fd_(fd) {}
+
+UsdaWriter& UsdaWriter::text(std::string_view text) {
+  if (text.size() > buffer_.size()) {
+    flush();
+    write_out(text.data(), text.size());
+    return *this;
+  }
+  reserve(text.size());
+  std::memcpy(buffer_.data() + used_, text.data(), text.size());
+  used_ += text.size();
+  return *this;
+}
+
+UsdaWriter& UsdaWriter::number(double value) {
+  reserve(MAX_NUMBER_CHARS);
+  char* begin = buffer_.data() + used_;
+  used_ += static_cast<size_t>(std::to_chars(begin, begin + MAX_NUMBER_CHARS, value).ptr - begin);
+  return *this;
+}
+
+UsdaWriter& UsdaWriter::tuple(double x, double y, double z) {
+  text("(").number(x).text(", ").number(y).text(", ").number(z);
+  return text(")");
+}
+
+UsdaWriter& UsdaWriter::tuple(double w, double x, double y, double z) {
+  text("(").number(w).text(", ").number(x).text(", ").number(y).text(", ").number(z);
+  return text(")");
+}
+
+UsdaWriter& UsdaWriter::indent(int depth) {
+  for (int i = 0; i < depth; ++i) text("    ");
+  return *this;
+}
+
+bool UsdaWriter::flush() {
+  write_out(buffer_.data(), used_);
+  used_ = 0;
+  if (out_ && ok_) ok_ = static_cast<bool>(out_->flush());
+  return ok_;
+}
+
+void UsdaWriter::write_out(const char* data, size_t size) {
+  if (!ok_ || size == 0) return;
+  if (out_) {
+    out_->write(data, static_cast<std::streamsize>(size));
+    ok_ = static_cast<bool>(*out_);
+    return;
+  }
+  size_t written = 0;
+  while (ok_ && written < size) {
+    ssize_t n = ::write(fd_, data + written, size - written);
+    ok_ = n > 0;
+    if (ok_) written += static_cast<size_t>(n);
+  }
+}
+
+}
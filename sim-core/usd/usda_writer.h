@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace navora::usd {
+
+// Buffered text sink for USDA output, to an std::ostream or a file
+// descriptor. Memory is the fixed buffer however large the document gets.
+// Numbers use std::to_chars shortest round-trip formatting, so doubles read
+// back bit-identical.
+class UsdaWriter {
+public:
+  static constexpr size_t BUFFER_SIZE = 64 * 1024;
+
+  explicit UsdaWriter(std::ostream& out);
+  // Does not take ownership of fd.
+  explicit UsdaWriter(int fd);
+  ~UsdaWriter() { flush(); }
+
+  UsdaWriter(const UsdaWriter&) = delete;
+  UsdaWriter& operator=(const UsdaWriter&) = delete;
+
+  UsdaWriter& text(std::string_view text);
+  UsdaWriter& number(double value);
+  // "(x, y, z)"
+  UsdaWriter& tuple(double x, double y, double z);
+  // "(w, x, y, z)", the USD quaternion order.
+  UsdaWriter& tuple(double w, double x, double y, double z);
+  // Four spaces per level.
+  UsdaWriter& indent(int depth);
+
+  // False once a write has failed.
+  bool flush();
+  bool ok() const { return ok_; }
+
+private:
+  void reserve(size_t bytes) {
+    if (used_ + bytes > buffer_.size()) flush();
+  }
+  void write_out(const char* data, size_t size);
+
+  std::vector<char> buffer_;
+  size_t used_ = 0;
+  std::ostream* out_ = nullptr;
+  int fd_ = -1;
+  bool ok_ = true;
+};
+
+}
@@ -0,0 +1,141 @@
+#include "checkpoint.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace navora::util {
+
+namespace {
+
+constexpr uint64_t SECTION_ALIGNMENT = 64;
+
+uint64_t align_up(uint64_t offset) {
+  return (offset + SECTION_ALIGNMENT - 1) & ~(SECTION_ALIGNMENT - 1);
+}
+
+}
+
+size_t CheckpointWriter::size() const {
+  uint64_t offset = sizeof(CheckpointHeader) + sections_.size() * sizeof(CheckpointSectionEntry);
+  for (const Section& section : sections_) {
+    offset = align_up(offset) + section.count * section.element_size;
+  }
+  return offset;
+}
+
+void CheckpointWriter::write(std::vector<char>& image) const {
+  image.assign(size(), 0);
+
+  CheckpointHeader header;
+  header.section_count = static_cast<uint32_t>(sections_.size());
+  header.total_size = image.size();
+  std::memcpy(image.data(), &header, sizeof(header));
+
+  uint64_t offset = sizeof(CheckpointHeader) + sections_.size() * sizeof(CheckpointSectionEntry);
+  char* table = image.data() + sizeof(CheckpointHeader);
+  for (size_t s = 0; s < sections_.size(); ++s) {
+    const Section& section = sections_[s];
+    offset = align_up(offset);
+    CheckpointSectionEntry entry{section.tag, section.element_size, offset, section.count};
+    std::memcpy(table + s * sizeof(entry), &entry, sizeof(entry));
+    const size_t bytes = section.count * section.element_size;
+    if (bytes > 0) std::memcpy(image.data() + offset, section.data, bytes);
+    offset += bytes;
+  }
+}
+
+bool CheckpointWriter::write_file(const std::string& path) const {
+  std::vector<char> image;
+  write(image);
+  return replace_file(path, image.data(), image.size());
+}
+
+bool replace_file(const std::string& path, const void* data, size_t size) {
+  std::string temp_path = path + ".XXXXXX";
+  int fd = ::mkstemp(&temp_path[0]);
+  if (fd < 0) return false;
+  // One call unless the data exceeds the kernel's per-call limit (~2 GiB).
+  const char* bytes = static_cast<const char*>(data);
+  size_t written = 0;
+  bool ok = ::fchmod(fd, 0644) == 0;
+  while (ok && written < size) {
+    ssize_t n = ::write(fd, bytes + written, size - written);
+    ok = n > 0;
+    if (ok) written += static_cast<size_t>(n);
+  }
+  ok = ::fsync(fd) == 0 && ok;
+  ok = ::close(fd) == 0 && ok;
+  if (ok && ::rename(temp_path.c_str(), path.c_str()) == 0) return true;
+  ::unlink(temp_path.c_str());
+  return false;
+}
+
+bool CheckpointReader::open(const void* data, size_t size) {
+  data_ = nullptr;
+  size_ = 0;
+  sections_.clear();
+
+  CheckpointHeader header;
+  if (!data || size < sizeof(header)) return false;
+  std::memcpy(&header, data, sizeof(header));
+  if (header.magic != CheckpointHeader::MAGIC || header.version != CheckpointHeader::VERSION ||
+      header.total_size > size) {
+    return false;
+  }
+  const uint64_t table_end = sizeof(header) + static_cast<uint64_t>(header.section_count) * sizeof(CheckpointSectionEntry);
+  if (table_end > header.total_size) return false;
+
+  sections_.resize(header.section_count);
+  std::memcpy(sections_.data(), static_cast<const char*>(data) + sizeof(header),
+              sections_.size() * sizeof(CheckpointSectionEntry));
+  for (const CheckpointSectionEntry& entry : sections_) {
+    if (entry.offset < table_end || entry.offset > header.total_size ||
+        (entry.element_size > 0 && entry.count > (header.total_size - entry.offset) / entry.element_size)) {
+      sections_.clear();
+      return false;
+    }
+  }
+
+  data_ = static_cast<const char*>(data);
+  size_ = header.total_size;
+  return true;
+}
+
+const CheckpointSectionEntry* CheckpointReader::find(uint32_t tag) const {
+  for (const CheckpointSectionEntry& entry : sections_) {
+    if (entry.tag == tag) return &entry;
+  }
+  return nullptr;
+}
+
+MappedFile::~MappedFile() {
+  close();
+}
+
+bool MappedFile::open(const std::string& path) {
+  close();
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+  struct stat info;
+  if (::fstat(fd, &info) != 0 || info.st_size <= 0) {
+    ::close(fd);
+    return false;
+  }
+  void* data = ::mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED) return false;
+  data_ = data;
+  size_ = static_cast<size_t>(info.st_size);
+  return true;
+}
+
+void MappedFile::close() {
+  if (data_) ::munmap(data_, size_);
+  data_ = nullptr;
+  size_ = 0;
+}
+
+}
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace navora::util {
+
+// Section tags of a simulation checkpoint. Tags are never renumbered; a
+// reader skips sections it does not know.
+enum CheckpointSection : uint32_t {
+  CHECKPOINT_SIMULATOR = 1,
+  CHECKPOINT_ENTITY_NAMES = 2,
+  CHECKPOINT_ENTITY_NAME_OFFSETS = 3,
+  CHECKPOINT_ENTITY_HANDLES = 4,
+  CHECKPOINT_ENTITY_SLOTS = 5,
+  CHECKPOINT_ENTITY_TABLE = 6,
+
+  CHECKPOINT_BODY_POSITION = 16,
+  CHECKPOINT_BODY_ROTATION = 17,
+  CHECKPOINT_BODY_SCALE = 18,
+  CHECKPOINT_BODY_LINEAR_VELOCITY = 19,
+  CHECKPOINT_BODY_ANGULAR_VELOCITY = 20,
+  CHECKPOINT_BODY_MASS = 21,
+  CHECKPOINT_BODY_INV_MASS = 22,
+  CHECKPOINT_BODY_SHAPE = 23,
+  CHECKPOINT_BODY_FLAGS = 24,
+  CHECKPOINT_BODY_SLEEP_TIME = 25,
+  CHECKPOINT_BODY_SLEEP_NEXT = 26,
+  CHECKPOINT_BODY_SLEEP_PREV = 27,
+
+  CHECKPOINT_SOLVER_CACHE = 32,
+
+  CHECKPOINT_QUERY_TREE = 48,
+  CHECKPOINT_QUERY_TREE_NODES = 49,
+  CHECKPOINT_QUERY_PROXIES = 50,
+  CHECKPOINT_QUERY_UNBOUNDED = 51
+};
+
+// Checkpoint image layout, all in native byte order:
+//
+//   CheckpointHeader
+//   CheckpointSectionEntry[section_count]
+//   section data, each section starting on a 64-byte boundary
+//
+// Sections are raw arrays of trivially copyable records, so an image is built
+// with one copy per array, written with one write(), and restored from a
+// memory-mapped file with one copy per array. Each entry records its element
+// size, and a reader rejects a section whose records do not match its own.
+// The magic also detects a byte-order mismatch.
+struct CheckpointHeader {
+  static constexpr uint32_t MAGIC = 0x4b43564eu;  // "NVCK"
+  static constexpr uint32_t VERSION = 1;
+
+  uint32_t magic = MAGIC;
+  uint32_t version = VERSION;
+  uint32_t section_count = 0;
+  uint32_t reserved = 0;
+  uint64_t total_size = 0;
+};
+
+struct CheckpointSectionEntry {
+  uint32_t tag;
+  uint32_t element_size;
+  uint64_t offset;
+  uint64_t count;
+};
+
+// Collects array sections by reference; the referenced data must stay
+// unchanged until the image is written.
+class CheckpointWriter {
+public:
+  template <typename T>
+  void add(uint32_t tag, const T* data, size_t count) {
+    static_assert(std::is_trivially_copyable<T>::value, "checkpoint records must be trivially copyable");
+    sections_.push_back({tag, static_cast<uint32_t>(sizeof(T)), data, count});
+  }
+
+  template <typename T, typename Allocator>
+  void add(uint32_t tag, const std::vector<T, Allocator>& values) {
+    add(tag, values.data(), values.size());
+  }
+
+  // Single records are copied, so they may be temporaries.
+  template <typename T>
+  void add_value(uint32_t tag, const T& value) {
+    static_assert(std::is_trivially_copyable<T>::value, "checkpoint records must be trivially copyable");
+    values_.emplace_back(sizeof(T));
+    std::memcpy(values_.back().data(), &value, sizeof(T));
+    sections_.push_back({tag, static_cast<uint32_t>(sizeof(T)), values_.back().data(), 1});
+  }
+
+  size_t size() const;
+  void write(std::vector<char>& image) const;
+  // Builds the image and writes it with a single write() call through
+  // replace_file().
+  bool write_file(const std::string& path) const;
+
+private:
+  struct Section {
+    uint32_t tag;
+    uint32_t element_size;
+    const void* data;
+    size_t count;
+  };
+
+  std::vector<Section> sections_;
+  std::vector<std::vector<char>> values_;
+};
+
+// Reads sections out of an image in memory, e.g. a MappedFile. The image
+// must outlive the reader.
+class CheckpointReader {
+public:
+  // Validates the header and section table; false if the image is not a
+  // checkpoint of this version or is truncated.
+  bool open(const void* data, size_t size);
+
+  bool has(uint32_t tag) const { return find(tag) != nullptr; }
+
+  // Copies a section into values. False, with values untouched, if the
+  // section is missing or its records have a different size than T.
+  template <typename T, typename Allocator>
+  bool read(uint32_t tag, std::vector<T, Allocator>& values) const {
+    static_assert(std::is_trivially_copyable<T>::value, "checkpoint records must be trivially copyable");
+    const CheckpointSectionEntry* entry = find(tag);
+    if (!entry || entry->element_size != sizeof(T)) return false;
+    values.resize(entry->count);
+    if (entry->count > 0) std::memcpy(values.data(), data_ + entry->offset, entry->count * sizeof(T));
+    return true;
+  }
+
+  template <typename T>
+  bool read_value(uint32_t tag, T& value) const {
+    static_assert(std::is_trivially_copyable<T>::value, "checkpoint records must be trivially copyable");
+    const CheckpointSectionEntry* entry = find(tag);
+    if (!entry || entry->element_size != sizeof(T) || entry->count != 1) return false;
+    std::memcpy(&value, data_ + entry->offset, sizeof(T));
+    return true;
+  }
+
+private:
+  const CheckpointSectionEntry* find(uint32_t tag) const;
+
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+  std::vector<CheckpointSectionEntry> sections_;
+};
+
+// Writes data to a temporary file next to path, syncs it and renames it over
+// path, so a failed write leaves any previous file at path intact.
+bool replace_file(const std::string& path, const void* data, size_t size);
+
+// Read-only memory mapping of a whole file.
+class MappedFile {
+public:
+  MappedFile() = default;
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  bool open(const std::string& path);
+  void close();
+
+  const void* data() const { return data_; }
+  size_t size() const { return size_; }
+
+private:
+  void* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+}
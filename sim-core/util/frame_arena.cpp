@@ -0,0 +1,69 @@
+#include "frame_arena.h"
+#include <algorithm>
+#include <new>
+
+namespace navora::util {
+
+FrameArena::FrameArena(size_t initial_capacity) {
+  if (initial_capacity > 0) {
+    block_ = allocate_block(initial_capacity);
+    capacity_ = initial_capacity;
+    heap_allocations_++;
+  }
+}
+
+FrameArena::~FrameArena() {
+  for (std::byte* block : overflow_) {
+    free_block(block);
+  }
+  free_block(block_);
+}
+
+std::byte* FrameArena::allocate_block(size_t size) {
+  return static_cast<std::byte*>(::operator new(size, std::align_val_t(ALIGNMENT)));
+}
+
+void FrameArena::free_block(std::byte* block) {
+  if (block) ::operator delete(block, std::align_val_t(ALIGNMENT));
+}
+
+void* FrameArena::allocate_overflow(size_t size, size_t alignment) {
+  // Oversized requests get their own block; the merged block on the next
+  // reset is large enough to serve the whole frame in place.
+  size_t padded = std::max(size + alignment, capacity_);
+  std::byte* block = allocate_block(padded);
+  if (overflow_.size() == overflow_.capacity()) {
+    // The overflow list grows on the heap too.
+    heap_allocations_++;
+    frame_heap_allocations_++;
+  }
+  overflow_.push_back(block);
+  overflow_bytes_ += padded;
+  heap_allocations_++;
+  frame_heap_allocations_++;
+  size_t offset = (alignment - reinterpret_cast<uintptr_t>(block) % alignment) % alignment;
+  return block + offset;
+}
+
+void FrameArena::reset() {
+  peak_bytes_ = std::max(peak_bytes_, bytes_used());
+  if (!overflow_.empty()) {
+    size_t needed = capacity_ + overflow_bytes_;
+    for (std::byte* block : overflow_) {
+      free_block(block);
+    }
+    overflow_.clear();
+    overflow_bytes_ = 0;
+    free_block(block_);
+    capacity_ = 1;
+    while (capacity_ < needed) capacity_ <<= 1;
+    block_ = allocate_block(capacity_);
+    heap_allocations_++;
+    frame_heap_allocations_++;
+  }
+  offset_ = 0;
+  last_frame_heap_allocations_ = frame_heap_allocations_;
+  frame_heap_allocations_ = 0;
+}
+
+}
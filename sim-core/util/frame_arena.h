@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace navora::util {
+
+// Linear allocator for scratch memory that lives for one frame. Allocation
+// bumps an offset into a single block and reset() rewinds it. When a frame
+// outgrows the block, extra blocks are taken from the heap and merged into one
+// larger block on the next reset, so after a few warm-up frames a steady
+// workload performs no heap allocations at all. Memory is never freed
+// individually.
+class FrameArena {
+public:
+  static constexpr size_t ALIGNMENT = 64;
+
+  explicit FrameArena(size_t initial_capacity = 64 * 1024);
+  ~FrameArena();
+
+  FrameArena(const FrameArena&) = delete;
+  FrameArena& operator=(const FrameArena&) = delete;
+
+  void* allocate(size_t size, size_t alignment) {
+    size_t offset = (offset_ + alignment - 1) & ~(alignment - 1);
+    if (offset + size > capacity_) return allocate_overflow(size, alignment);
+    offset_ = offset + size;
+    return block_ + offset;
+  }
+
+  // Invalidates everything allocated since the last reset. O(1) unless the
+  // frame overflowed, in which case the block is regrown once.
+  void reset();
+
+  size_t capacity() const { return capacity_; }
+  size_t bytes_used() const { return offset_ + overflow_bytes_; }
+  // High-water mark of bytes_used() over all frames.
+  size_t peak_bytes() const { return peak_bytes_; }
+  // Heap allocations made by the arena, its blocks and overflow list, since
+  // construction and during the last completed frame. The latter is 0 once
+  // the arena has warmed up. Containers that outlive a frame allocate outside
+  // the arena and are not counted here.
+  uint64_t heap_allocations() const { return heap_allocations_; }
+  uint64_t last_frame_heap_allocations() const { return last_frame_heap_allocations_; }
+
+private:
+  void* allocate_overflow(size_t size, size_t alignment);
+  static std::byte* allocate_block(size_t size);
+  static void free_block(std::byte* block);
+
+  std::byte* block_ = nullptr;
+  size_t capacity_ = 0;
+  size_t offset_ = 0;
+  std::vector<std::byte*> overflow_;
+  size_t overflow_bytes_ = 0;
+  size_t peak_bytes_ = 0;
+  uint64_t heap_allocations_ = 0;
+  uint64_t frame_heap_allocations_ = 0;
+  uint64_t last_frame_heap_allocations_ = 0;
+};
+
+// Standard allocator over a FrameArena; deallocation is a no-op.
+template <typename T>
+class ArenaAllocator {
+public:
+  using value_type = T;
+  using propagate_on_container_copy_assignment = std::true_type;
+  using propagate_on_container_move_assignment = std::true_type;
+  using propagate_on_container_swap = std::true_type;
+
+  ArenaAllocator(FrameArena& arena) noexcept : arena_(&arena) {}
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U>& other) noexcept : arena_(other.arena()) {}
+
+  T* allocate(size_t count) {
+    return static_cast<T*>(arena_->allocate(count * sizeof(T), alignof(T)));
+  }
+  void deallocate(T*, size_t) noexcept {}
+
+  FrameArena* arena() const { return arena_; }
+
+  template <typename U>
+  bool operator==(const ArenaAllocator<U>& other) const { return arena_ == other.arena(); }
+  template <typename U>
+  bool operator!=(const ArenaAllocator<U>& other) const { return arena_ != other.arena(); }
+
+private:
+  FrameArena* arena_;
+};
+
+// Per-frame scratch array. Owners call release() before the arena is reset so
+// no vector keeps pointing into rewound memory.
+template <typename T>
+using FrameVector = std::vector<T, ArenaAllocator<T>>;
+
+template <typename T>
+void release(FrameVector<T>& vector) {
+  vector = FrameVector<T>(vector.get_allocator());
+}
+
+}
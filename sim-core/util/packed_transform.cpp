@@ -0,0 +1,210 @@
+#include "packed_transform.h"
+#include <algorithm>
+#include <cmath>
+
+namespace navora::util {
+
+namespace {
+
+constexpr double ROTATION_RANGE = 0.70710678118654752;  // 1/sqrt(2)
+constexpr uint32_t ROTATION_MAX = (1u << 10) - 1;
+constexpr int32_t POSITION_MAX = (1 << TransformPacker::POSITION_BITS) - 1;
+// Quantized velocities stay within +-VELOCITY_MAX so the change between two
+// of them always fits an int32_t.
+constexpr int32_t VELOCITY_MAX = (1 << 30) - 1;
+
+int32_t quantize_velocity(double v) {
+  const double q = v / TransformPacker::VELOCITY_STEP;
+  if (!(q > -VELOCITY_MAX)) return q < 0 ? -VELOCITY_MAX : 0;
+  return static_cast<int32_t>(std::lround(std::min(q, static_cast<double>(VELOCITY_MAX))));
+}
+
+}  // namespace
+
+void PackedTransforms::clear() {
+  key = false;
+  box_min = physics::Vector3();
+  position_step = 0.0;
+  velocity_step = 0.0;
+  index_gaps.clear();
+  positions.clear();
+  rotations.clear();
+  velocities.clear();
+  motions.clear();
+}
+
+uint32_t pack_rotation(const physics::Quaternion& rotation) {
+  double c[4] = {rotation.x, rotation.y, rotation.z, rotation.w};
+  double length = std::sqrt(c[0] * c[0] + c[1] * c[1] + c[2] * c[2] + c[3] * c[3]);
+  if (!(length > 0.0)) {
+    c[0] = c[1] = c[2] = 0.0;
+    c[3] = length = 1.0;
+  }
+
+  uint32_t largest = 0;
+  for (uint32_t k = 1; k < 4; ++k) {
+    if (std::abs(c[k]) > std::abs(c[largest])) largest = k;
+  }
+  // q and -q are the same rotation; make the dropped component positive.
+  const double scale = (c[largest] < 0.0 ? -1.0 : 1.0) / length;
+  uint32_t packed = largest << 30;
+  int shift = 20;
+  for (uint32_t k = 0; k < 4; ++k) {
+    if (k == largest) continue;
+    const double unit = (c[k] * scale + ROTATION_RANGE) / (2.0 * ROTATION_RANGE);
+    const double q = std::round(std::clamp(unit, 0.0, 1.0) * ROTATION_MAX);
+    packed |= static_cast<uint32_t>(q) << shift;
+    shift -= 10;
+  }
+  return packed;
+}
+
+physics::Quaternion unpack_rotation(uint32_t packed) {
+  const uint32_t largest = packed >> 30;
+  double c[4];
+  double sum = 0.0;
+  int shift = 20;
+  for (uint32_t k = 0; k < 4; ++k) {
+    if (k == largest) continue;
+    const double unit = static_cast<double>((packed >> shift) & ROTATION_MAX) / ROTATION_MAX;
+    c[k] = unit * 2.0 * ROTATION_RANGE - ROTATION_RANGE;
+    sum += c[k] * c[k];
+    shift -= 10;
+  }
+  c[largest] = std::sqrt(std::max(0.0, 1.0 - sum));
+  return physics::Quaternion(c[0], c[1], c[2], c[3]);
+}
+
+bool TransformPacker::quantize(const physics::Vector3& position, int32_t q[3]) const {
+  const double axes[3] = {position.x - box_min_.x, position.y - box_min_.y, position.z - box_min_.z};
+  for (int k = 0; k < 3; ++k) {
+    const double value = std::round(axes[k] / step_);
+    if (!(value >= 0.0 && value <= POSITION_MAX)) return false;
+    q[k] = static_cast<int32_t>(value);
+  }
+  return true;
+}
+
+void TransformPacker::begin(PackedTransforms& out, bool key) const {
+  out.clear();
+  out.key = key;
+  out.box_min = box_min_;
+  out.position_step = step_;
+  out.velocity_step = VELOCITY_STEP;
+}
+
+void TransformPacker::append_key(uint32_t index, const Held& held, PackedTransforms& out,
+                                 uint32_t& previous) {
+  out.index_gaps.push_back(index - previous);
+  previous = index;
+  out.positions.insert(out.positions.end(), held.position, held.position + 3);
+  out.rotations.push_back(static_cast<uint64_t>(held.rotation) + 1);
+  out.velocities.insert(out.velocities.end(), held.velocity, held.velocity + 3);
+}
+
+bool TransformPacker::encode(std::vector<PackedEntity>& entities, PackedTransforms& out) {
+  if (step_ == 0.0) return false;
+  std::sort(entities.begin(), entities.end(),
+            [](const PackedEntity& a, const PackedEntity& b) { return a.index < b.index; });
+
+  // Every position is checked before anything is written, so a frame is
+  // either fully a difference frame or left for a key frame.
+  positions_.resize(3 * entities.size());
+  for (size_t i = 0; i < entities.size(); ++i) {
+    if (!quantize(entities[i].position, &positions_[3 * i])) return false;
+  }
+
+  begin(out, false);
+  uint32_t previous = 0;
+  for (size_t i = 0; i < entities.size(); ++i) {
+    const PackedEntity& entity = entities[i];
+    if (entity.index >= held_.size()) held_.resize(entity.index + 1);
+    Held& held = held_[entity.index];
+    const bool fresh = !held.live;
+    if (fresh) held = Held();
+    held.live = true;
+
+    out.index_gaps.push_back(entity.index - previous);
+    previous = entity.index;
+    const int32_t velocity[3] = {quantize_velocity(entity.linear_velocity.x),
+                                 quantize_velocity(entity.linear_velocity.y),
+                                 quantize_velocity(entity.linear_velocity.z)};
+    for (int k = 0; k < 3; ++k) {
+      const int32_t change = positions_[3 * i + k] - held.position[k];
+      out.positions.push_back(change - held.motion[k]);
+      held.position[k] = positions_[3 * i + k];
+      held.motion[k] = change;
+      out.velocities.push_back(velocity[k] - held.velocity[k]);
+      held.velocity[k] = velocity[k];
+    }
+    const uint32_t rotation = pack_rotation(entity.rotation);
+    out.rotations.push_back(!fresh && rotation == held.rotation ? 0 : static_cast<uint64_t>(rotation) + 1);
+    held.rotation = rotation;
+  }
+  return true;
+}
+
+void TransformPacker::encode_key(std::vector<PackedEntity>& entities, PackedTransforms& out) {
+  std::sort(entities.begin(), entities.end(),
+            [](const PackedEntity& a, const PackedEntity& b) { return a.index < b.index; });
+
+  physics::Vector3 lo(0, 0, 0);
+  physics::Vector3 hi(0, 0, 0);
+  bool first = true;
+  for (const auto& entity : entities) {
+    const auto& p = entity.position;
+    if (!(std::isfinite(p.x) && std::isfinite(p.y) && std::isfinite(p.z))) continue;
+    if (first) {
+      lo = hi = p;
+      first = false;
+      continue;
+    }
+    lo = physics::Vector3(std::min(lo.x, p.x), std::min(lo.y, p.y), std::min(lo.z, p.z));
+    hi = physics::Vector3(std::max(hi.x, p.x), std::max(hi.y, p.y), std::max(hi.z, p.z));
+  }
+  // Margin so moving entities stay inside for a while; the box only changes
+  // on key frames.
+  const double extent = std::max({hi.x - lo.x, hi.y - lo.y, hi.z - lo.z});
+  const double margin = std::max(1.0, 0.25 * extent);
+  box_min_ = lo - physics::Vector3(margin, margin, margin);
+  step_ = (extent + 2.0 * margin) / POSITION_MAX;
+
+  held_.assign(held_.size(), Held());
+  begin(out, true);
+  uint32_t previous = 0;
+  for (const auto& entity : entities) {
+    if (entity.index >= held_.size()) held_.resize(entity.index + 1);
+    Held& held = held_[entity.index];
+    held = Held();
+    if (!quantize(entity.position, held.position)) std::fill(held.position, held.position + 3, 0);
+    held.rotation = pack_rotation(entity.rotation);
+    held.velocity[0] = quantize_velocity(entity.linear_velocity.x);
+    held.velocity[1] = quantize_velocity(entity.linear_velocity.y);
+    held.velocity[2] = quantize_velocity(entity.linear_velocity.z);
+    held.live = true;
+    append_key(entity.index, held, out, previous);
+  }
+}
+
+void TransformPacker::encode_held(PackedTransforms& out) const {
+  begin(out, true);
+  uint32_t previous = 0;
+  for (uint32_t index = 0; index < held_.size(); ++index) {
+    const Held& held = held_[index];
+    if (!held.live) continue;
+    append_key(index, held, out, previous);
+    out.motions.insert(out.motions.end(), held.motion, held.motion + 3);
+  }
+}
+
+void TransformPacker::remove(uint32_t index) {
+  if (index < held_.size()) held_[index].live = false;
+}
+
+void TransformPacker::clear() {
+  held_.clear();
+  box_min_ = physics::Vector3();
+  step_ = 0.0;
+}
+
+}  // namespace navora::util
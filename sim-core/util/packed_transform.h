@@ -0,0 +1,142 @@
+#pragma once
+
+#include "../physics/rigid_body.h"
+#include <cstdint>
+#include <vector>
+
+namespace navora::util {
+
+// Compact transform encoding for state streams. Entities are addressed by
+// their EntityHandle slot index and sent in ascending index order as gaps.
+// Everything is sent relative to the values last sent for the same index:
+// - Positions are quantized to a uniform grid over a bounding box that is
+//   kept while every entity stays inside it. What is sent is the change in
+//   grid cells minus the change sent last time, which is near zero for
+//   steady motion.
+// - Rotations use smallest-three: the largest component is dropped (its sign
+//   made positive) and the other three go in 10 bits each, with the dropped
+//   component's index in the top 2 bits. Sent as packed + 1, or 0 when
+//   unchanged.
+// - Velocities are quantized to a fixed step and sent as the change.
+//
+// A key frame sends every live entity absolute on a new box, with the last
+// position changes in motions when it continues a sequence. Otherwise an
+// index not currently held, i.e. new or reused since it was last removed,
+// starts from zero.
+struct PackedTransforms {
+  bool key = false;
+  physics::Vector3 box_min;
+  double position_step = 0.0;
+  double velocity_step = 0.0;
+  std::vector<uint32_t> index_gaps;
+  // Three per entity.
+  std::vector<int32_t> positions;
+  // One per entity.
+  std::vector<uint64_t> rotations;
+  // Three per entity.
+  std::vector<int32_t> velocities;
+  // Key frames only, three per entity when present.
+  std::vector<int32_t> motions;
+
+  void clear();
+};
+
+struct PackedEntity {
+  uint32_t index;
+  physics::Vector3 position;
+  physics::Quaternion rotation;
+  physics::Vector3 linear_velocity;
+};
+
+uint32_t pack_rotation(const physics::Quaternion& rotation);
+physics::Quaternion unpack_rotation(uint32_t packed);
+
+// Encoder side; holds the values last sent for each index. Not thread safe.
+class TransformPacker {
+public:
+  static constexpr int POSITION_BITS = 16;
+  static constexpr double VELOCITY_STEP = 1.0 / 256.0;
+
+  // Encodes entities, which need not be sorted. Returns false without
+  // touching out or the held values when one left the box; encode a key
+  // frame of every entity instead.
+  bool encode(std::vector<PackedEntity>& entities, PackedTransforms& out);
+  // Fits a new box around every live entity and sends them all absolute.
+  void encode_key(std::vector<PackedEntity>& entities, PackedTransforms& out);
+  // Key frame of the held values, for consumers joining now. Positions are
+  // exactly what in-sequence consumers hold, so they can continue from it.
+  void encode_held(PackedTransforms& out) const;
+
+  // Forgets an entity; its index starts from zero again.
+  void remove(uint32_t index);
+  void clear();
+
+private:
+  struct Held {
+    int32_t position[3];
+    int32_t motion[3];
+    uint32_t rotation;
+    int32_t velocity[3];
+    bool live = false;
+  };
+
+  bool quantize(const physics::Vector3& position, int32_t q[3]) const;
+  void begin(PackedTransforms& out, bool key) const;
+  static void append_key(uint32_t index, const Held& held, PackedTransforms& out, uint32_t& previous);
+
+  std::vector<Held> held_;
+  std::vector<int32_t> positions_;
+  physics::Vector3 box_min_;
+  double step_ = 0.0;
+};
+
+// Decoder side; mirrors the values a TransformPacker holds. Call remove()
+// for every removed and created entity before applying the frame.
+class TransformUnpacker {
+public:
+  // Applies a frame, calling visit(index, position, rotation, linear_velocity)
+  // for every entity in it.
+  template <typename Visit>
+  void apply(const PackedTransforms& frame, Visit&& visit) {
+    if (frame.key) clear();
+    const double* min[3] = {&frame.box_min.x, &frame.box_min.y, &frame.box_min.z};
+    uint32_t index = 0;
+    for (size_t i = 0; i < frame.index_gaps.size(); ++i) {
+      index += frame.index_gaps[i];
+      if (index >= held_.size()) held_.resize(index + 1);
+      Held& held = held_[index];
+      double position[3];
+      double velocity[3];
+      for (int k = 0; k < 3; ++k) {
+        const int32_t change = held.motion[k] + frame.positions[3 * i + k];
+        held.position[k] += change;
+        held.motion[k] = frame.key ? (frame.motions.empty() ? 0 : frame.motions[3 * i + k]) : change;
+        position[k] = *min[k] + held.position[k] * frame.position_step;
+        held.velocity[k] += frame.velocities[3 * i + k];
+        velocity[k] = held.velocity[k] * frame.velocity_step;
+      }
+      if (frame.rotations[i] != 0) {
+        held.rotation = unpack_rotation(static_cast<uint32_t>(frame.rotations[i] - 1));
+      }
+      visit(index, physics::Vector3(position[0], position[1], position[2]), held.rotation,
+            physics::Vector3(velocity[0], velocity[1], velocity[2]));
+    }
+  }
+
+  void remove(uint32_t index) {
+    if (index < held_.size()) held_[index] = Held();
+  }
+  void clear() { held_.clear(); }
+
+private:
+  struct Held {
+    int32_t position[3] = {0, 0, 0};
+    int32_t motion[3] = {0, 0, 0};
+    int32_t velocity[3] = {0, 0, 0};
+    physics::Quaternion rotation;
+  };
+
+  std::vector<Held> held_;
+};
+
+}  // namespace navora::util
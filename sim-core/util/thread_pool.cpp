@@ -0,0 +1,72 @@
+#include "thread_pool.h"
+#include <algorithm>
+
+namespace navora::util {
+
+ThreadPool::ThreadPool(size_t thread_count) {
+  for (size_t i = 1; i < thread_count; ++i) {
+    workers_.emplace_back(&ThreadPool::worker_loop, this);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  wake_.notify_all();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+}
+
+void ThreadPool::run(size_t count, Invoke invoke, void* context) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    invoke_ = invoke;
+    context_ = context;
+    count_ = count;
+    grain_ = std::max<size_t>(1, count / (size() * 8));
+    next_.store(0, std::memory_order_relaxed);
+    active_ = workers_.size();
+    generation_++;
+  }
+  wake_.notify_all();
+
+  work();
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_.wait(lock, [this] { return active_ == 0; });
+}
+
+void ThreadPool::work() {
+  for (;;) {
+    size_t begin = next_.fetch_add(grain_, std::memory_order_relaxed);
+    if (begin >= count_) return;
+    size_t end = std::min(begin + grain_, count_);
+    for (size_t i = begin; i < end; ++i) {
+      invoke_(context_, i);
+    }
+  }
+}
+
+void ThreadPool::worker_loop() {
+  uint64_t seen = 0;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_.wait(lock, [&] { return stopping_ || generation_ != seen; });
+      if (stopping_) return;
+      seen = generation_;
+    }
+
+    work();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--active_ == 0) {
+      done_.notify_one();
+    }
+  }
+}
+
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace navora::util {
+
+// Fixed set of worker threads for data-parallel loops. parallel_for blocks
+// until every index has run; the calling thread takes part in the work, so a
+// pool of size 1 has no workers and runs everything inline. Calls must not be
+// nested or issued concurrently from several threads.
+class ThreadPool {
+public:
+  explicit ThreadPool(size_t thread_count = 1);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  size_t size() const { return workers_.size() + 1; }
+
+  template <typename Fn>
+  void parallel_for(size_t count, Fn&& fn) {
+    if (workers_.empty() || count <= 1) {
+      for (size_t i = 0; i < count; ++i) fn(i);
+      return;
+    }
+    run(count, [](void* context, size_t i) { (*static_cast<Fn*>(context))(i); }, &fn);
+  }
+
+private:
+  using Invoke = void (*)(void*, size_t);
+
+  void run(size_t count, Invoke invoke, void* context);
+  void work();
+  void worker_loop();
+
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  uint64_t generation_ = 0;
+  bool stopping_ = false;
+  size_t active_ = 0;
+
+  Invoke invoke_ = nullptr;
+  void* context_ = nullptr;
+  size_t count_ = 0;
+  size_t grain_ = 1;
+  std::atomic<size_t> next_{0};
+};
+
+}
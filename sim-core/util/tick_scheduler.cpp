@@ -0,0 +1,56 @@
+#include "tick_scheduler.h"
+#include <algorithm>
+
+namespace navora::util {
+
+void TickScheduler::configure(const TickSchedulerSettings& settings) {
+  settings_ = settings;
+  settings_.max_catch_up = std::max(settings_.max_catch_up, 1);
+  period_ = Seconds(settings_.tick_rate > 0.0 ? 1.0 / settings_.tick_rate : 1.0 / 60.0);
+}
+
+void TickScheduler::start(Clock::time_point now) {
+  next_deadline_ = now;
+  window_start_ = now;
+  window_ticks_ = 0;
+  slack_measured_ = false;
+  stats_ = TickSchedulerStats();
+}
+
+int TickScheduler::begin(Clock::time_point now) {
+  if (settings_.max_speed) {
+    next_deadline_ = now;
+    window_ticks_++;
+    stats_.ticks++;
+    return 1;
+  }
+  if (now < next_deadline_) return 0;
+
+  const auto period = std::chrono::duration_cast<Clock::duration>(period_);
+  const uint64_t owed = static_cast<uint64_t>((now - next_deadline_) / period) + 1;
+  const uint64_t steps = std::min<uint64_t>(owed, static_cast<uint64_t>(settings_.max_catch_up));
+  stats_.dropped_ticks += owed - steps;
+  stats_.ticks += steps;
+  window_ticks_ += steps;
+  next_deadline_ += period * static_cast<Clock::rep>(owed);
+  return static_cast<int>(steps);
+}
+
+void TickScheduler::end(Clock::time_point now) {
+  const double slack = Seconds(next_deadline_ - now).count();
+  if (!settings_.max_speed) {
+    if (slack < 0.0) stats_.overruns++;
+    stats_.min_slack = slack_measured_ ? std::min(stats_.min_slack, slack) : slack;
+    stats_.last_slack = slack;
+    slack_measured_ = true;
+  }
+
+  const double window = Seconds(now - window_start_).count();
+  if (window >= 1.0) {
+    stats_.achieved_rate = window_ticks_ / window;
+    window_start_ = now;
+    window_ticks_ = 0;
+  }
+}
+
+}
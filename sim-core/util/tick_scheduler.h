@@ -0,0 +1,81 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+namespace navora::util {
+
+struct TickSchedulerSettings {
+  // Target fixed steps per second of wall time.
+  double tick_rate = 60.0;
+  // Most steps run back to back on one wake-up when behind. Time owed beyond
+  // that is dropped rather than accumulated, so a long stall does not turn
+  // into a burst of catch-up steps.
+  int max_catch_up = 4;
+  // Offline runs: step as fast as possible, one step per wake-up, no sleeping.
+  bool max_speed = false;
+};
+
+struct TickSchedulerStats {
+  uint64_t ticks = 0;
+  // Wake-ups that finished after the next step was already due.
+  uint64_t overruns = 0;
+  // Steps skipped because more than max_catch_up were owed.
+  uint64_t dropped_ticks = 0;
+  // Steps per second of wall time over the last completed second.
+  double achieved_rate = 0.0;
+  // Time left before the next deadline when the last wake-up finished;
+  // negative on an overrun. min_slack is the lowest since start().
+  double last_slack = 0.0;
+  double min_slack = 0.0;
+};
+
+// Fixed-step scheduler on absolute deadlines. Step n is due at
+// start + n * period on a monotonic clock, so the achieved rate does not drift
+// with step cost or sleep jitter the way a fixed sleep after each step does.
+// The caller loops:
+//
+//   if (int steps = scheduler.begin(Clock::now())) {
+//     ... run steps fixed steps ...
+//     scheduler.end(Clock::now());
+//   }
+//   sleep until scheduler.next_deadline() unless max_speed
+//
+// Not thread safe; guard it together with the simulation it paces.
+class TickScheduler {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit TickScheduler(const TickSchedulerSettings& settings = TickSchedulerSettings()) { configure(settings); }
+
+  // Takes effect from the next start().
+  void configure(const TickSchedulerSettings& settings);
+  const TickSchedulerSettings& get_settings() const { return settings_; }
+  // Seconds per step.
+  double get_period() const { return period_.count(); }
+
+  // Resets stats; the first step is due at now.
+  void start(Clock::time_point now);
+
+  // Number of steps to run now: 0 if the next deadline has not arrived,
+  // otherwise every step owed up to max_catch_up.
+  int begin(Clock::time_point now);
+  // Called once the steps from a non-zero begin() have run.
+  void end(Clock::time_point now);
+
+  Clock::time_point next_deadline() const { return next_deadline_; }
+  const TickSchedulerStats& get_stats() const { return stats_; }
+
+private:
+  using Seconds = std::chrono::duration<double>;
+
+  TickSchedulerSettings settings_;
+  Seconds period_{1.0 / 60.0};
+  Clock::time_point next_deadline_;
+  Clock::time_point window_start_;
+  uint64_t window_ticks_ = 0;
+  bool slack_measured_ = false;
+  TickSchedulerStats stats_;
+};
+
+}
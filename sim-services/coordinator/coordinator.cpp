@@ -4,53 +4,119 @@
 #include <unordered_map>
 #include <vector>
 #include <atomic>
+#include <condition_variable>
 #include <sstream>
 #include <iomanip>
+#include <limits>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <memory>
+#include <google/protobuf/arena.h>
 #include "sim.pb.h"
 #include "sim.grpc.pb.h"
 #include "../../sim-core/simulator.h"
+#include "../../sim-core/util/tick_scheduler.h"
+#include "../../sim-core/util/checkpoint.h"
+#include "../../sim-core/util/packed_transform.h"
+#include "../../sim-core/usd/usd_async_export.h"
 
 using grpc::Server;
 using grpc::ServerBuilder;
-using grpc::ServerContext;
+using grpc::CallbackServerContext;
+using grpc::ServerUnaryReactor;
 using grpc::Status;
 
-class CoordinatorServiceImpl final : public navora::sim::SimulationCoordinator::Service {
+// The coordinator's world precision is a build option; everything below goes
+// through these aliases, and the wire format is double either way.
+#ifdef NAVORA_SINGLE_PRECISION
+using SimWorld = navora::SimulatorT<float>;
+#else
+using SimWorld = navora::Simulator;
+#endif
+using Body = SimWorld::RigidBody;
+using BodyVector = SimWorld::Vector3;
+
+// Every RPC runs on the callback API, so streams cost no thread while they
+// wait for frames. StreamState is raw so frames go out as pre-serialized
+// bytes.
+using CoordinatorService = navora::sim::SimulationCoordinator::WithRawCallbackMethod_StreamState<
+    navora::sim::SimulationCoordinator::CallbackService>;
+
+class CoordinatorServiceImpl final : public CoordinatorService {
 public:
-  CoordinatorServiceImpl() : sim_running_(false), next_entity_id_(0) {
-    navora::physics::RigidBody floor_body;
+  explicit CoordinatorServiceImpl(const navora::util::TickSchedulerSettings& schedule)
+    : scheduler_(schedule), sim_running_(false), next_entity_id_(0) {
+    sim_.get_integrator().set_thread_count(std::max(1u, std::thread::hardware_concurrency()));
+    sim_.set_fixed_dt(scheduler_.get_period());
+
+    Body floor_body;
     floor_body.is_static = true;
     floor_body.shape.type = navora::physics::ShapeType::PLANE;
-    floor_body.shape.normal = navora::physics::Vector3(0, 1, 0);
+    floor_body.shape.normal = BodyVector(0, 1, 0);
     floor_body.shape.offset = 0.0;
-    floor_body.transform.position = navora::physics::Vector3(0, -5, 0);
+    floor_body.transform.position = BodyVector(0, -5, 0);
     sim_.create_entity("floor", floor_body);
 
-    navora::physics::RigidBody sphere1_body;
+    Body sphere1_body;
     sphere1_body.mass = 1.0;
     sphere1_body.inv_mass = 1.0;
     sphere1_body.shape.type = navora::physics::ShapeType::SPHERE;
-    sphere1_body.shape.size = navora::physics::Vector3(1.0, 1.0, 1.0);
-    sphere1_body.transform.position = navora::physics::Vector3(0, 5, 0);
+    sphere1_body.shape.size = BodyVector(1.0, 1.0, 1.0);
+    sphere1_body.transform.position = BodyVector(0, 5, 0);
     sim_.create_entity("sphere_0", sphere1_body);
 
-    navora::physics::RigidBody sphere2_body;
+    Body sphere2_body;
     sphere2_body.mass = 1.5;
     sphere2_body.inv_mass = 1.0 / 1.5;
     sphere2_body.shape.type = navora::physics::ShapeType::SPHERE;
-    sphere2_body.shape.size = navora::physics::Vector3(0.8, 0.8, 0.8);
-    sphere2_body.transform.position = navora::physics::Vector3(-2, 8, 0);
+    sphere2_body.shape.size = BodyVector(0.8, 0.8, 0.8);
+    sphere2_body.transform.position = BodyVector(-2, 8, 0);
     sim_.create_entity("sphere_1", sphere2_body);
 
     sim_.start();
     sim_running_ = true;
     tick_thread_ = std::thread(&CoordinatorServiceImpl::tick_loop, this);
+    fan_out_thread_ = std::thread(&CoordinatorServiceImpl::fan_out_loop, this);
   }
 
-  Status StartSimulation(ServerContext* context, const navora::sim::Command* request,
-                         navora::sim::CommandResponse* response) override {
+  // Replaces the built-in scene with the entities of a USD file.
+  bool load_scene(const std::string& path, std::string& error) {
+#ifdef USD_FOUND
     std::lock_guard<std::mutex> lock(mutex_);
+    if (!sim_.load_usd(path)) {
+      error = "Failed to load " + path;
+      return false;
+    }
+    return true;
+#else
+    error = "Loading scenes requires a build with USD";
+    return false;
+#endif
+  }
+
+  ~CoordinatorServiceImpl() override {
+    sim_running_ = false;
+    if (tick_thread_.joinable()) tick_thread_.join();
+    {
+      std::lock_guard<std::mutex> lock(streams_mutex_);
+      fan_out_stop_ = true;
+    }
+    frames_cv_.notify_one();
+    fan_out_thread_.join();
+  }
+
+  ServerUnaryReactor* StartSimulation(CallbackServerContext* context, const navora::sim::Command* request,
+                                      navora::sim::CommandResponse* response) override {
+    std::unique_lock<std::mutex> lock(mutex_);
     if (!sim_running_) {
+      // A stopped loop may still be finishing its last wake-up, which needs
+      // the lock.
+      if (tick_thread_.joinable()) {
+        lock.unlock();
+        tick_thread_.join();
+        lock.lock();
+      }
       sim_.start();
       sim_running_ = true;
       tick_thread_ = std::thread(&CoordinatorServiceImpl::tick_loop, this);
@@ -60,11 +126,11 @@ public:
       response->set_success(false);
       response->set_error("Simulation already running");
     }
-    return Status::OK;
+    return reply(context, Status::OK);
   }
 
-  Status StopSimulation(ServerContext* context, const navora::sim::Command* request,
-                        navora::sim::CommandResponse* response) override {
+  ServerUnaryReactor* StopSimulation(CallbackServerContext* context, const navora::sim::Command* request,
+                                     navora::sim::CommandResponse* response) override {
     std::lock_guard<std::mutex> lock(mutex_);
     if (sim_running_) {
       sim_.stop();
@@ -74,110 +140,80 @@ public:
       response->set_success(false);
       response->set_error("Simulation not running");
     }
-    return Status::OK;
+    return reply(context, Status::OK);
   }
 
-  Status GetStatus(ServerContext* context, const navora::sim::Command* request,
-                   navora::sim::SimulationStatus* response) override {
+  ServerUnaryReactor* GetStatus(CallbackServerContext* context, const navora::sim::Command* request,
+                                navora::sim::SimulationStatus* response) override {
     std::lock_guard<std::mutex> lock(mutex_);
     response->set_running(sim_running_);
     response->set_current_tick(sim_.get_tick());
     response->set_sim_time(sim_.get_sim_time());
     response->set_consumer_count(consumers_.size());
-    return Status::OK;
+    const auto& stats = scheduler_.get_stats();
+    response->set_target_tick_rate(scheduler_.get_settings().tick_rate);
+    response->set_achieved_tick_rate(stats.achieved_rate);
+    response->set_last_slack_ms(stats.last_slack * 1000.0);
+    response->set_min_slack_ms(stats.min_slack * 1000.0);
+    response->set_overruns(stats.overruns);
+    response->set_dropped_ticks(stats.dropped_ticks);
+    response->set_max_speed(scheduler_.get_settings().max_speed);
+    return reply(context, Status::OK);
   }
 
-  Status StreamState(ServerContext* context, const navora::sim::StreamRequest* request,
-                     grpc::ServerWriter<navora::sim::StateDelta>* writer) override {
-    std::string consumer_id = request->consumer_id();
-    if (consumer_id.empty()) {
-      consumer_id = "consumer_" + std::to_string(consumers_.size());
+  // Streams are served from frames the tick thread publishes (see
+  // publish_frame), so writers never take the simulation lock after joining;
+  // a stream that has sent everything parks until the fan-out thread hands it
+  // the next frame.
+  // A stream starts from the full state of the frame it joins at, flagged
+  // with reset, then sends every frame's delta in order. A stream that falls
+  // behind the frame history parks until the tick thread publishes a frame
+  // with the full state and resyncs from it. start_tick is informational, a
+  // new stream always starts with a full sync.
+  grpc::ServerWriteReactor<grpc::ByteBuffer>* StreamState(CallbackServerContext* context,
+                                                          const grpc::ByteBuffer* request) override {
+    navora::sim::StreamRequest stream_request;
+    grpc::ByteBuffer request_bytes(*request);
+    if (!grpc::SerializationTraits<navora::sim::StreamRequest>::Deserialize(&request_bytes, &stream_request).ok()) {
+      return new RejectedStream(Status(grpc::StatusCode::INVALID_ARGUMENT, "Malformed StreamRequest"));
     }
 
+    FramePtr frame;
+    std::string consumer_id = stream_request.consumer_id();
+    const bool packed = stream_request.encoding() == navora::sim::PACKED;
     {
       std::lock_guard<std::mutex> lock(mutex_);
-      consumers_[consumer_id] = true;
-    }
-
-    uint64_t last_tick = request->start_tick();
-    bool sent_initial = false;
-    
-    while (!context->IsCancelled()) {
-      std::this_thread::sleep_for(std::chrono::milliseconds(16));
-
-      std::lock_guard<std::mutex> lock(mutex_);
-      
-      if (!sent_initial || sim_.get_tick() > last_tick) {
-        navora::sim::StateDelta delta;
-        auto* metadata = delta.mutable_metadata();
-        metadata->set_tick(sim_.get_tick());
-        metadata->set_sim_time(sim_.get_sim_time());
-        metadata->set_delta_time(sim_.get_fixed_dt());
-
-        auto entity_ids = sim_.get_all_entity_ids();
-        for (const auto& id : entity_ids) {
-          navora::physics::RigidBody body;
-          if (sim_.get_entity(id, body)) {
-            auto* updated = delta.add_updated();
-            updated->set_id(id);
-            auto* transform = updated->mutable_transform();
-            transform->mutable_position()->set_x(body.transform.position.x);
-            transform->mutable_position()->set_y(body.transform.position.y);
-            transform->mutable_position()->set_z(body.transform.position.z);
-            transform->mutable_rotation()->set_x(body.transform.rotation.x);
-            transform->mutable_rotation()->set_y(body.transform.rotation.y);
-            transform->mutable_rotation()->set_z(body.transform.rotation.z);
-            transform->mutable_rotation()->set_w(body.transform.rotation.w);
-            auto* physics = updated->mutable_physics();
-            physics->mutable_linear_velocity()->set_x(body.linear_velocity.x);
-            physics->mutable_linear_velocity()->set_y(body.linear_velocity.y);
-            physics->mutable_linear_velocity()->set_z(body.linear_velocity.z);
-            
-            auto* shape = updated->mutable_shape();
-            if (body.shape.type == navora::physics::ShapeType::SPHERE) {
-              shape->set_type(navora::sim::CollisionShape::SPHERE);
-            } else if (body.shape.type == navora::physics::ShapeType::PLANE) {
-              shape->set_type(navora::sim::CollisionShape::PLANE);
-            } else {
-              shape->set_type(navora::sim::CollisionShape::AABB);
-            }
-            shape->mutable_size()->set_x(body.shape.size.x);
-            shape->mutable_size()->set_y(body.shape.size.y);
-            shape->mutable_size()->set_z(body.shape.size.z);
-          }
-        }
-
-        if (!writer->Write(delta)) {
-          break;
-        }
-        sent_initial = true;
-        last_tick = sim_.get_tick();
+      if (consumer_id.empty()) {
+        consumer_id = "consumer_" + std::to_string(consumers_.size());
       }
+      consumers_[consumer_id]++;
+      if (packed) packed_streams_++;
+      frame = publish_frame(true);
     }
 
-    {
-      std::lock_guard<std::mutex> lock(mutex_);
-      consumers_.erase(consumer_id);
-    }
-
-    return Status::OK;
+    auto* stream = new StateStream(this, std::move(consumer_id), packed);
+    std::lock_guard<std::mutex> lock(streams_mutex_);
+    stream->write(frame, stream->full_of(*frame));
+    return stream;
   }
 
-  Status SendCommand(ServerContext* context, const navora::sim::Command* request,
-                     navora::sim::CommandResponse* response) override {
+  ServerUnaryReactor* SendCommand(CallbackServerContext* context, const navora::sim::Command* request,
+                                  navora::sim::CommandResponse* response) override {
     std::lock_guard<std::mutex> lock(mutex_);
+    const uint64_t version = sim_.get_change_version();
 
     switch (request->type()) {
       case navora::sim::Command::APPLY_FORCE: {
-        navora::physics::RigidBody body;
-        if (sim_.get_entity(request->entity_id(), body)) {
-          navora::physics::Vector3 force(
+        navora::EntityHandle handle = resolve_entity(*request);
+        Body body;
+        if (sim_.get_entity(handle, body)) {
+          BodyVector force(
             request->force().x(),
             request->force().y(),
             request->force().z()
           );
-          body.apply_force(force, navora::physics::DEFAULT_DELTA_TIME);
-          sim_.update_entity(request->entity_id(), body);
+          body.apply_force(force, static_cast<SimWorld::Scalar>(sim_.get_fixed_dt()));
+          sim_.update_entity(handle, body);
           response->set_success(true);
         } else {
           response->set_success(false);
@@ -186,15 +222,16 @@ public:
         break;
       }
       case navora::sim::Command::APPLY_IMPULSE: {
-        navora::physics::RigidBody body;
-        if (sim_.get_entity(request->entity_id(), body)) {
-          navora::physics::Vector3 impulse(
+        navora::EntityHandle handle = resolve_entity(*request);
+        Body body;
+        if (sim_.get_entity(handle, body)) {
+          BodyVector impulse(
             request->force().x(),
             request->force().y(),
             request->force().z()
           );
           body.apply_impulse(impulse);
-          sim_.update_entity(request->entity_id(), body);
+          sim_.update_entity(handle, body);
           response->set_success(true);
         } else {
           response->set_success(false);
@@ -206,8 +243,8 @@ public:
         std::stringstream ss;
         ss << "entity_" << std::setfill('0') << std::setw(4) << next_entity_id_++;
         std::string id = ss.str();
-        navora::physics::RigidBody body;
-        body.transform.position = navora::physics::Vector3(
+        Body body;
+        body.transform.position = BodyVector(
           request->position().x(),
           request->position().y(),
           request->position().z()
@@ -217,7 +254,15 @@ public:
         if (request->has_shape()) {
           if (request->shape().type() == navora::sim::CollisionShape::SPHERE) {
             body.shape.type = navora::physics::ShapeType::SPHERE;
-            body.shape.size = navora::physics::Vector3(
+            body.shape.size = BodyVector(
+              request->shape().size().x(),
+              request->shape().size().y(),
+              request->shape().size().z()
+            );
+          } else if (request->shape().type() == navora::sim::CollisionShape::AABB) {
+            // size holds the box half extents.
+            body.shape.type = navora::physics::ShapeType::AABB;
+            body.shape.size = BodyVector(
               request->shape().size().x(),
               request->shape().size().y(),
               request->shape().size().z()
@@ -225,25 +270,26 @@ public:
           }
         } else {
           body.shape.type = navora::physics::ShapeType::SPHERE;
-          body.shape.size = navora::physics::Vector3(1.0, 1.0, 1.0);
+          body.shape.size = BodyVector(1.0, 1.0, 1.0);
         }
-        sim_.create_entity(id, body);
-        response->set_success(true);
+        navora::EntityHandle handle = sim_.create_entity(id, body);
+        response->set_success(static_cast<bool>(handle));
+        response->set_entity_handle(handle.to_u64());
         break;
       }
       case navora::sim::Command::REMOVE_ENTITY: {
-        sim_.remove_entity(request->entity_id());
+        sim_.remove_entity(resolve_entity(*request));
         response->set_success(true);
         break;
       }
       case navora::sim::Command::RESET_SIM: {
         sim_.stop();
         sim_.reset();
-        navora::physics::RigidBody floor_body;
+        Body floor_body;
         floor_body.is_static = true;
         floor_body.shape.type = navora::physics::ShapeType::PLANE;
-        floor_body.shape.normal = navora::physics::Vector3(0, 1, 0);
-        floor_body.transform.position = navora::physics::Vector3(0, -5, 0);
+        floor_body.shape.normal = BodyVector(0, 1, 0);
+        floor_body.transform.position = BodyVector(0, -5, 0);
         sim_.create_entity("floor", floor_body);
         sim_.start();
         response->set_success(true);
@@ -254,32 +300,684 @@ public:
         response->set_error("Unknown command type");
     }
 
+    // Commands that changed nothing (failed, unknown, no-op) take no slot in
+    // the frame history, so a burst of them cannot push streams into a resync.
+    if (sim_.get_change_version() != version) publish_frame(false);
     response->set_tick(sim_.get_tick());
-    return Status::OK;
+    return reply(context, Status::OK);
+  }
+
+  ServerUnaryReactor* Query(CallbackServerContext* context, const navora::sim::QueryRequest* request,
+                            navora::sim::QueryResponse* response) override {
+    std::vector<navora::physics::Ray> rays;
+    std::vector<navora::physics::SphereSweep> sweeps;
+    std::vector<navora::physics::Sphere> spheres;
+    std::vector<navora::physics::AABB> boxes;
+    std::vector<int> slot(request->queries_size());
+
+    for (int q = 0; q < request->queries_size(); ++q) {
+      const auto& query = request->queries(q);
+      navora::physics::Vector3 origin = to_vector(query.origin());
+      double max_distance = query.max_distance() > 0 ? query.max_distance()
+                                                     : std::numeric_limits<double>::infinity();
+      switch (query.type()) {
+        case navora::sim::Query::RAYCAST:
+          slot[q] = static_cast<int>(rays.size());
+          rays.push_back({origin, to_vector(query.direction()), max_distance});
+          break;
+        case navora::sim::Query::SWEEP_SPHERE:
+          slot[q] = static_cast<int>(sweeps.size());
+          sweeps.push_back({origin, to_vector(query.direction()), query.radius(), max_distance});
+          break;
+        case navora::sim::Query::OVERLAP_SPHERE:
+          slot[q] = static_cast<int>(spheres.size());
+          spheres.push_back({origin, query.radius()});
+          break;
+        case navora::sim::Query::OVERLAP_AABB: {
+          navora::physics::Vector3 half = to_vector(query.half_extents());
+          slot[q] = static_cast<int>(boxes.size());
+          boxes.push_back(navora::physics::AABB(origin - half, origin + half));
+          break;
+        }
+        default:
+          return reply(context, Status(grpc::StatusCode::INVALID_ARGUMENT, "Unknown query type"));
+      }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<navora::physics::QueryHit> ray_hits;
+    std::vector<navora::physics::QueryHit> sweep_hits;
+    navora::physics::OverlapResults sphere_results;
+    navora::physics::OverlapResults box_results;
+    sim_.raycast(rays, ray_hits);
+    sim_.sweep_sphere(sweeps, sweep_hits);
+    sim_.overlap_sphere(spheres, sphere_results);
+    sim_.overlap_aabb(boxes, box_results);
+
+    response->set_tick(sim_.get_tick());
+    for (int q = 0; q < request->queries_size(); ++q) {
+      auto* result = response->add_results();
+      switch (request->queries(q).type()) {
+        case navora::sim::Query::RAYCAST:
+          fill_hit(ray_hits[slot[q]], result);
+          break;
+        case navora::sim::Query::SWEEP_SPHERE:
+          fill_hit(sweep_hits[slot[q]], result);
+          break;
+        case navora::sim::Query::OVERLAP_SPHERE:
+          fill_overlaps(sphere_results, slot[q], result);
+          break;
+        case navora::sim::Query::OVERLAP_AABB:
+          fill_overlaps(box_results, slot[q], result);
+          break;
+        default:
+          break;
+      }
+    }
+    return reply(context, Status::OK);
+  }
+
+  ServerUnaryReactor* Checkpoint(CallbackServerContext* context,
+                                 const navora::sim::CheckpointRequest* request,
+                                 navora::sim::CheckpointResponse* response) override {
+    if (request->discard()) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      response->set_success(checkpoints_.erase(request->name()) > 0);
+      if (!response->success()) response->set_error("Checkpoint not found");
+      return reply(context, Status::OK);
+    }
+    if (request->name().empty() && request->path().empty()) {
+      response->set_success(false);
+      response->set_error("No name or path");
+      return reply(context, Status::OK);
+    }
+
+    std::vector<char> image;
+    uint64_t tick;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      sim_.save_checkpoint(image);
+      tick = sim_.get_tick();
+    }
+    response->set_tick(tick);
+    response->set_size_bytes(image.size());
+
+    // The file is written outside the lock so the tick loop keeps its pace.
+    if (!request->path().empty() && !navora::util::replace_file(request->path(), image.data(), image.size())) {
+      response->set_success(false);
+      response->set_error("Failed to write " + request->path());
+      return reply(context, Status::OK);
+    }
+    if (!request->name().empty()) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      checkpoints_[request->name()] = std::move(image);
+    }
+    response->set_success(true);
+    return reply(context, Status::OK);
+  }
+
+  ServerUnaryReactor* Restore(CallbackServerContext* context, const navora::sim::RestoreRequest* request,
+                              navora::sim::CommandResponse* response) override {
+    navora::util::MappedFile file;
+    if (!request->path().empty() && !file.open(request->path())) {
+      response->set_success(false);
+      response->set_error("Failed to open " + request->path());
+      return reply(context, Status::OK);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    bool restored;
+    if (file.data()) {
+      restored = sim_.load_checkpoint(file.data(), file.size());
+    } else {
+      auto it = checkpoints_.find(request->name());
+      if (it == checkpoints_.end()) {
+        response->set_success(false);
+        response->set_error("Checkpoint not found");
+        response->set_tick(sim_.get_tick());
+        return reply(context, Status::OK);
+      }
+      restored = sim_.load_checkpoint(it->second.data(), it->second.size());
+    }
+    if (restored) {
+      publish_frame(false);
+      response->set_success(true);
+    } else {
+      response->set_success(false);
+      response->set_error("Invalid checkpoint");
+    }
+    response->set_tick(sim_.get_tick());
+    return reply(context, Status::OK);
+  }
+
+  // Only the snapshot is taken under the lock; authoring and writing run on
+  // the exporter's thread, so ticks and streams carry on during the export.
+  ServerUnaryReactor* ExportScene(CallbackServerContext* context, const navora::sim::ExportRequest* request,
+                                  navora::sim::ExportResponse* response) override {
+    if (request->path().empty()) {
+      response->set_accepted(false);
+      response->set_error("No path");
+      return reply(context, Status::OK);
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    exporter_.export_async(sim_, request->path());
+    response->set_accepted(true);
+    response->set_tick(sim_.get_tick());
+    return reply(context, Status::OK);
+  }
+
+  ServerUnaryReactor* GetExportStatus(CallbackServerContext* context, const navora::sim::Command* request,
+                                      navora::sim::ExportStatus* response) override {
+    const navora::usd::ExportStatus status = exporter_.get_status();
+    response->set_busy(status.busy);
+    response->set_queued(static_cast<uint32_t>(status.queued));
+    response->set_completed(status.completed);
+    response->set_failed(status.failed);
+    response->set_superseded(status.superseded);
+    response->set_last_success(status.last.success);
+    response->set_last_path(status.last.path);
+    response->set_last_error(status.last.error);
+    response->set_last_tick(status.last.tick);
+    response->set_last_seconds(status.last.seconds);
+    return reply(context, Status::OK);
   }
 
 private:
+  // Unary handlers do their work inline on the callback thread and complete
+  // before returning.
+  static ServerUnaryReactor* reply(CallbackServerContext* context, const Status& status) {
+    ServerUnaryReactor* reactor = context->DefaultReactor();
+    reactor->Finish(status);
+    return reactor;
+  }
+
+  // Commands may carry a handle, which skips the name lookup entirely.
+  navora::EntityHandle resolve_entity(const navora::sim::Command& command) const {
+    if (command.entity_handle() != 0) {
+      return navora::EntityHandle::from_u64(command.entity_handle());
+    }
+    return sim_.find_entity(command.entity_id());
+  }
+
+  static navora::physics::Vector3 to_vector(const navora::sim::Vector3& v) {
+    return navora::physics::Vector3(v.x(), v.y(), v.z());
+  }
+
+  static void set_vector(navora::sim::Vector3* out, const navora::physics::Vector3& v) {
+    out->set_x(v.x);
+    out->set_y(v.y);
+    out->set_z(v.z);
+  }
+
+  static void fill_entity(const std::string& id, navora::EntityHandle handle, const Body& body,
+                          bool with_shape, navora::sim::Entity* entity) {
+    entity->set_id(id);
+    entity->set_handle(handle.to_u64());
+    auto* transform = entity->mutable_transform();
+    transform->mutable_position()->set_x(body.transform.position.x);
+    transform->mutable_position()->set_y(body.transform.position.y);
+    transform->mutable_position()->set_z(body.transform.position.z);
+    transform->mutable_rotation()->set_x(body.transform.rotation.x);
+    transform->mutable_rotation()->set_y(body.transform.rotation.y);
+    transform->mutable_rotation()->set_z(body.transform.rotation.z);
+    transform->mutable_rotation()->set_w(body.transform.rotation.w);
+    auto* physics = entity->mutable_physics();
+    physics->mutable_linear_velocity()->set_x(body.linear_velocity.x);
+    physics->mutable_linear_velocity()->set_y(body.linear_velocity.y);
+    physics->mutable_linear_velocity()->set_z(body.linear_velocity.z);
+    if (!with_shape) return;
+
+    auto* shape = entity->mutable_shape();
+    if (body.shape.type == navora::physics::ShapeType::SPHERE) {
+      shape->set_type(navora::sim::CollisionShape::SPHERE);
+    } else if (body.shape.type == navora::physics::ShapeType::PLANE) {
+      shape->set_type(navora::sim::CollisionShape::PLANE);
+    } else {
+      shape->set_type(navora::sim::CollisionShape::AABB);
+    }
+    shape->mutable_size()->set_x(body.shape.size.x);
+    shape->mutable_size()->set_y(body.shape.size.y);
+    shape->mutable_size()->set_z(body.shape.size.z);
+  }
+
+  // One publication of the world, serialized once and shared by every
+  // stream. delta brings a consumer from the previous frame to this one; full,
+  // when present, is the whole world for streams joining at this frame. The
+  // packed pair is the same in the PACKED encoding, built while any stream
+  // uses it.
+  struct StateFrame {
+    uint64_t seq;
+    uint64_t version;
+    grpc::ByteBuffer delta;
+    grpc::ByteBuffer full;
+    grpc::ByteBuffer packed_delta;
+    grpc::ByteBuffer packed_full;
+  };
+  using FramePtr = std::shared_ptr<const StateFrame>;
+
+  // Frames streams can still catch up through, about a second at 60 Hz.
+  static constexpr uint64_t FRAME_HISTORY = 64;
+
+  // Ends a stream without writing, for requests that cannot be served.
+  class RejectedStream final : public grpc::ServerWriteReactor<grpc::ByteBuffer> {
+  public:
+    explicit RejectedStream(const Status& status) { Finish(status); }
+    void OnDone() override { delete this; }
+  };
+
+  class StateStream final : public grpc::ServerWriteReactor<grpc::ByteBuffer> {
+  public:
+    StateStream(CoordinatorServiceImpl* service, std::string consumer_id, bool packed)
+      : service_(service), consumer_id_(std::move(consumer_id)), packed_(packed) {}
+
+    const grpc::ByteBuffer* delta_of(const StateFrame& frame) const {
+      return packed_ ? &frame.packed_delta : &frame.delta;
+    }
+    const grpc::ByteBuffer* full_of(const StateFrame& frame) const {
+      return packed_ ? &frame.packed_full : &frame.full;
+    }
+
+    // Called with streams_mutex_ held.
+    void write(FramePtr frame, const grpc::ByteBuffer* bytes) {
+      frame_ = std::move(frame);
+      writing_ = true;
+      StartWrite(bytes);
+    }
+
+    // Writes the frame after the last one sent, or parks the stream until the
+    // next publish. A stream that fell out of the frame history resyncs from
+    // the latest frame if it has the full state, and otherwise parks until
+    // the tick thread publishes one. Called with streams_mutex_ held.
+    void advance() {
+      if (lagging_) {
+        FramePtr latest = std::atomic_load(&service_->latest_frame_);
+        if (latest && full_of(*latest)->Valid()) {
+          lagging_ = false;
+          write(latest, full_of(*latest));
+          return;
+        }
+        service_->full_frame_wanted_ = true;
+        park(service_->lagging_streams_);
+        return;
+      }
+      if (FramePtr next = service_->frame_at(frame_->seq + 1)) {
+        write(next, delta_of(*next));
+        return;
+      }
+      FramePtr latest = std::atomic_load(&service_->latest_frame_);
+      if (!latest || latest->seq <= frame_->seq) {
+        park(service_->waiting_streams_);
+        return;
+      }
+      lagging_ = true;
+      advance();
+    }
+
+    void OnWriteDone(bool ok) override {
+      std::lock_guard<std::mutex> lock(service_->streams_mutex_);
+      writing_ = false;
+      if (!ok || cancelled_) {
+        finish();
+        return;
+      }
+      advance();
+    }
+
+    void OnCancel() override {
+      std::lock_guard<std::mutex> lock(service_->streams_mutex_);
+      cancelled_ = true;
+      if (waiting_) {
+        auto& waiting = lagging_ ? service_->lagging_streams_ : service_->waiting_streams_;
+        waiting.erase(std::find(waiting.begin(), waiting.end(), this));
+        waiting_ = false;
+      }
+      if (!writing_) finish();
+    }
+
+    void OnDone() override {
+      {
+        std::lock_guard<std::mutex> lock(service_->mutex_);
+        auto it = service_->consumers_.find(consumer_id_);
+        if (--it->second == 0) service_->consumers_.erase(it);
+        if (packed_) service_->packed_streams_--;
+      }
+      delete this;
+    }
+
+  private:
+    friend class CoordinatorServiceImpl;
+
+    void park(std::vector<StateStream*>& streams) {
+      waiting_ = true;
+      streams.push_back(this);
+    }
+
+    void finish() {
+      if (finished_) return;
+      finished_ = true;
+      Finish(Status::OK);
+    }
+
+    CoordinatorServiceImpl* service_;
+    std::string consumer_id_;
+    bool packed_;
+    FramePtr frame_;
+    bool writing_ = false;
+    bool waiting_ = false;
+    // Fell out of the frame history; the next write is a full frame.
+    bool lagging_ = false;
+    bool cancelled_ = false;
+    bool finished_ = false;
+  };
+
+  // Builds, serializes and publishes a frame of everything that changed since
+  // the previous one and wakes the fan-out thread. Called with mutex_ held,
+  // after ticks and commands. with_full adds the full state for joining
+  // streams, as does a lagging stream waiting for one; the latest frame is
+  // reused when it already has it.
+  FramePtr publish_frame(bool with_full) {
+    with_full = full_frame_wanted_.exchange(false) || with_full;
+    FramePtr latest = std::atomic_load(&latest_frame_);
+    const uint64_t version = sim_.get_change_version();
+    if (consumers_.empty()) {
+      // Nobody to stream to; the next stream starts from a full frame.
+      if (latest) std::atomic_store(&latest_frame_, FramePtr());
+      sim_.trim_changes(version);
+      return nullptr;
+    }
+    const bool packed = packed_streams_ > 0;
+    if (latest && latest->version == version &&
+        (!with_full || (latest->full.Valid() && (!packed || latest->packed_full.Valid())))) {
+      return latest;
+    }
+
+    const uint64_t baseline = latest ? latest->version : 0;
+    auto frame = std::make_shared<StateFrame>();
+    frame->seq = ++frame_seq_;
+    frame->version = version;
+    frame->delta = serialize_delta(baseline, !latest, false);
+    if (with_full) frame->full = latest ? serialize_delta(0, true, false) : frame->delta;
+    if (packed) {
+      // The packer only holds what consumers hold if it encoded every frame
+      // up to the baseline; otherwise it restarts with a key frame.
+      if (packed_version_ != baseline || !latest) packer_.clear();
+      frame->packed_delta = serialize_delta(baseline, !latest, true);
+      packed_version_ = version;
+      if (with_full) frame->packed_full = serialize_full_packed();
+    } else {
+      packed_version_ = 0;
+    }
+    sim_.trim_changes(version);
+
+    FramePtr published = std::move(frame);
+    std::atomic_store(&frames_[published->seq % FRAME_HISTORY], published);
+    std::atomic_store(&latest_frame_, published);
+    {
+      std::lock_guard<std::mutex> lock(streams_mutex_);
+      published_seq_ = published->seq;
+    }
+    frames_cv_.notify_one();
+    return published;
+  }
+
+  // Hands each published frame to the streams parked waiting for it, so
+  // neither the tick thread nor the simulation lock pays per consumer. Never
+  // takes mutex_: lagging streams wait for the tick thread's next full frame.
+  void fan_out_loop() {
+    std::vector<StateStream*> waiting;
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(streams_mutex_);
+    while (true) {
+      frames_cv_.wait(lock, [&] { return fan_out_stop_ || published_seq_ != seen; });
+      if (fan_out_stop_) break;
+      seen = published_seq_;
+      for (auto* parked : {&waiting_streams_, &lagging_streams_}) {
+        waiting.swap(*parked);
+        for (auto* stream : waiting) {
+          stream->waiting_ = false;
+          stream->advance();
+        }
+        waiting.clear();
+      }
+    }
+  }
+
+  FramePtr frame_at(uint64_t seq) const {
+    FramePtr frame = std::atomic_load(&frames_[seq % FRAME_HISTORY]);
+    return frame && frame->seq == seq ? frame : nullptr;
+  }
+
+  // The changes since baseline, or the whole world when full is set or the
+  // world was reset after baseline. packed encodes for PACKED streams and
+  // advances packer_ to this frame.
+  grpc::ByteBuffer serialize_delta(uint64_t baseline, bool full, bool packed) {
+    auto* delta = begin_delta();
+    const auto& entity_ids = sim_.get_all_entity_ids();
+    const auto& entity_handles = sim_.get_all_entity_handles();
+    const auto& changes = sim_.get_entity_changes();
+    const auto& bodies = sim_.get_bodies();
+    full = full || baseline < sim_.get_reset_version();
+    delta->set_reset(full);
+    packed_entities_.clear();
+    // A delta visits only the entities changed since the last trim, which
+    // publish_frame() keeps at the baseline, in body index order as a full
+    // pass does.
+    delta_indices_.clear();
+    if (!full) {
+      for (navora::EntityHandle handle : sim_.get_changed_entities()) {
+        uint32_t index = sim_.get_body_index(handle);
+        if (index != navora::EntityTable::NO_INDEX) delta_indices_.push_back(index);
+      }
+      std::sort(delta_indices_.begin(), delta_indices_.end());
+    }
+    const size_t visit_count = full ? entity_ids.size() : delta_indices_.size();
+    Body body;
+    for (size_t k = 0; k < visit_count; ++k) {
+      const uint32_t i = full ? static_cast<uint32_t>(k) : delta_indices_[k];
+      const auto& change = changes[i];
+      const bool created = full || change.created > baseline;
+      const bool changed = change.changed > baseline;
+      if (!created && !changed && change.moved <= baseline) continue;
+
+      bodies.get(i, body);
+      if (packed) add_packed_entity(entity_handles[i], body);
+      navora::sim::Entity* entity;
+      if (created) {
+        entity = delta->add_created();
+      } else if (!packed || changed) {
+        entity = delta->add_updated();
+      } else {
+        continue;
+      }
+      const std::string& id = entity_ids[i];
+      fill_entity(id.empty() ? navora::default_entity_name(entity_handles[i]) : id,
+                  entity_handles[i], body, created || changed, entity);
+    }
+    if (!full) {
+      // Entities both created and removed since the baseline never reached
+      // the consumer.
+      for (const auto& removal : sim_.get_removals()) {
+        if (removal.removed <= baseline || removal.created > baseline) continue;
+        if (packed) packer_.remove(removal.handle.index);
+        delta->add_removed(removal.name);
+        delta->add_removed_handles(removal.handle.to_u64());
+      }
+    }
+
+    if (packed) {
+      if (full || !packer_.encode(packed_entities_, packed_transforms_)) {
+        if (!full) {
+          // An entity left the box: key frame of every entity on a new one.
+          packed_entities_.clear();
+          for (uint32_t i = 0; i < entity_handles.size(); ++i) {
+            bodies.get(i, body);
+            add_packed_entity(entity_handles[i], body);
+          }
+        }
+        packer_.encode_key(packed_entities_, packed_transforms_);
+      }
+      fill_packed(packed_transforms_, delta->mutable_packed());
+    }
+    return serialize(delta);
+  }
+
+  // Full state for PACKED streams joining at the frame just encoded: the
+  // transforms packer_ holds, which in-sequence consumers hold too.
+  grpc::ByteBuffer serialize_full_packed() {
+    auto* delta = begin_delta();
+    const auto& entity_ids = sim_.get_all_entity_ids();
+    const auto& entity_handles = sim_.get_all_entity_handles();
+    const auto& bodies = sim_.get_bodies();
+    delta->set_reset(true);
+    Body body;
+    for (uint32_t i = 0; i < entity_ids.size(); ++i) {
+      bodies.get(i, body);
+      const std::string& id = entity_ids[i];
+      fill_entity(id.empty() ? navora::default_entity_name(entity_handles[i]) : id,
+                  entity_handles[i], body, true, delta->add_created());
+    }
+    packer_.encode_held(packed_transforms_);
+    fill_packed(packed_transforms_, delta->mutable_packed());
+    return serialize(delta);
+  }
+
+  navora::sim::StateDelta* begin_delta() {
+    arena_.Reset();
+    auto* delta = google::protobuf::Arena::CreateMessage<navora::sim::StateDelta>(&arena_);
+    auto* metadata = delta->mutable_metadata();
+    metadata->set_tick(sim_.get_tick());
+    metadata->set_sim_time(sim_.get_sim_time());
+    metadata->set_delta_time(sim_.get_fixed_dt());
+    return delta;
+  }
+
+  void add_packed_entity(navora::EntityHandle handle, const Body& body) {
+    packed_entities_.push_back({handle.index, navora::physics::Vector3(body.transform.position),
+                                navora::physics::Quaternion(body.transform.rotation),
+                                navora::physics::Vector3(body.linear_velocity)});
+  }
+
+  static void fill_packed(const navora::util::PackedTransforms& transforms,
+                          navora::sim::PackedTransforms* out) {
+    out->set_key(transforms.key);
+    set_vector(out->mutable_box_min(), transforms.box_min);
+    out->set_position_step(transforms.position_step);
+    out->set_velocity_step(transforms.velocity_step);
+    out->mutable_index_gaps()->Add(transforms.index_gaps.begin(), transforms.index_gaps.end());
+    out->mutable_positions()->Add(transforms.positions.begin(), transforms.positions.end());
+    out->mutable_rotations()->Add(transforms.rotations.begin(), transforms.rotations.end());
+    out->mutable_velocities()->Add(transforms.velocities.begin(), transforms.velocities.end());
+    out->mutable_motions()->Add(transforms.motions.begin(), transforms.motions.end());
+  }
+
+  static grpc::ByteBuffer serialize(const navora::sim::StateDelta* delta) {
+    grpc::Slice slice(delta->ByteSizeLong());
+    delta->SerializeWithCachedSizesToArray(const_cast<uint8_t*>(slice.begin()));
+    return grpc::ByteBuffer(&slice, 1);
+  }
+
+  void fill_hit(const navora::physics::QueryHit& hit, navora::sim::QueryResult* result) const {
+    result->set_hit(hit.hit);
+    if (!hit.hit) return;
+    result->set_entity_id(entity_name(hit.body));
+    result->set_entity_handle(sim_.get_all_entity_handles()[hit.body].to_u64());
+    result->set_distance(hit.distance);
+    set_vector(result->mutable_point(), hit.point);
+    set_vector(result->mutable_normal(), hit.normal);
+  }
+
+  void fill_overlaps(const navora::physics::OverlapResults& overlaps, int slot,
+                     navora::sim::QueryResult* result) const {
+    for (uint32_t k = overlaps.offsets[slot]; k < overlaps.offsets[slot + 1]; ++k) {
+      result->add_overlapping_ids(entity_name(overlaps.bodies[k]));
+      result->add_overlapping_handles(sim_.get_all_entity_handles()[overlaps.bodies[k]].to_u64());
+    }
+    result->set_hit(result->overlapping_ids_size() > 0);
+  }
+
+  std::string entity_name(uint32_t index) const {
+    const std::string& id = sim_.get_entity_id(index);
+    return id.empty() ? navora::default_entity_name(sim_.get_all_entity_handles()[index]) : id;
+  }
+
+  // Steps on absolute deadlines from the scheduler, so the rate holds at the
+  // target regardless of tick cost; see util::TickScheduler.
   void tick_loop() {
+    using Clock = navora::util::TickScheduler::Clock;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      scheduler_.start(Clock::now());
+    }
     while (sim_running_) {
+      Clock::time_point deadline;
       {
         std::lock_guard<std::mutex> lock(mutex_);
-        sim_.tick();
+        if (int steps = scheduler_.begin(Clock::now())) {
+          for (int step = 0; step < steps; ++step) {
+            sim_.tick();
+          }
+          scheduler_.end(Clock::now());
+          publish_frame(false);
+        }
+        deadline = scheduler_.next_deadline();
+      }
+      // std::mutex is not fair; at max speed, give RPCs waiting on mutex_ a
+      // chance to take it before the next step.
+      if (scheduler_.get_settings().max_speed) {
+        std::this_thread::yield();
+      } else {
+        std::this_thread::sleep_until(deadline);
       }
-      std::this_thread::sleep_for(std::chrono::milliseconds(16));
     }
   }
 
-  navora::Simulator sim_;
+  SimWorld sim_;
+  navora::util::TickScheduler scheduler_;
   std::mutex mutex_;
   std::atomic<bool> sim_running_;
   std::thread tick_thread_;
-  std::unordered_map<std::string, bool> consumers_;
+  // Open streams per consumer id, and how many of them are PACKED.
+  std::unordered_map<std::string, int> consumers_;
+  int packed_streams_ = 0;
+  // Publication state, written under mutex_. Streams read the frames without
+  // it; the parked stream lists, stream state and the fan-out handshake are
+  // guarded by streams_mutex_, which is taken after mutex_ when both are needed.
+  google::protobuf::Arena arena_;
+  uint64_t frame_seq_ = 0;
+  FramePtr latest_frame_;
+  FramePtr frames_[FRAME_HISTORY];
+  // PACKED encoder state; packed_version_ is the frame it last encoded.
+  navora::util::TransformPacker packer_;
+  uint64_t packed_version_ = 0;
+  std::vector<navora::util::PackedEntity> packed_entities_;
+  navora::util::PackedTransforms packed_transforms_;
+  std::vector<uint32_t> delta_indices_;
+  std::mutex streams_mutex_;
+  std::condition_variable frames_cv_;
+  uint64_t published_seq_ = 0;
+  bool fan_out_stop_ = false;
+  std::vector<StateStream*> waiting_streams_;
+  std::vector<StateStream*> lagging_streams_;
+  // Set by a lagging stream, cleared by the next publish_frame(), which adds
+  // the full state.
+  std::atomic<bool> full_frame_wanted_{false};
+  std::thread fan_out_thread_;
+  std::unordered_map<std::string, std::vector<char>> checkpoints_;
+  navora::usd::AsyncExporter exporter_;
   int next_entity_id_;
 };
 
-void RunServer() {
+bool RunServer(const navora::util::TickSchedulerSettings& schedule, const std::string& scene_path) {
   std::string server_address("0.0.0.0:50051");
-  CoordinatorServiceImpl service;
+  CoordinatorServiceImpl service(schedule);
+  if (!scene_path.empty()) {
+    std::string error;
+    if (!service.load_scene(scene_path, error)) {
+      std::cerr << error << std::endl;
+      return false;
+    }
+    std::cout << "Loaded scene " << scene_path << std::endl;
+  }
 
   ServerBuilder builder;
   builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
@@ -288,10 +986,35 @@ void RunServer() {
   std::unique_ptr<Server> server(builder.BuildAndStart());
   std::cout << "Coordinator server listening on " << server_address << std::endl;
   server->Wait();
+  return true;
 }
 
+// --tick-rate=<Hz> sets the fixed step and the wall-clock rate it runs at,
+// --max-catch-up=<steps> bounds the steps run back to back when behind, and
+// --max-speed steps as fast as possible for offline runs. --scene=<file>
+// starts from the entities of a USD file instead of the built-in scene.
 int main(int argc, char** argv) {
-  RunServer();
-  return 0;
+  navora::util::TickSchedulerSettings schedule;
+  std::string scene_path;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg.rfind("--tick-rate=", 0) == 0) {
+      schedule.tick_rate = std::stod(arg.substr(12));
+    } else if (arg.rfind("--max-catch-up=", 0) == 0) {
+      schedule.max_catch_up = std::stoi(arg.substr(15));
+    } else if (arg == "--max-speed") {
+      schedule.max_speed = true;
+    } else if (arg.rfind("--scene=", 0) == 0) {
+      scene_path = arg.substr(8);
+    } else {
+      std::cerr << "Unknown argument: " << arg << std::endl;
+      return 1;
+    }
+  }
+  if (!(schedule.tick_rate > 0.0)) {
+    std::cerr << "--tick-rate must be positive" << std::endl;
+    return 1;
+  }
+  return RunServer(schedule, scene_path) ? 0 : 1;
 }
 
@@ -198,6 +198,9 @@ app.get('/api/sim/stream', (req, res) => {
         simTime: validateNumber(metadata.simTime || metadata.sim_time, 0),
         deltaTime: validateNumber(metadata.deltaTime || metadata.delta_time, 0)
       },
+      // The coordinator streams changes only; reset means created holds the
+      // whole world and anything else the client has is stale.
+      reset: Boolean(delta.reset),
       created: Array.isArray(delta.created) ? delta.created.map(e => {
         if (!e || !e.id) return null;
         return {
@@ -233,6 +236,8 @@ app.get('/api/sim/stream', (req, res) => {
         };
       }).filter(e => e !== null) : [],
       removed: Array.isArray(delta.removed) ? delta.removed.filter(id => id != null).map(id => String(id)) : [],
+      removedHandles: Array.isArray(delta.removedHandles || delta.removed_handles)
+        ? (delta.removedHandles || delta.removed_handles).map(h => String(h)) : [],
       updated: Array.isArray(delta.updated) ? delta.updated.map(e => {
         if (!e || !e.id) return null;
         return {
@@ -257,7 +262,7 @@ app.get('/api/sim/stream', (req, res) => {
               y: validateNumber(e.shape.size?.y, 1),
               z: validateNumber(e.shape.size?.z, 1)
             }
-          } : { type: 0, size: { x: 1, y: 1, z: 1 } },
+          } : null,
           physics: e.physics ? {
             linearVelocity: {
               x: validateNumber(e.physics.linearVelocity?.x || e.physics.linear_velocity?.x, 0),
@@ -53,6 +53,34 @@ class Controller:
         resp = self.stub.SendCommand(cmd)
         return resp.success
 
+    def raycast(self, origin, direction, max_distance=0.0):
+        query = sim_pb2.Query(
+            type=sim_pb2.Query.QueryType.RAYCAST,
+            origin=sim_pb2.Vector3(x=origin[0], y=origin[1], z=origin[2]),
+            direction=sim_pb2.Vector3(x=direction[0], y=direction[1], z=direction[2]),
+            max_distance=max_distance
+        )
+        resp = self.stub.Query(sim_pb2.QueryRequest(queries=[query]))
+        return resp.results[0]
+
+    def overlap_sphere(self, center, radius):
+        query = sim_pb2.Query(
+            type=sim_pb2.Query.QueryType.OVERLAP_SPHERE,
+            origin=sim_pb2.Vector3(x=center[0], y=center[1], z=center[2]),
+            radius=radius
+        )
+        resp = self.stub.Query(sim_pb2.QueryRequest(queries=[query]))
+        return list(resp.results[0].overlapping_ids)
+
+    def overlap_aabb(self, center, half_extents):
+        query = sim_pb2.Query(
+            type=sim_pb2.Query.QueryType.OVERLAP_AABB,
+            origin=sim_pb2.Vector3(x=center[0], y=center[1], z=center[2]),
+            half_extents=sim_pb2.Vector3(x=half_extents[0], y=half_extents[1], z=half_extents[2])
+        )
+        resp = self.stub.Query(sim_pb2.QueryRequest(queries=[query]))
+        return list(resp.results[0].overlapping_ids)
+
     def stream_state(self, callback):
         request = sim_pb2.StreamRequest(consumer_id="python_controller")
         for delta in self.stub.StreamState(request):